@@ -101,8 +101,33 @@ private:
 		return func;
 	};
 
+	// Elements of a sealed tree are owned by its root, so keep it alive,
+	// declared first to be released after obj
+	std::unique_ptr<ucl_object_t, ucl_deleter> root;
 	std::unique_ptr<ucl_object_t, ucl_deleter> obj;
 
+	Ucl child (const ucl_object_t *elt) const
+	{
+		Ucl res (elt);
+
+		if (elt && (elt->flags & UCL_OBJECT_PINNED)) {
+			res.root.reset (ucl_object_ref (root ? root.get () : obj.get ()));
+		}
+
+		return res;
+	}
+
+	// Values stored in new containers must not depend on a sealed root
+	static ucl_object_t *
+	own (const ucl_object_t *elt)
+	{
+		if (elt && (elt->flags & UCL_OBJECT_SEALED)) {
+			return ucl_object_copy (elt);
+		}
+
+		return ucl_object_ref (elt);
+	}
+
 public:
 	class const_iterator {
 	private:
@@ -112,24 +137,29 @@ public:
 			}
 		};
 		std::shared_ptr<void> it;
+		std::shared_ptr<Ucl> parent;
 		std::unique_ptr<Ucl> cur;
 	public:
 		typedef std::forward_iterator_tag iterator_category;
 
 		const_iterator(const Ucl &obj) {
+			parent = std::make_shared<Ucl>(obj);
 			it = std::shared_ptr<void>(ucl_object_iterate_new (obj.obj.get()),
 					ucl_iter_deleter());
-			cur.reset (new Ucl(ucl_object_iterate_safe (it.get(), true)));
+			cur.reset (new Ucl(parent->child (
+					ucl_object_iterate_safe (it.get(), true))));
 		}
 
 		const_iterator() {}
 		const_iterator(const const_iterator &other) {
 			it = other.it;
+			parent = other.parent;
 		}
 		~const_iterator() {}
 
 		const_iterator& operator=(const const_iterator &other) {
 			it = other.it;
+			parent = other.parent;
 			return *this;
 		}
 
@@ -150,7 +180,8 @@ public:
 		const_iterator& operator++()
 		{
 			if (it) {
-				cur.reset (new Ucl(ucl_object_iterate_safe (it.get(), true)));
+				cur.reset (new Ucl(parent->child (
+						ucl_object_iterate_safe (it.get(), true))));
 			}
 
 			if (!*cur) {
@@ -183,10 +214,15 @@ public:
 
 	Ucl(const Ucl &other) {
 		obj.reset (ucl_object_ref (other.obj.get()));
+
+		if (other.root) {
+			root.reset (ucl_object_ref (other.root.get()));
+		}
 	}
 
 	Ucl(Ucl &&other) {
 		obj.swap (other.obj);
+		root.swap (other.root);
 	}
 
 	Ucl() noexcept {
@@ -229,7 +265,7 @@ public:
 		auto cobj = obj.get ();
 
 		for (const auto &e : m) {
-			ucl_object_insert_key (cobj, ucl_object_ref (e.second.obj.get()),
+			ucl_object_insert_key (cobj, own (e.second.obj.get()),
 					e.first.data (), e.first.size (), true);
 		}
 	}
@@ -243,7 +279,7 @@ public:
 		auto cobj = obj.get ();
 
 		for (const auto &e : v) {
-			ucl_array_append (cobj, ucl_object_ref (e.obj.get()));
+			ucl_array_append (cobj, own (e.obj.get()));
 		}
 	}
 
@@ -302,10 +338,24 @@ public:
 		return res;
 	}
 
+	// Make the whole tree read-only: elements are owned by the root and are
+	// no longer refcounted, values taken from the tree keep the root alive
+	void seal ()
+	{
+		if (obj) {
+			ucl_object_seal (obj.get());
+		}
+	}
+
+	bool is_sealed () const
+	{
+		return ucl_object_is_sealed (obj.get());
+	}
+
 	const Ucl operator[] (size_t i) const
 	{
 		if (type () == UCL_ARRAY) {
-			return Ucl (ucl_array_find_index (obj.get(), i));
+			return child (ucl_array_find_index (obj.get(), i));
 		}
 
 		return Ucl (nullptr);
@@ -314,7 +364,7 @@ public:
 	const Ucl operator[](const std::string &key) const
 	{
 		if (type () == UCL_OBJECT) {
-			return Ucl (ucl_object_lookup_len (obj.get(),
+			return child (ucl_object_lookup_len (obj.get(),
 					key.data (), key.size ()));
 		}
 
@@ -140,11 +140,25 @@ typedef enum ucl_emitter {
 	UCL_EMIT_MAX /**< Unsupported emitter type */
 } ucl_emitter_t;
 
+/**
+ * Compression formats of inputs and compressed emitter outputs
+ */
+typedef enum ucl_compression_type {
+	UCL_COMPRESSION_NONE = 0, /**< Plain data */
+	UCL_COMPRESSION_GZIP, /**< gzip, requires zlib */
+	UCL_COMPRESSION_XZ, /**< xz, requires liblzma */
+	UCL_COMPRESSION_ZSTD /**< zstd, requires libzstd */
+} ucl_compression_type_t;
+
 /**
  * These flags defines parser behaviour. If you specify #UCL_PARSER_ZEROCOPY you must ensure
  * that the input memory is not freed if an object is in use. Moreover, if you want to use
  * zero-terminated keys and string values then you should not use zero-copy mode, as in this case
- * UCL still has to perform copying implicitly.
+ * UCL still has to perform copying implicitly. Files and descriptors parsed in zero-copy mode are
+ * kept mapped by the containers built from them; scalars are copied out of the input when they are
+ * referenced with ucl_object_ref() or copied, so they can outlive the tree. As with lazy
+ * unescaping this writes to the scalar, so such trees must not be shared between threads unless
+ * sealed.
  */
 typedef enum ucl_parser_flags {
 	UCL_PARSER_DEFAULT = 0,       /**< No special flags */
@@ -153,7 +167,9 @@ typedef enum ucl_parser_flags {
 	UCL_PARSER_NO_TIME = (1 << 2), /**< Do not parse time and treat time values as strings */
 	UCL_PARSER_NO_IMPLICIT_ARRAYS = (1 << 3), /** Create explicit arrays instead of implicit ones */
 	UCL_PARSER_SAVE_COMMENTS = (1 << 4), /** Save comments in the parser context */
-	UCL_PARSER_DISABLE_MACRO = (1 << 5) /** Treat macros as comments */
+	UCL_PARSER_DISABLE_MACRO = (1 << 5), /** Treat macros as comments */
+	UCL_PARSER_PACK_ARRAYS = (1 << 6), /** Pack arrays of integers or floats */
+	UCL_PARSER_LAZY_UNESCAPE = (1 << 7) /** Unescape strings on the first access, input must be kept as for zero-copy mode. The first access writes to string objects, so parsed trees must not be read from multiple threads unless sealed (sealing unescapes all strings) */
 } ucl_parser_flags_t;
 
 /**
@@ -185,7 +201,12 @@ typedef enum ucl_object_flags {
 	UCL_OBJECT_MULTILINE = (1 << 4), /**< String should be displayed as multiline string */
 	UCL_OBJECT_MULTIVALUE = (1 << 5), /**< Object is a key with multiple values */
 	UCL_OBJECT_INHERITED = (1 << 6), /**< Object has been inherited from another */
-	UCL_OBJECT_BINARY = (1 << 7) /**< Object contains raw binary data */
+	UCL_OBJECT_BINARY = (1 << 7), /**< Object contains raw binary data */
+	UCL_OBJECT_SEALED = (1 << 8), /**< Object belongs to a sealed tree and cannot be modified */
+	UCL_OBJECT_PINNED = (1 << 9), /**< Refcount is pinned, object is owned by the sealed tree root */
+	UCL_OBJECT_NEED_UNESCAPE = (1 << 10), /**< String value is not yet unescaped */
+	UCL_OBJECT_DEFERRED = (1 << 11), /**< Container is not yet parsed */
+	UCL_OBJECT_BORROWED = (1 << 12) /**< Key or string value may refer to the parser input */
 } ucl_object_flags_t;
 
 /**
@@ -230,7 +251,8 @@ typedef struct ucl_object_s {
 	uint32_t len;							/**< Size of an object		*/
 	uint32_t ref;							/**< Reference count		*/
 	uint16_t flags;							/**< Object flags			*/
-	uint16_t type;							/**< Real type				*/
+	uint8_t type;							/**< Real type				*/
+	uint8_t priority;						/**< Priority (0-15)		*/
 	unsigned char* trash_stack[2];			/**< Pointer to allocated chunks */
 } ucl_object_t;
 
@@ -285,6 +307,28 @@ UCL_EXTERN ucl_object_t* ucl_object_typed_new (ucl_type_t type) UCL_WARN_UNUSED_
 UCL_EXTERN ucl_object_t* ucl_object_new_full (ucl_type_t type, unsigned priority)
 	UCL_WARN_UNUSED_RESULT;
 
+/**
+ * Create new object with type and priority specified preallocating space
+ * for `reserved` elements if an object is an array or an object, so it could
+ * be filled without reallocations
+ * @param type type of a new object
+ * @param priority priority of an object
+ * @param reserved number of elements to reserve space for
+ * @return new object
+ */
+UCL_EXTERN ucl_object_t* ucl_object_new_reserved (ucl_type_t type,
+		unsigned priority, size_t reserved) UCL_WARN_UNUSED_RESULT;
+
+/**
+ * Preallocate space for `reserved` elements in an array or an object, so
+ * that inserting them does not cause any reallocations or rehashing. Existing
+ * elements are preserved, the storage is never shrunk
+ * @param obj array or object
+ * @param reserved total number of elements to reserve space for
+ * @return true if space has been reserved
+ */
+UCL_EXTERN bool ucl_object_reserve (ucl_object_t *obj, size_t reserved);
+
 /**
  * Create new object with userdata dtor
  * @param dtor destructor function
@@ -405,6 +449,33 @@ UCL_EXTERN bool ucl_object_replace_key (ucl_object_t *top, ucl_object_t *elt,
  */
 UCL_EXTERN bool ucl_object_merge (ucl_object_t *top, ucl_object_t *elt, bool copy);
 
+/**
+ * Configuration layer for ucl_object_merge_layers()
+ */
+struct ucl_merge_layer {
+	const ucl_object_t *obj; /**< parsed tree, must be of type UCL_OBJECT */
+	unsigned priority; /**< priority of all values in the layer (0-15) */
+	enum ucl_duplicate_strategy strategy; /**< how to treat keys already defined */
+};
+
+/**
+ * Merge `nlayers` configuration layers in a single pass. Layers are applied
+ * in order, conflicts are resolved exactly as if all layers were parsed by a
+ * single parser with the corresponding priorities and duplicate strategies,
+ * but every key is resolved once for all layers, so no intermediate
+ * implicit arrays are created. Values that come from a single layer are not
+ * copied but referenced, so the result must not outlive sealed layers and
+ * modifications of shared values are visible in layers; use
+ * ucl_object_copy() to get an independent tree.
+ * @param layers array of layers
+ * @param nlayers number of layers
+ * @return merged object or NULL if some layer is not an object or a duplicate
+ * key has been found in a layer with UCL_DUPLICATE_ERROR strategy
+ */
+UCL_EXTERN ucl_object_t* ucl_object_merge_layers (
+		const struct ucl_merge_layer *layers, size_t nlayers)
+		UCL_WARN_UNUSED_RESULT;
+
 /**
  * Delete a object associated with key 'key', old object will be unrefered,
  * @param top object
@@ -477,6 +548,14 @@ UCL_EXTERN bool ucl_array_append (ucl_object_t *top,
 UCL_EXTERN bool ucl_array_prepend (ucl_object_t *top,
 		ucl_object_t *elt);
 
+/**
+ * Preallocate space for `reserved` elements in an array
+ * @param top destination object (must be of type UCL_ARRAY)
+ * @param reserved total number of elements to reserve space for
+ * @return true if space has been reserved
+ */
+UCL_EXTERN bool ucl_array_reserve (ucl_object_t *top, size_t reserved);
+
 /**
  * Merge all elements of second array into the first array
  * @param top destination array (must be of type UCL_ARRAY)
@@ -548,6 +627,93 @@ UCL_EXTERN const ucl_object_t* ucl_array_find_index (const ucl_object_t *top,
 UCL_EXTERN unsigned int ucl_array_index_of (ucl_object_t *top,
 		ucl_object_t *elt);
 
+/**
+ * Convert a homogeneous array of integers or floats to the packed form:
+ * values are stored in a contiguous vector instead of separate objects.
+ * Packed arrays are transparent for all array functions and iterators.
+ * Lookups and iterators return ephemeral element objects that are valid
+ * until the array is modified or freed (`ucl_object_ref` copies them), the
+ * array itself stays packed, so sealed packed arrays may be read from many
+ * threads. Modifications convert an array back to the normal form. If
+ * element objects cannot be allocated, lookups and iterators return NULL and
+ * modifications return false. Emitting, hashing and comparison read packed
+ * values directly and never fail.
+ * @param top array to pack
+ * @return true if an array is packed
+ */
+UCL_EXTERN bool ucl_array_pack (ucl_object_t *top);
+
+/**
+ * Check whether an array is stored in the packed form
+ * @param top array object
+ * @return true if an array is packed
+ */
+UCL_EXTERN bool ucl_array_is_packed (const ucl_object_t *top);
+
+/**
+ * Create a packed array of integers copying `nelts` values
+ * @param values values to copy
+ * @param nelts number of values
+ * @return new array
+ */
+UCL_EXTERN ucl_object_t* ucl_array_new_packed_int (const int64_t *values,
+		size_t nelts) UCL_WARN_UNUSED_RESULT;
+
+/**
+ * Create a packed array of floats copying `nelts` values
+ * @param values values to copy
+ * @param nelts number of values
+ * @return new array
+ */
+UCL_EXTERN ucl_object_t* ucl_array_new_packed_double (const double *values,
+		size_t nelts) UCL_WARN_UNUSED_RESULT;
+
+/**
+ * Return values of a packed array of integers without copying. The pointer
+ * is valid until an array is modified
+ * @param top array object
+ * @param nelts output number of values
+ * @return values or NULL if `top` is not a packed array of integers
+ */
+UCL_EXTERN const int64_t* ucl_array_packed_int (const ucl_object_t *top,
+		size_t *nelts);
+
+/**
+ * Return values of a packed array of floats without copying. The pointer
+ * is valid until an array is modified
+ * @param top array object
+ * @param nelts output number of values
+ * @return values or NULL if `top` is not a packed array of floats
+ */
+UCL_EXTERN const double* ucl_array_packed_double (const ucl_object_t *top,
+		size_t *nelts);
+
+/**
+ * Calculate sum, minimum and maximum of an array of integers, packed arrays
+ * are processed using vector instructions when available. The sum wraps
+ * around on overflow
+ * @param top array object
+ * @param sum output sum (may be NULL)
+ * @param min output minimum (may be NULL)
+ * @param max output maximum (may be NULL)
+ * @return false if `top` is empty or not an array of integers
+ */
+UCL_EXTERN bool ucl_array_int_stats (const ucl_object_t *top,
+		int64_t *sum, int64_t *min, int64_t *max);
+
+/**
+ * Calculate sum, minimum and maximum of an array of floats, packed arrays
+ * are processed using vector instructions when available, so the order of
+ * summation is unspecified. Results are unspecified if an array contains NaN
+ * @param top array object
+ * @param sum output sum (may be NULL)
+ * @param min output minimum (may be NULL)
+ * @param max output maximum (may be NULL)
+ * @return false if `top` is empty or not an array of floats
+ */
+UCL_EXTERN bool ucl_array_double_stats (const ucl_object_t *top,
+		double *sum, double *min, double *max);
+
 /**
  * Replace an element in an array with a different element, returning the object
  * that was replaced. This object is not released, caller must unref the
@@ -745,6 +911,42 @@ UCL_DEPRECATED(UCL_EXTERN void ucl_object_free (ucl_object_t *obj));
  */
 UCL_EXTERN void ucl_object_unref (ucl_object_t *obj);
 
+/**
+ * Seal the whole tree starting from `obj` making it read-only. All functions
+ * that modify objects refuse to work with sealed objects. Reference counts
+ * of all elements below `obj` are pinned: `ucl_object_ref` and
+ * `ucl_object_unref` do not touch them, so the tree could be read from
+ * multiple threads without any atomic operations. The lifetime of all
+ * elements is bound to the root object which is still refcounted as usual,
+ * so references to inner elements must not outlive the root. Sealed objects
+ * cannot be inserted into other objects as this would change their keys, use
+ * `ucl_object_copy` to get a mutable copy instead.
+ * @param obj the root object of the tree to seal
+ */
+UCL_EXTERN void ucl_object_seal (ucl_object_t *obj);
+
+/**
+ * Check whether an object is a part of a sealed tree
+ * @param obj object to check
+ * @return true if an object cannot be modified
+ */
+UCL_EXTERN bool ucl_object_is_sealed (const ucl_object_t *obj);
+
+/**
+ * Calculate 64 bit hash of the object's content including all nested
+ * elements and implicit array members. Hashes do not depend on the order of
+ * keys in objects or on how implicit arrays were built, so equal objects
+ * always have equal hashes, but equal hashes do not imply equal objects.
+ * Hashes of sealed containers are computed by `ucl_object_seal` and cached,
+ * so checking that sealed subtrees differ is cheap. Mutable objects have no
+ * cache and are rehashed on each call. `ucl_object_compare` does not use
+ * hashes and no deduplication of identical subtrees is done: callers may use
+ * the hash as a key to find candidates and confirm them with a comparison.
+ * @param obj object to hash
+ * @return hash value
+ */
+UCL_EXTERN uint64_t ucl_object_hash (const ucl_object_t *obj);
+
 /**
  * Compare objects `o1` and `o2`
  * @param o1 the first object
@@ -779,6 +981,47 @@ UCL_EXTERN int ucl_object_compare_qsort (const ucl_object_t **o1,
 UCL_EXTERN void ucl_object_array_sort (ucl_object_t *ar,
 		int (*cmp)(const ucl_object_t **o1, const ucl_object_t **o2));
 
+/**
+ * Generate a list of JSON Patch (RFC 6902) operations that transform `from`
+ * to `to`. Identical subtrees are detected by their hashes and skipped.
+ * Subtrees of mutable objects with equal hashes are also compared deeply.
+ * For containers of sealed trees equal cached hashes are trusted, so in the
+ * unlikely case of a 64 bit hash collision a changed sealed subtree is not
+ * reported; callers that cannot accept that should diff mutable copies.
+ * Objects are compared key by key, arrays element by element, scalars and
+ * keys with multiple values are replaced as a whole.
+ * @param from the original object
+ * @param to the new object
+ * @return UCL_ARRAY of operations (empty if objects are equal), must be
+ * unref'ed by a caller
+ */
+UCL_EXTERN ucl_object_t* ucl_object_diff (const ucl_object_t *from,
+		const ucl_object_t *to) UCL_WARN_UNUSED_RESULT;
+
+/**
+ * Apply JSON Patch (RFC 6902) to an object. All operations (`add`, `remove`,
+ * `replace`, `move`, `copy` and `test`) are supported. Patch is applied
+ * atomically: on success `*top` is replaced with the patched object,
+ * otherwise it is left untouched.
+ * @param top pointer to the target object
+ * @param patch UCL_ARRAY of operations
+ * @return true if all operations have been applied
+ */
+UCL_EXTERN bool ucl_object_patch (ucl_object_t **top,
+		const ucl_object_t *patch);
+
+/**
+ * Apply JSON Merge Patch (RFC 7386) to an object: keys with `null` values
+ * are removed, objects are merged recursively and all other values replace
+ * the corresponding values in the target. Sealed targets and sealed subtrees
+ * are copied, so sealed trees are never modified.
+ * @param top pointer to the target object, replaced with the result
+ * @param patch merge patch object
+ * @return true if patch has been applied
+ */
+UCL_EXTERN bool ucl_object_merge_patch (ucl_object_t **top,
+		const ucl_object_t *patch);
+
 /**
  * Get the priority for specific UCL object
  * @param obj any ucl object
@@ -905,6 +1148,72 @@ UCL_EXTERN void ucl_parser_set_filename (struct ucl_parser *parser, const char *
  */
 UCL_EXTERN bool ucl_parser_set_default_priority (struct ucl_parser *parser,
 		unsigned prio);
+
+/**
+ * Defer parsing of objects and arrays nested deeper than `depth` levels:
+ * the parser only finds their bounds and they are parsed on the first lookup
+ * or iteration. As with zero-copy mode the input must not be freed while
+ * such objects are in use, the contents of files and includes are always
+ * parsed immediately, as are containers with single quotes or heredocs.
+ * Syntax errors inside deferred containers are detected when they are parsed,
+ * see ucl_object_materialize().
+ * @param parser parser object
+ * @param depth nesting level to defer containers from, 0 disables deferring
+ * @return true if the depth has been set
+ */
+UCL_EXTERN bool ucl_parser_set_lazy_depth (struct ucl_parser *parser,
+		unsigned depth);
+
+/**
+ * Limit nesting of objects and arrays, parsing fails with #UCL_ENESTED when
+ * the limit is exceeded
+ * @param parser parser object
+ * @param depth maximum number of nested containers, 0 means no limit (default)
+ * @return true if the limit has been set
+ */
+UCL_EXTERN bool ucl_parser_set_max_depth (struct ucl_parser *parser,
+		unsigned depth);
+
+/**
+ * Limit nesting of included files, 16 by default
+ * @param parser parser object
+ * @param recursion maximum number of nested chunks, must not be 0
+ * @return true if the limit has been set
+ */
+UCL_EXTERN bool ucl_parser_set_max_recursion (struct ucl_parser *parser,
+		unsigned recursion);
+
+/**
+ * Limit the size of compressed files and descriptors once decompressed,
+ * parsing fails when the limit is exceeded. Sizes stored in compressed data
+ * are not trusted for allocations beyond the limit.
+ * @param parser parser object
+ * @param size maximum size in bytes, 0 means no limit, 256 MiB by default
+ * @return true if the limit has been set
+ */
+UCL_EXTERN bool ucl_parser_set_max_decompressed_size (struct ucl_parser *parser,
+		size_t size);
+
+/**
+ * Select a path to be parsed, keys that do not belong to any of the selected
+ * paths are skipped without building objects. Components of a path select keys
+ * of objects as in ucl_object_lookup_path() and apply to every element of
+ * arrays. Paths must be added before any data is parsed.
+ * @param parser parser object
+ * @param path dotted path, e.g. "section.key"
+ * @return true if the path has been added
+ */
+UCL_EXTERN bool ucl_parser_add_projection (struct ucl_parser *parser,
+		const char *path);
+
+/**
+ * Parse containers deferred by ucl_parser_set_lazy_depth()
+ * @param obj object to parse
+ * @param recursive parse all nested deferred containers as well
+ * @return false if some deferred container has invalid syntax, it is left empty
+ */
+UCL_EXTERN bool ucl_object_materialize (const ucl_object_t *obj,
+		bool recursive);
 /**
  * Register new handler for a macro
  * @param parser parser object
@@ -959,6 +1268,56 @@ UCL_EXTERN void ucl_parser_register_variable (struct ucl_parser *parser, const c
 UCL_EXTERN void ucl_parser_set_variables_handler (struct ucl_parser *parser,
 		ucl_variable_handler handler, void *ud);
 
+/**
+ * Handler to fetch includes without blocking the parser. The contents must be
+ * passed to #ucl_parser_include_data once fetched, this may be done from the
+ * handler itself
+ * @param id identifier of the include
+ * @param name path or url of the include
+ * @param is_url true if `name` is an url
+ * @param ud opaque userdata
+ */
+typedef void (*ucl_include_fetcher) (unsigned id, const char *name,
+		bool is_url, void *ud);
+
+/**
+ * Set handler to fetch includes. The parser does not load included files and
+ * urls itself, but asks the handler and continues parsing, so independent
+ * includes can be fetched concurrently. Contents supplied from the handler
+ * itself while no other include is pending are parsed at the directive, as a
+ * blocking include would be. Contents supplied later are parsed into the
+ * objects where include directives are, in the order of directives, but after
+ * the data that follows the directive in the same chunk: an include with
+ * `a = 1` followed by `a = 2` yields `a = [2, 1]` rather than `[1, 2]`, so
+ * priorities should be used to override values. Signed includes, glob patterns
+ * and includes with search paths are still loaded by the parser.
+ * @param parser parser structure
+ * @param fetcher handler or NULL to load includes by the parser
+ * @param ud opaque data for the handler
+ */
+UCL_EXTERN void ucl_parser_set_include_fetcher (struct ucl_parser *parser,
+		ucl_include_fetcher fetcher, void *ud);
+
+/**
+ * Supply contents of an include requested by an include fetcher, the data is
+ * copied
+ * @param parser parser structure
+ * @param id identifier of the include
+ * @param data contents or NULL if the include cannot be fetched
+ * @param len length of contents
+ * @return false if the include or an include parsed after it has failed
+ */
+UCL_EXTERN bool ucl_parser_include_data (struct ucl_parser *parser,
+		unsigned id, const unsigned char *data, size_t len);
+
+/**
+ * Get number of includes waiting for their contents, the parsed object is
+ * complete when it is zero
+ * @param parser parser structure
+ * @return number of pending includes
+ */
+UCL_EXTERN unsigned ucl_parser_pending_includes (struct ucl_parser *parser);
+
 /**
  * Load new chunk to a parser
  * @param parser parser structure
@@ -996,6 +1355,42 @@ UCL_EXTERN bool ucl_parser_add_chunk_full (struct ucl_parser *parser,
 		const unsigned char *data, size_t len, unsigned priority,
 		enum ucl_duplicate_strategy strat, enum ucl_parse_type parse_type);
 
+/**
+ * Progress of a chunk parsed in slices
+ */
+enum ucl_parser_progress {
+	UCL_PROGRESS_ERROR = 0, /**< Parsing has failed */
+	UCL_PROGRESS_DONE, /**< The whole chunk has been parsed */
+	UCL_PROGRESS_AGAIN /**< Budget is exhausted, call #ucl_parser_resume */
+};
+
+/**
+ * Parse a chunk until a budget is exhausted, so parsing of a large document
+ * can be interleaved with other work. The data must stay valid until the
+ * chunk is parsed, no other chunks can be added meanwhile and the parsed object
+ * is incomplete until UCL_PROGRESS_DONE is returned. A slice can exceed the
+ * budget by a single value, as the parser stops between values only
+ * @param parser parser structure
+ * @param data the pointer to the beginning of a chunk
+ * @param len the length of a chunk
+ * @param max_bytes bytes to parse in this slice or 0 for no limit
+ * @param max_time seconds to parse in this slice or 0 for no limit
+ * @return progress of parsing
+ */
+UCL_EXTERN enum ucl_parser_progress ucl_parser_add_chunk_sliced (
+		struct ucl_parser *parser, const unsigned char *data, size_t len,
+		size_t max_bytes, double max_time);
+
+/**
+ * Continue parsing of a chunk started by #ucl_parser_add_chunk_sliced
+ * @param parser parser structure
+ * @param max_bytes bytes to parse in this slice or 0 for no limit
+ * @param max_time seconds to parse in this slice or 0 for no limit
+ * @return progress of parsing
+ */
+UCL_EXTERN enum ucl_parser_progress ucl_parser_resume (
+		struct ucl_parser *parser, size_t max_bytes, double max_time);
+
 /**
  * Load ucl object from a string
  * @param parser parser structure
@@ -1019,7 +1414,8 @@ UCL_EXTERN bool ucl_parser_add_string_priority (struct ucl_parser *parser,
 		const char *data, size_t len, unsigned priority);
 
 /**
- * Load and add data from a file
+ * Load and add data from a file, FIFOs and devices are read as with
+ * ucl_parser_add_fd()
  * @param parser parser structure
  * @param filename the name of file
  * @param err if *err is NULL it is set to parser error
@@ -1041,7 +1437,22 @@ UCL_EXTERN bool ucl_parser_add_file_priority (struct ucl_parser *parser,
 		const char *filename, unsigned priority);
 
 /**
- * Load and add data from a file descriptor
+ * Load and add data from a file with the specified merge strategy and format
+ * @param parser parser structure
+ * @param filename the name of file
+ * @param priority the desired priority of a chunk (only 4 least significant bits
+ * are considered for this parameter)
+ * @param strat merge strategy in case of duplicate keys
+ * @param parse_type input format
+ * @return true if chunk has been added and false in case of error
+ */
+UCL_EXTERN bool ucl_parser_add_file_full (struct ucl_parser *parser,
+		const char *filename, unsigned priority,
+		enum ucl_duplicate_strategy strat, enum ucl_parse_type parse_type);
+
+/**
+ * Load and add data from a file descriptor. Regular files are mapped to memory,
+ * other descriptors such as pipes or sockets are read till the end of file
  * @param parser parser structure
  * @param filename the name of file
  * @param err if *err is NULL it is set to parser error
@@ -1072,6 +1483,17 @@ UCL_EXTERN bool ucl_parser_add_fd_priority (struct ucl_parser *parser,
 UCL_EXTERN bool ucl_set_include_path (struct ucl_parser *parser,
 		ucl_object_t *paths);
 
+/**
+ * Keep documents fetched by URL includes and schema references in a
+ * directory. Cached documents are revalidated with conditional requests using
+ * their ETag and Last-Modified time and are used as is when a server cannot be
+ * reached or answers with an error. This setting is global and should be changed before any parsing
+ * starts.
+ * @param dir directory for the cache (created if missing) or NULL to disable
+ * caching
+ */
+UCL_EXTERN void ucl_set_url_cache (const char *dir);
+
 /**
  * Get a top object for a parser (refcount is increased)
  * @param parser parser structure
@@ -1120,6 +1542,69 @@ UCL_EXTERN void ucl_parser_clear_error (struct ucl_parser *parser);
  */
 UCL_EXTERN void ucl_parser_free (struct ucl_parser *parser);
 
+/**
+ * Reset parser to accept a new document. The parsed object, chunks, errors
+ * and comments are released, while registered macros, variables, include
+ * paths, public keys, verified signatures, projections and parser settings
+ * are preserved.
+ * @param parser parser object
+ * @return true if parser has been reset
+ */
+UCL_EXTERN bool ucl_parser_reset (struct ucl_parser *parser);
+
+/**
+ * Get a parser with the specified flags from the pool of the calling thread
+ * or create a new one if there is no suitable idle parser. A pooled parser
+ * is in the same state as one returned by ucl_parser_new(): nothing
+ * configured by its previous user is kept.
+ * @param flags parser flags
+ * @return parser object
+ */
+UCL_EXTERN struct ucl_parser* ucl_parser_pool_get (int flags);
+
+/**
+ * Reset parser and return it to the pool of the calling thread, the parser
+ * is freed if the pool is full. Unlike ucl_parser_reset() this also drops
+ * registered macros, variables, include paths, public keys, verified
+ * signatures, projections, the include fetcher and parser settings.
+ * @param parser parser object
+ */
+UCL_EXTERN void ucl_parser_pool_put (struct ucl_parser *parser);
+
+/**
+ * Free all idle parsers of the calling thread's pool, should be called
+ * before a thread that has used the pool exits
+ */
+UCL_EXTERN void ucl_parser_pool_drain (void);
+
+/**
+ * Document for #ucl_parse_batch
+ */
+struct ucl_batch_item {
+	const unsigned char *data; /**< Document data */
+	size_t len; /**< Length of data */
+	enum ucl_parse_type parse_type; /**< Format of the document */
+	int flags; /**< Parser flags */
+	unsigned priority; /**< Priority of the parsed values */
+	ucl_object_t *obj; /**< Parsed object or NULL, set by the batch */
+	char *err; /**< Error description or NULL, set by the batch, must be freed */
+};
+
+/**
+ * Parse independent documents concurrently. Documents are split between
+ * worker threads, which reuse a parser for documents with the same flags and
+ * take documents from busy workers once they are done with their own. Each
+ * document is parsed by a fresh or reset parser, so no macros or variables
+ * other than built-in ones are available
+ * @param items documents, results are stored in the same items
+ * @param nitems number of documents
+ * @param nthreads maximum number of threads including the calling one, 0 for
+ * the number of online CPUs
+ * @return number of documents that have failed to parse
+ */
+UCL_EXTERN size_t ucl_parse_batch (struct ucl_batch_item *items,
+		size_t nitems, unsigned int nthreads);
+
 /**
  * Get constant opaque pointer to comments structure for this parser. Increase
  * refcount to prevent this object to be destroyed on parser's destruction
@@ -1158,6 +1643,87 @@ UCL_EXTERN bool ucl_parser_pubkey_add (struct ucl_parser *parser,
 UCL_EXTERN bool ucl_parser_set_filevars (struct ucl_parser *parser, const char *filename,
 		bool need_expand);
 
+/**
+ * Opaque watcher of a configuration file and the files it includes
+ */
+struct ucl_watcher;
+
+/**
+ * Create a parser for a watcher, it may register variables, macros and
+ * handlers the configuration needs
+ * @param ud opaque userdata
+ * @return new parser or NULL
+ */
+typedef struct ucl_parser* (*ucl_watcher_parser_cb) (void *ud);
+
+/**
+ * Create a watcher that keeps an object parsed from a file up to date. Each
+ * file processed by an include is recorded with the container it has been
+ * included into and the keys it has added, so that when it changes only this
+ * file is parsed again and its keys are replaced in a new top object that
+ * shares all other data with the previous one. Files whose keys are mixed with
+ * other data, signed files and files included into arrays are reparsed with
+ * their including file. On Linux files, directories of included files and
+ * directories of glob patterns are watched with inotify
+ * @param filename top configuration file
+ * @param cb function to create parsers or NULL to use `ucl_parser_new (0)`
+ * @param ud opaque data for `cb`
+ * @return new watcher or NULL
+ */
+UCL_EXTERN struct ucl_watcher* ucl_watcher_new (const char *filename,
+		ucl_watcher_parser_cb cb, void *ud);
+
+/**
+ * Get a descriptor that becomes readable when watched files change
+ * @param watcher watcher
+ * @return descriptor to poll or -1 if files cannot be watched
+ */
+UCL_EXTERN int ucl_watcher_get_fd (struct ucl_watcher *watcher);
+
+/**
+ * Mark a file as changed, for example when changes are detected by other
+ * means than inotify
+ * @param watcher watcher
+ * @param path absolute path of a file
+ */
+UCL_EXTERN void ucl_watcher_notify (struct ucl_watcher *watcher,
+		const char *path);
+
+/**
+ * Parse changed files and update the top object, the first call parses the
+ * whole configuration. If parsing fails the previous object is kept, and the
+ * file that has failed and changed files not parsed yet are parsed again by
+ * the next update
+ * @param watcher watcher
+ * @param changes if not NULL, set to an object with `files` array of changed
+ * files and `paths` array of JSON pointers to changed values or to NULL if no
+ * files have changed, must be unref'ed by a caller
+ * @return true if the object is up to date
+ */
+UCL_EXTERN bool ucl_watcher_update (struct ucl_watcher *watcher,
+		ucl_object_t **changes);
+
+/**
+ * Get the top object of a watcher (refcount is increased). The object must not
+ * be modified as its values are shared with the objects made by updates
+ * @param watcher watcher
+ * @return top object or NULL if nothing has been parsed yet
+ */
+UCL_EXTERN ucl_object_t* ucl_watcher_get_object (struct ucl_watcher *watcher);
+
+/**
+ * Get the error of the last update
+ * @param watcher watcher
+ * @return error description or NULL
+ */
+UCL_EXTERN const char* ucl_watcher_get_error (struct ucl_watcher *watcher);
+
+/**
+ * Free a watcher and stop watching files
+ * @param watcher watcher
+ */
+UCL_EXTERN void ucl_watcher_free (struct ucl_watcher *watcher);
+
 /** @} */
 
 /**
@@ -1320,6 +1886,20 @@ UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_file_funcs (
 UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_fd_funcs (
 		int fd);
 
+/**
+ * Returns functions that compress the output incrementally and pass it to
+ * another set of functions, any emitter type can be used with them. The
+ * compressed stream is finished by ucl_object_emit_funcs_free(), `sink`
+ * is not owned and must be freed after that
+ * @param sink functions to write compressed data to
+ * @param type compression format
+ * @param level compression level, 0 means the default one of the format
+ * @return emitter functions structure or NULL if the format is not supported
+ */
+UCL_EXTERN struct ucl_emitter_functions* ucl_object_emit_compressed_funcs (
+		struct ucl_emitter_functions *sink, enum ucl_compression_type type,
+		int level);
+
 /**
  * Free emitter functions
  * @param f pointer to functions
@@ -761,6 +761,28 @@ lua_ucl_object_unwrap (lua_State *L)
 	return 1;
 }
 
+/***
+ * @method object:seal()
+ * Makes opaque ucl object read-only. Sealed objects are not refcounted
+ * internally, so they could be shared cheaply.
+ * @return {ucl.object} the same object
+ */
+static int
+lua_ucl_object_seal (lua_State *L)
+{
+	ucl_object_t *obj;
+
+	obj = lua_ucl_object_get (L, 1);
+
+	if (obj) {
+		ucl_object_seal (obj);
+	}
+
+	lua_pushvalue (L, 1);
+
+	return 1;
+}
+
 /***
  * @method object:tostring(type)
  * Unwraps opaque ucl object to string (json by default). Optionally you can
@@ -977,6 +999,9 @@ lua_ucl_object_mt (lua_State *L)
 	lua_pushcfunction (L, lua_ucl_object_validate);
 	lua_setfield (L, -2, "validate");
 
+	lua_pushcfunction (L, lua_ucl_object_seal);
+	lua_setfield (L, -2, "seal");
+
 	lua_pushstring (L, OBJECT_META);
 	lua_setfield (L, -2, "class");
 
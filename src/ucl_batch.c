@@ -0,0 +1,303 @@
+/* Copyright (c) 2016, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Parsing of independent documents on a pool of threads. Each worker owns a
+ * contiguous range of documents and takes them from its front, an idle worker
+ * steals the back half of the largest remaining range
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ucl.h"
+#include "ucl_internal.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* Upper limit of threads started for a batch */
+#define UCL_BATCH_MAX_THREADS 64
+
+struct ucl_batch_queue {
+	size_t front;
+	size_t back;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+#endif
+};
+
+struct ucl_batch {
+	struct ucl_batch_item *items;
+	struct ucl_batch_queue *queues;
+	unsigned int nqueues;
+};
+
+struct ucl_batch_worker {
+	struct ucl_batch *batch;
+	unsigned int id;
+	size_t failed;
+	/* Parsers are reset and reused for documents with the same flags */
+	struct ucl_parser *parsers[UCL_PARSER_POOL_SIZE];
+	unsigned int nparsers;
+};
+
+#ifdef HAVE_PTHREAD_H
+#define UCL_BATCH_LOCK(q) pthread_mutex_lock (&(q)->lock)
+#define UCL_BATCH_UNLOCK(q) pthread_mutex_unlock (&(q)->lock)
+#else
+#define UCL_BATCH_LOCK(q) do {} while (0)
+#define UCL_BATCH_UNLOCK(q) do {} while (0)
+#endif
+
+/**
+ * Take the next document of a worker, stealing from others once its own range
+ * is exhausted
+ * @return false if no documents are left
+ */
+static bool
+ucl_batch_take (struct ucl_batch *b, unsigned int self, size_t *idx)
+{
+	struct ucl_batch_queue *q = &b->queues[self], *victim;
+	size_t remain, best, front, back;
+	unsigned int i;
+
+	for (;;) {
+		UCL_BATCH_LOCK (q);
+		if (q->front < q->back) {
+			*idx = q->front ++;
+			UCL_BATCH_UNLOCK (q);
+
+			return true;
+		}
+		UCL_BATCH_UNLOCK (q);
+
+		victim = NULL;
+		best = 0;
+
+		for (i = 0; i < b->nqueues; i ++) {
+			if (i == self) {
+				continue;
+			}
+
+			UCL_BATCH_LOCK (&b->queues[i]);
+			remain = b->queues[i].back - b->queues[i].front;
+			UCL_BATCH_UNLOCK (&b->queues[i]);
+
+			if (remain > best) {
+				best = remain;
+				victim = &b->queues[i];
+			}
+		}
+
+		if (victim == NULL) {
+			return false;
+		}
+
+		UCL_BATCH_LOCK (victim);
+		remain = victim->back - victim->front;
+		if (remain == 0) {
+			/* Taken meanwhile, look for another victim */
+			UCL_BATCH_UNLOCK (victim);
+			continue;
+		}
+		back = victim->back;
+		front = back - (remain + 1) / 2;
+		victim->back = front;
+		UCL_BATCH_UNLOCK (victim);
+
+		UCL_BATCH_LOCK (q);
+		q->front = front;
+		q->back = back;
+		UCL_BATCH_UNLOCK (q);
+	}
+}
+
+static void
+ucl_batch_parse (struct ucl_batch_worker *wrk, struct ucl_batch_item *item)
+{
+	struct ucl_parser *parser = NULL;
+	const char *err;
+	unsigned int i;
+
+	for (i = 0; i < wrk->nparsers; i ++) {
+		if (wrk->parsers[i]->flags == item->flags) {
+			parser = wrk->parsers[i];
+			break;
+		}
+	}
+
+	if (parser == NULL) {
+		parser = ucl_parser_new (item->flags);
+
+		if (parser == NULL) {
+			item->err = strdup ("cannot allocate parser");
+			wrk->failed ++;
+
+			return;
+		}
+
+		if (wrk->nparsers < UCL_PARSER_POOL_SIZE) {
+			wrk->parsers[wrk->nparsers ++] = parser;
+		}
+	}
+
+	if (ucl_parser_add_chunk_full (parser, item->data, item->len,
+			item->priority, UCL_DUPLICATE_APPEND, item->parse_type)) {
+		item->obj = ucl_parser_get_object (parser);
+	}
+	else {
+		err = ucl_parser_get_error (parser);
+		item->err = strdup (err != NULL ? err : "unknown error");
+		wrk->failed ++;
+	}
+
+	if (i < wrk->nparsers) {
+		ucl_parser_reset (parser);
+	}
+	else {
+		ucl_parser_free (parser);
+	}
+}
+
+static void *
+ucl_batch_run (void *ud)
+{
+	struct ucl_batch_worker *wrk = ud;
+	size_t idx;
+	unsigned int i;
+
+	while (ucl_batch_take (wrk->batch, wrk->id, &idx)) {
+		ucl_batch_parse (wrk, &wrk->batch->items[idx]);
+	}
+
+	for (i = 0; i < wrk->nparsers; i ++) {
+		ucl_parser_free (wrk->parsers[i]);
+	}
+
+	return NULL;
+}
+
+static unsigned int
+ucl_batch_threads (unsigned int nthreads, size_t nitems)
+{
+#if defined(HAVE_PTHREAD_H) && defined(_SC_NPROCESSORS_ONLN)
+	long ncpu;
+
+	if (nthreads == 0) {
+		ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? ncpu : 1;
+	}
+#elif !defined(HAVE_PTHREAD_H)
+	nthreads = 1;
+#endif
+
+	if (nthreads == 0) {
+		nthreads = 1;
+	}
+	if (nthreads > UCL_BATCH_MAX_THREADS) {
+		nthreads = UCL_BATCH_MAX_THREADS;
+	}
+	if (nthreads > nitems) {
+		nthreads = nitems;
+	}
+
+	return nthreads;
+}
+
+size_t
+ucl_parse_batch (struct ucl_batch_item *items, size_t nitems,
+		unsigned int nthreads)
+{
+	struct ucl_batch_queue queues[UCL_BATCH_MAX_THREADS];
+	struct ucl_batch_worker workers[UCL_BATCH_MAX_THREADS];
+	struct ucl_batch b;
+	ucl_object_t *warm;
+	size_t i, failed = 0;
+	unsigned int n, k;
+#ifdef HAVE_PTHREAD_H
+	pthread_t threads[UCL_BATCH_MAX_THREADS];
+#endif
+
+	if (items == NULL || nitems == 0) {
+		return 0;
+	}
+
+	for (i = 0; i < nitems; i ++) {
+		items[i].obj = NULL;
+		items[i].err = NULL;
+	}
+
+	/* The hash seed is set lazily and must be the same for all threads */
+	warm = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (warm, ucl_object_new (), "seed", 0, false);
+	ucl_object_unref (warm);
+
+	n = ucl_batch_threads (nthreads, nitems);
+	b.items = items;
+	b.queues = queues;
+	b.nqueues = n;
+
+	for (k = 0; k < n; k ++) {
+		queues[k].front = nitems * k / n;
+		queues[k].back = nitems * (k + 1) / n;
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_init (&queues[k].lock, NULL);
+#endif
+		memset (&workers[k], 0, sizeof (workers[k]));
+		workers[k].batch = &b;
+		workers[k].id = k;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	/* The calling thread is worker 0, ranges of failed threads are stolen */
+	for (k = 1; k < n; k ++) {
+		if (pthread_create (&threads[k], NULL, ucl_batch_run,
+				&workers[k]) != 0) {
+			workers[k].batch = NULL;
+		}
+	}
+#endif
+
+	ucl_batch_run (&workers[0]);
+
+#ifdef HAVE_PTHREAD_H
+	/* Any worker may still lock any queue until all of them are joined */
+	for (k = 1; k < n; k ++) {
+		if (workers[k].batch != NULL) {
+			pthread_join (threads[k], NULL);
+		}
+	}
+#endif
+
+	for (k = 0; k < n; k ++) {
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_destroy (&queues[k].lock);
+#endif
+		failed += workers[k].failed;
+	}
+
+	return failed;
+}
@@ -0,0 +1,714 @@
+/* Copyright (c) 2016, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Transparent decompression of gzip, xz and zstd inputs and compressed
+ * emitter functions
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ucl.h"
+#include "ucl_internal.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static const char *ucl_compression_names[] = {
+	[UCL_COMPRESSION_NONE] = "plain",
+	[UCL_COMPRESSION_GZIP] = "gzip",
+	[UCL_COMPRESSION_XZ] = "xz",
+	[UCL_COMPRESSION_ZSTD] = "zstd"
+};
+
+enum ucl_compression_type
+ucl_compression_detect (const unsigned char *data, size_t len)
+{
+	if (len >= 3 && data[0] == 0x1f && data[1] == 0x8b && data[2] == 0x08) {
+		return UCL_COMPRESSION_GZIP;
+	}
+	if (len >= 6 && memcmp (data, "\xfd" "7zXZ\0", 6) == 0) {
+		return UCL_COMPRESSION_XZ;
+	}
+	if (len >= 4 && memcmp (data, "\x28\xb5\x2f\xfd", 4) == 0) {
+		return UCL_COMPRESSION_ZSTD;
+	}
+
+	return UCL_COMPRESSION_NONE;
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_LZMA) || defined(HAVE_ZSTD)
+/*
+ * Output buffers are grown by doubling, so the decompressed data is written
+ * directly to the buffer that is then parsed. Decompression fails once the
+ * buffer cannot grow beyond the limit.
+ */
+static bool
+ucl_decompress_grow (unsigned char **buf, size_t *size, size_t limit,
+		UT_string **err)
+{
+	unsigned char *nbuf;
+	size_t nsize = *size > 0 ? *size * 2 : UCL_READ_BUFFER_SIZE;
+
+	if (limit != 0) {
+		if (*size >= limit) {
+			ucl_create_err (err, "decompressed data exceeds the limit of "
+					"%zu bytes", limit);
+			return false;
+		}
+		if (nsize > limit) {
+			nsize = limit;
+		}
+	}
+
+	nbuf = realloc (*buf, nsize);
+
+	if (nbuf == NULL) {
+		ucl_create_err (err, "cannot allocate %zu bytes for decompression",
+				nsize);
+		return false;
+	}
+
+	*buf = nbuf;
+	*size = nsize;
+
+	return true;
+}
+
+/*
+ * Decompressed size is at least as large as compressed one, a size stored in
+ * the input is only trusted up to a sane ratio and the limit
+ */
+static size_t
+ucl_decompress_hint (size_t inlen, size_t hint, size_t limit)
+{
+	if (hint < inlen) {
+		hint = inlen * 4;
+	}
+	else if (hint / UCL_DECOMPRESS_HINT_RATIO > inlen) {
+		hint = inlen * UCL_DECOMPRESS_HINT_RATIO;
+	}
+
+	if (hint < UCL_READ_BUFFER_SIZE) {
+		hint = UCL_READ_BUFFER_SIZE;
+	}
+
+	return limit != 0 && hint > limit ? limit : hint;
+}
+#endif
+
+#ifdef HAVE_ZLIB
+static bool
+ucl_decompress_gzip (const unsigned char *in, size_t inlen, size_t limit,
+		unsigned char **out, size_t *outlen, UT_string **err)
+{
+	z_stream strm;
+	unsigned char *buf;
+	size_t size, isize;
+	int ret;
+
+	/* Uncompressed size modulo 2^32 is stored in the trailer */
+	isize = 0;
+
+	if (inlen >= 4) {
+		isize = in[inlen - 4] | (in[inlen - 3] << 8) |
+				(in[inlen - 2] << 16) | ((size_t)in[inlen - 1] << 24);
+	}
+
+	size = ucl_decompress_hint (inlen, isize + 1, limit);
+	buf = malloc (size);
+
+	if (buf == NULL) {
+		ucl_create_err (err, "cannot allocate %zu bytes for decompression",
+				size);
+		return false;
+	}
+
+	memset (&strm, 0, sizeof (strm));
+
+	if (inflateInit2 (&strm, 15 + 16) != Z_OK) {
+		ucl_create_err (err, "cannot init gzip decompression");
+		free (buf);
+		return false;
+	}
+
+	strm.next_in = (unsigned char *)in;
+	strm.avail_in = inlen;
+	strm.next_out = buf;
+	strm.avail_out = size;
+
+	for (;;) {
+		ret = inflate (&strm, Z_NO_FLUSH);
+
+		if (ret == Z_STREAM_END) {
+			if (strm.avail_in > 0 && ucl_compression_detect (strm.next_in,
+					strm.avail_in) == UCL_COMPRESSION_GZIP) {
+				/* Concatenated members */
+				inflateReset (&strm);
+				continue;
+			}
+
+			break;
+		}
+		else if (ret == Z_BUF_ERROR && strm.avail_in == 0) {
+			ucl_create_err (err, "truncated gzip input");
+			goto err;
+		}
+		else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			ucl_create_err (err, "gzip decompression error: %s",
+					strm.msg ? strm.msg : "unknown error");
+			goto err;
+		}
+
+		if (strm.avail_out == 0) {
+			if (!ucl_decompress_grow (&buf, &size, limit, err)) {
+				goto err;
+			}
+
+			strm.next_out = buf + strm.total_out;
+			strm.avail_out = size - strm.total_out;
+		}
+	}
+
+	*out = buf;
+	*outlen = strm.total_out;
+	inflateEnd (&strm);
+
+	return true;
+
+err:
+	inflateEnd (&strm);
+	free (buf);
+
+	return false;
+}
+#endif
+
+#ifdef HAVE_LZMA
+static bool
+ucl_decompress_xz (const unsigned char *in, size_t inlen, size_t limit,
+		unsigned char **out, size_t *outlen, UT_string **err)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	unsigned char *buf;
+	size_t size;
+	lzma_ret ret;
+
+	size = ucl_decompress_hint (inlen, 0, limit);
+	buf = malloc (size);
+
+	if (buf == NULL) {
+		ucl_create_err (err, "cannot allocate %zu bytes for decompression",
+				size);
+		return false;
+	}
+
+	if (lzma_stream_decoder (&strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+		ucl_create_err (err, "cannot init xz decompression");
+		free (buf);
+		return false;
+	}
+
+	strm.next_in = in;
+	strm.avail_in = inlen;
+	strm.next_out = buf;
+	strm.avail_out = size;
+
+	for (;;) {
+		/* The whole input is available */
+		ret = lzma_code (&strm, LZMA_FINISH);
+
+		if (ret == LZMA_STREAM_END) {
+			break;
+		}
+		else if (ret != LZMA_OK && !(ret == LZMA_BUF_ERROR &&
+				strm.avail_out == 0)) {
+			ucl_create_err (err, "xz decompression error: %d", (int)ret);
+			goto err;
+		}
+
+		if (strm.avail_out == 0) {
+			if (!ucl_decompress_grow (&buf, &size, limit, err)) {
+				goto err;
+			}
+
+			strm.next_out = buf + strm.total_out;
+			strm.avail_out = size - strm.total_out;
+		}
+	}
+
+	*out = buf;
+	*outlen = strm.total_out;
+	lzma_end (&strm);
+
+	return true;
+
+err:
+	lzma_end (&strm);
+	free (buf);
+
+	return false;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static bool
+ucl_decompress_zstd (const unsigned char *in, size_t inlen, size_t limit,
+		unsigned char **out, size_t *outlen, UT_string **err)
+{
+	ZSTD_DStream *zstream;
+	ZSTD_inBuffer zin;
+	ZSTD_outBuffer zout;
+	unsigned long long hint;
+	unsigned char *buf;
+	size_t size, ret;
+
+	hint = ZSTD_getFrameContentSize (in, inlen);
+
+	if (hint == ZSTD_CONTENTSIZE_UNKNOWN || hint == ZSTD_CONTENTSIZE_ERROR ||
+			hint >= SIZE_MAX) {
+		hint = 0;
+	}
+
+	size = ucl_decompress_hint (inlen, hint + 1, limit);
+	buf = malloc (size);
+
+	if (buf == NULL) {
+		ucl_create_err (err, "cannot allocate %zu bytes for decompression",
+				size);
+		return false;
+	}
+
+	zstream = ZSTD_createDStream ();
+
+	if (zstream == NULL) {
+		ucl_create_err (err, "cannot init zstd decompression");
+		free (buf);
+		return false;
+	}
+
+	zin.src = in;
+	zin.size = inlen;
+	zin.pos = 0;
+	zout.dst = buf;
+	zout.size = size;
+	zout.pos = 0;
+
+	for (;;) {
+		ret = ZSTD_decompressStream (zstream, &zout, &zin);
+
+		if (ZSTD_isError (ret)) {
+			ucl_create_err (err, "zstd decompression error: %s",
+					ZSTD_getErrorName (ret));
+			goto err;
+		}
+
+		if (ret == 0 && zin.pos == zin.size) {
+			break;
+		}
+
+		if (zout.pos == zout.size) {
+			if (!ucl_decompress_grow (&buf, &size, limit, err)) {
+				goto err;
+			}
+
+			zout.dst = buf;
+			zout.size = size;
+		}
+		else if (zin.pos == zin.size) {
+			ucl_create_err (err, "truncated zstd input");
+			goto err;
+		}
+	}
+
+	*out = buf;
+	*outlen = zout.pos;
+	ZSTD_freeDStream (zstream);
+
+	return true;
+
+err:
+	ZSTD_freeDStream (zstream);
+	free (buf);
+
+	return false;
+}
+#endif
+
+bool
+ucl_decompress (enum ucl_compression_type type,
+		const unsigned char *in, size_t inlen, size_t limit,
+		unsigned char **out, size_t *outlen, UT_string **err)
+{
+	switch (type) {
+#ifdef HAVE_ZLIB
+	case UCL_COMPRESSION_GZIP:
+		return ucl_decompress_gzip (in, inlen, limit, out, outlen, err);
+#endif
+#ifdef HAVE_LZMA
+	case UCL_COMPRESSION_XZ:
+		return ucl_decompress_xz (in, inlen, limit, out, outlen, err);
+#endif
+#ifdef HAVE_ZSTD
+	case UCL_COMPRESSION_ZSTD:
+		return ucl_decompress_zstd (in, inlen, limit, out, outlen, err);
+#endif
+	default:
+		break;
+	}
+
+	ucl_create_err (err, "%s compressed input is not supported",
+			ucl_compression_names[type]);
+
+	return false;
+}
+
+struct ucl_compress_ctx {
+	struct ucl_emitter_functions *sink;
+	enum ucl_compression_type type;
+	union {
+#ifdef HAVE_ZLIB
+		z_stream gzip;
+#endif
+#ifdef HAVE_LZMA
+		lzma_stream xz;
+#endif
+#ifdef HAVE_ZSTD
+		ZSTD_CStream *zstd;
+#endif
+		int unused;
+	} strm;
+	int error;
+	size_t inlen;
+	unsigned char in[UCL_COMPRESS_BUFFER_SIZE];
+	unsigned char out[UCL_COMPRESS_BUFFER_SIZE];
+};
+
+#if defined(HAVE_ZLIB) || defined(HAVE_LZMA) || defined(HAVE_ZSTD)
+static int
+ucl_compress_write (struct ucl_compress_ctx *ctx, size_t len)
+{
+	if (len > 0 && ctx->sink->ucl_emitter_append_len (ctx->out, len,
+			ctx->sink->ud) < 0) {
+		ctx->error = -1;
+	}
+
+	return ctx->error;
+}
+#endif
+
+/*
+ * Compress the buffered input and pass the output to the sink, the stream is
+ * terminated if `finish` is true
+ */
+static int
+ucl_compress_flush (struct ucl_compress_ctx *ctx, bool finish)
+{
+	if (ctx->error != 0) {
+		return ctx->error;
+	}
+
+	switch (ctx->type) {
+#ifdef HAVE_ZLIB
+	case UCL_COMPRESSION_GZIP: {
+		z_stream *strm = &ctx->strm.gzip;
+		int ret;
+
+		strm->next_in = ctx->in;
+		strm->avail_in = ctx->inlen;
+
+		do {
+			strm->next_out = ctx->out;
+			strm->avail_out = sizeof (ctx->out);
+			ret = deflate (strm, finish ? Z_FINISH : Z_NO_FLUSH);
+
+			if (ret == Z_STREAM_ERROR ||
+					ucl_compress_write (ctx,
+							sizeof (ctx->out) - strm->avail_out) != 0) {
+				ctx->error = -1;
+				break;
+			}
+		} while (strm->avail_out == 0 || (finish && ret != Z_STREAM_END));
+		break;
+	}
+#endif
+#ifdef HAVE_LZMA
+	case UCL_COMPRESSION_XZ: {
+		lzma_stream *strm = &ctx->strm.xz;
+		lzma_ret ret;
+
+		strm->next_in = ctx->in;
+		strm->avail_in = ctx->inlen;
+
+		do {
+			strm->next_out = ctx->out;
+			strm->avail_out = sizeof (ctx->out);
+			ret = lzma_code (strm, finish ? LZMA_FINISH : LZMA_RUN);
+
+			if ((ret != LZMA_OK && ret != LZMA_STREAM_END) ||
+					ucl_compress_write (ctx,
+							sizeof (ctx->out) - strm->avail_out) != 0) {
+				ctx->error = -1;
+				break;
+			}
+		} while (strm->avail_out == 0 || (finish && ret != LZMA_STREAM_END));
+		break;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case UCL_COMPRESSION_ZSTD: {
+		ZSTD_inBuffer zin;
+		ZSTD_outBuffer zout;
+		size_t ret;
+
+		zin.src = ctx->in;
+		zin.size = ctx->inlen;
+		zin.pos = 0;
+
+		do {
+			zout.dst = ctx->out;
+			zout.size = sizeof (ctx->out);
+			zout.pos = 0;
+
+			if (zin.pos < zin.size) {
+				ret = ZSTD_compressStream (ctx->strm.zstd, &zout, &zin);
+			}
+			else if (finish) {
+				ret = ZSTD_endStream (ctx->strm.zstd, &zout);
+			}
+			else {
+				break;
+			}
+
+			if (ZSTD_isError (ret) || ucl_compress_write (ctx, zout.pos) != 0) {
+				ctx->error = -1;
+				break;
+			}
+		} while (zin.pos < zin.size || (finish && ret != 0));
+		break;
+	}
+#endif
+	default:
+		ctx->error = -1;
+		break;
+	}
+
+	ctx->inlen = 0;
+
+	return ctx->error;
+}
+
+static int
+ucl_compress_append_len (const unsigned char *str, size_t len, void *ud)
+{
+	struct ucl_compress_ctx *ctx = ud;
+	size_t chunk;
+
+	while (len > 0) {
+		if (ctx->inlen == sizeof (ctx->in) &&
+				ucl_compress_flush (ctx, false) != 0) {
+			return -1;
+		}
+
+		chunk = sizeof (ctx->in) - ctx->inlen;
+		chunk = chunk < len ? chunk : len;
+		memcpy (ctx->in + ctx->inlen, str, chunk);
+		ctx->inlen += chunk;
+		str += chunk;
+		len -= chunk;
+	}
+
+	return ctx->error;
+}
+
+static int
+ucl_compress_append_character (unsigned char c, size_t len, void *ud)
+{
+	struct ucl_compress_ctx *ctx = ud;
+	size_t chunk;
+
+	while (len > 0) {
+		if (ctx->inlen == sizeof (ctx->in) &&
+				ucl_compress_flush (ctx, false) != 0) {
+			return -1;
+		}
+
+		chunk = sizeof (ctx->in) - ctx->inlen;
+		chunk = chunk < len ? chunk : len;
+		memset (ctx->in + ctx->inlen, c, chunk);
+		ctx->inlen += chunk;
+		len -= chunk;
+	}
+
+	return ctx->error;
+}
+
+static int
+ucl_compress_append_int (int64_t val, void *ud)
+{
+	char nbuf[64];
+	int r;
+
+	r = snprintf (nbuf, sizeof (nbuf), "%jd", (intmax_t)val);
+
+	return ucl_compress_append_len ((const unsigned char *)nbuf, r, ud);
+}
+
+static int
+ucl_compress_append_double (double val, void *ud)
+{
+	char nbuf[64];
+	int r;
+
+	r = ucl_emitter_format_double (val, nbuf, sizeof (nbuf));
+
+	return ucl_compress_append_len ((const unsigned char *)nbuf, r, ud);
+}
+
+static void
+ucl_compress_free (void *ud)
+{
+	struct ucl_compress_ctx *ctx = ud;
+
+	ucl_compress_flush (ctx, true);
+
+	switch (ctx->type) {
+#ifdef HAVE_ZLIB
+	case UCL_COMPRESSION_GZIP:
+		deflateEnd (&ctx->strm.gzip);
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case UCL_COMPRESSION_XZ:
+		lzma_end (&ctx->strm.xz);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case UCL_COMPRESSION_ZSTD:
+		ZSTD_freeCStream (ctx->strm.zstd);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	free (ctx);
+}
+
+static bool
+ucl_compress_init (struct ucl_compress_ctx *ctx, int level)
+{
+	switch (ctx->type) {
+#ifdef HAVE_ZLIB
+	case UCL_COMPRESSION_GZIP:
+		/* Window bits above 15 select the gzip wrapper */
+		return deflateInit2 (&ctx->strm.gzip,
+				level > 0 ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+				15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+#endif
+#ifdef HAVE_LZMA
+	case UCL_COMPRESSION_XZ: {
+		lzma_stream strm = LZMA_STREAM_INIT;
+
+		ctx->strm.xz = strm;
+
+		return lzma_easy_encoder (&ctx->strm.xz,
+				level > 0 ? level : LZMA_PRESET_DEFAULT,
+				LZMA_CHECK_CRC64) == LZMA_OK;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case UCL_COMPRESSION_ZSTD:
+		ctx->strm.zstd = ZSTD_createCStream ();
+
+		if (ctx->strm.zstd == NULL) {
+			return false;
+		}
+
+		if (ZSTD_isError (ZSTD_initCStream (ctx->strm.zstd,
+				level > 0 ? level : ZSTD_CLEVEL_DEFAULT))) {
+			ZSTD_freeCStream (ctx->strm.zstd);
+			return false;
+		}
+
+		return true;
+#endif
+	default:
+		break;
+	}
+
+	return false;
+}
+
+struct ucl_emitter_functions*
+ucl_object_emit_compressed_funcs (struct ucl_emitter_functions *sink,
+		enum ucl_compression_type type, int level)
+{
+	struct ucl_emitter_functions *f;
+	struct ucl_compress_ctx *ctx;
+
+	if (sink == NULL) {
+		return NULL;
+	}
+
+	ctx = calloc (1, sizeof (*ctx));
+
+	if (ctx == NULL) {
+		return NULL;
+	}
+
+	ctx->sink = sink;
+	ctx->type = type;
+
+	if (!ucl_compress_init (ctx, level)) {
+		free (ctx);
+		return NULL;
+	}
+
+	f = calloc (1, sizeof (*f));
+
+	if (f == NULL) {
+		/* Nothing is written to the sink */
+		ctx->error = -1;
+		ucl_compress_free (ctx);
+		return NULL;
+	}
+
+	f->ucl_emitter_append_character = ucl_compress_append_character;
+	f->ucl_emitter_append_double = ucl_compress_append_double;
+	f->ucl_emitter_append_int = ucl_compress_append_int;
+	f->ucl_emitter_append_len = ucl_compress_append_len;
+	f->ucl_emitter_free_func = ucl_compress_free;
+	f->ud = ctx;
+
+	return f;
+}
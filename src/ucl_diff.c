@@ -0,0 +1,714 @@
+/* Copyright (c) 2016, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Structural diff of UCL objects producing JSON Patch (RFC 6902) operations
+ * and application of JSON Patch and JSON Merge Patch (RFC 7386) documents.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ucl.h"
+#include "ucl_internal.h"
+#include "khash.h"
+
+#define ucl_diff_ptr_hash(p) kh_int64_hash_func ((uint64_t)(uintptr_t)(p))
+#define ucl_diff_ptr_equal(a, b) ((a) == (b))
+
+/* Hashes of mutable subtrees memoized for a single diff run */
+KHASH_INIT (ucl_diff_hash, const ucl_object_t *, uint64_t, 1,
+		ucl_diff_ptr_hash, ucl_diff_ptr_equal);
+
+struct ucl_diff_ctx {
+	khash_t(ucl_diff_hash) *hashes;
+	UT_string *path;
+	ucl_object_t *ops;
+};
+
+static uint64_t
+ucl_diff_hash_child (const ucl_object_t *obj, void *ud)
+{
+	struct ucl_diff_ctx *ctx = ud;
+	khiter_t k;
+	uint64_t h;
+	int r;
+
+	if (obj->flags & UCL_OBJECT_SEALED) {
+		/* Use hashes cached in the tree itself */
+		return ucl_object_hash (obj);
+	}
+
+	k = kh_get (ucl_diff_hash, ctx->hashes, obj);
+
+	if (k != kh_end (ctx->hashes)) {
+		return kh_value (ctx->hashes, k);
+	}
+
+	h = ucl_object_hash_full (obj, ucl_diff_hash_child, ctx);
+	k = kh_put (ucl_diff_hash, ctx->hashes, obj, &r);
+
+	if (r >= 0) {
+		kh_value (ctx->hashes, k) = h;
+	}
+
+	return h;
+}
+
+/*
+ * Returns hash of the object's value including all its implicit array
+ * elements
+ */
+static uint64_t
+ucl_diff_hash (struct ucl_diff_ctx *ctx, const ucl_object_t *obj)
+{
+	return ucl_diff_hash_child (obj, ctx);
+}
+
+static void
+ucl_diff_path_push (UT_string *path, const char *key, size_t keylen)
+{
+	const char *p, *end = key + keylen;
+
+	utstring_append_c (path, '/');
+
+	/* Escape according to RFC 6901 */
+	for (p = key; p < end; p ++) {
+		if (*p == '~') {
+			utstring_append_len (path, "~0", 2);
+		}
+		else if (*p == '/') {
+			utstring_append_len (path, "~1", 2);
+		}
+		else {
+			utstring_append_c (path, *p);
+		}
+	}
+}
+
+static void
+ucl_diff_path_push_index (UT_string *path, unsigned idx)
+{
+	utstring_printf (path, "/%u", idx);
+}
+
+static void
+ucl_diff_path_pop (UT_string *path, size_t len)
+{
+	path->i = len;
+	path->d[len] = '\0';
+}
+
+static void
+ucl_diff_emit_op (struct ucl_diff_ctx *ctx, const char *op,
+		const ucl_object_t *value)
+{
+	ucl_object_t *elt;
+
+	elt = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (elt, ucl_object_fromstring (op), "op", 0, false);
+	ucl_object_insert_key (elt,
+			ucl_object_fromstring_common (utstring_body (ctx->path),
+					utstring_len (ctx->path), UCL_STRING_RAW),
+			"path", 0, false);
+
+	if (value != NULL) {
+		ucl_object_insert_key (elt, ucl_object_copy (value), "value", 0, false);
+	}
+
+	ucl_array_append (ctx->ops, elt);
+}
+
+static void ucl_diff_walk (struct ucl_diff_ctx *ctx,
+		const ucl_object_t *from, const ucl_object_t *to);
+
+static void
+ucl_diff_walk_object (struct ucl_diff_ctx *ctx,
+		const ucl_object_t *from, const ucl_object_t *to)
+{
+	const ucl_object_t *cur, *found;
+	ucl_object_iter_t it = NULL;
+	size_t plen = utstring_len (ctx->path);
+
+	while ((cur = ucl_object_iterate (from, &it, true)) != NULL) {
+		found = ucl_object_lookup_len (to, cur->key, cur->keylen);
+		ucl_diff_path_push (ctx->path, cur->key, cur->keylen);
+
+		if (found == NULL) {
+			ucl_diff_emit_op (ctx, "remove", NULL);
+		}
+		else {
+			ucl_diff_walk (ctx, cur, found);
+		}
+
+		ucl_diff_path_pop (ctx->path, plen);
+	}
+
+	it = NULL;
+
+	while ((cur = ucl_object_iterate (to, &it, true)) != NULL) {
+		if (ucl_object_lookup_len (from, cur->key, cur->keylen) == NULL) {
+			ucl_diff_path_push (ctx->path, cur->key, cur->keylen);
+			ucl_diff_emit_op (ctx, "add", cur);
+			ucl_diff_path_pop (ctx->path, plen);
+		}
+	}
+}
+
+static void
+ucl_diff_walk_array (struct ucl_diff_ctx *ctx,
+		const ucl_object_t *from, const ucl_object_t *to)
+{
+	const ucl_object_t *e1, *e2;
+	unsigned i, n1 = from->len, n2 = to->len;
+	size_t plen = utstring_len (ctx->path);
+
+	for (i = 0; i < n1 && i < n2; i ++) {
+		e1 = ucl_array_find_index (from, i);
+		e2 = ucl_array_find_index (to, i);
+
+		if (e1 == NULL || e2 == NULL) {
+			continue;
+		}
+
+		ucl_diff_path_push_index (ctx->path, i);
+		ucl_diff_walk (ctx, e1, e2);
+		ucl_diff_path_pop (ctx->path, plen);
+	}
+
+	/* Remove extra elements from the tail, so indicies are kept stable */
+	for (i = n1; i > n2; i --) {
+		ucl_diff_path_push_index (ctx->path, i - 1);
+		ucl_diff_emit_op (ctx, "remove", NULL);
+		ucl_diff_path_pop (ctx->path, plen);
+	}
+
+	for (i = n1; i < n2; i ++) {
+		ucl_diff_path_push_index (ctx->path, i);
+		ucl_diff_emit_op (ctx, "add", ucl_array_find_index (to, i));
+		ucl_diff_path_pop (ctx->path, plen);
+	}
+}
+
+/*
+ * Returns true if the object's hash is cached by ucl_object_seal
+ */
+static bool
+ucl_diff_hash_cached (const ucl_object_t *obj)
+{
+	return (obj->flags & UCL_OBJECT_SEALED) &&
+			(obj->type == UCL_OBJECT || obj->type == UCL_ARRAY);
+}
+
+/*
+ * Equal cached hashes of sealed containers are trusted, a collision of 64 bit
+ * hashes is accepted as the price of not walking sealed trees. Other subtrees
+ * with equal hashes are compared deeply including their implicit array members
+ */
+static bool
+ucl_diff_equal (struct ucl_diff_ctx *ctx,
+		const ucl_object_t *from, const ucl_object_t *to)
+{
+	if (ucl_diff_hash (ctx, from) != ucl_diff_hash (ctx, to)) {
+		return false;
+	}
+
+	if (ucl_diff_hash_cached (from) && ucl_diff_hash_cached (to)) {
+		return true;
+	}
+
+	while (from != NULL && to != NULL) {
+		if (ucl_object_compare (from, to) != 0) {
+			return false;
+		}
+
+		from = from->next;
+		to = to->next;
+	}
+
+	return from == NULL && to == NULL;
+}
+
+static void
+ucl_diff_walk (struct ucl_diff_ctx *ctx,
+		const ucl_object_t *from, const ucl_object_t *to)
+{
+	if (ucl_diff_equal (ctx, from, to)) {
+		/* Identical subtrees */
+		return;
+	}
+
+	if (from->type != to->type || from->next != NULL || to->next != NULL) {
+		/* Scalars, type changes and implicit arrays are replaced as a whole */
+		ucl_diff_emit_op (ctx, "replace", to);
+	}
+	else if (from->type == UCL_OBJECT) {
+		ucl_diff_walk_object (ctx, from, to);
+	}
+	else if (from->type == UCL_ARRAY) {
+		ucl_diff_walk_array (ctx, from, to);
+	}
+	else {
+		ucl_diff_emit_op (ctx, "replace", to);
+	}
+}
+
+ucl_object_t *
+ucl_object_diff (const ucl_object_t *from, const ucl_object_t *to)
+{
+	struct ucl_diff_ctx ctx;
+
+	if (from == NULL || to == NULL) {
+		return NULL;
+	}
+
+	ctx.hashes = kh_init (ucl_diff_hash);
+	ctx.ops = ucl_object_typed_new (UCL_ARRAY);
+	utstring_new (ctx.path);
+
+	ucl_diff_walk (&ctx, from, to);
+
+	kh_destroy (ucl_diff_hash, ctx.hashes);
+	utstring_free (ctx.path);
+
+	return ctx.ops;
+}
+
+/*
+ * Splits JSON pointer to the parent path and the last reference token, the
+ * token is unescaped and stored in `token`, returns the parent object
+ */
+static ucl_object_t *
+ucl_patch_resolve_parent (ucl_object_t *top, const char *path,
+		UT_string *token)
+{
+	const char *p, *end;
+	ucl_object_t *cur = top;
+	char *endptr;
+	unsigned long idx;
+
+	if (*path != '/') {
+		return NULL;
+	}
+
+	p = path + 1;
+
+	for (;;) {
+		utstring_clear (token);
+		end = p;
+
+		while (*end != '\0' && *end != '/') {
+			if (*end == '~') {
+				if (end[1] == '0') {
+					utstring_append_c (token, '~');
+				}
+				else if (end[1] == '1') {
+					utstring_append_c (token, '/');
+				}
+				else {
+					return NULL;
+				}
+				end += 2;
+			}
+			else {
+				utstring_append_c (token, *end);
+				end ++;
+			}
+		}
+
+		if (*end == '\0') {
+			/* The last token */
+			return cur;
+		}
+
+		if (cur == NULL) {
+			return NULL;
+		}
+		else if (cur->type == UCL_OBJECT) {
+			cur = __DECONST (ucl_object_t *, ucl_object_lookup_len (cur,
+					utstring_body (token), utstring_len (token)));
+		}
+		else if (cur->type == UCL_ARRAY) {
+			if (utstring_len (token) == 0 ||
+					!isdigit (utstring_body (token)[0])) {
+				return NULL;
+			}
+			idx = strtoul (utstring_body (token), &endptr, 10);
+
+			if (*endptr != '\0') {
+				return NULL;
+			}
+			cur = __DECONST (ucl_object_t *, ucl_array_find_index (cur, idx));
+		}
+		else {
+			return NULL;
+		}
+
+		p = end + 1;
+	}
+
+	/* Not reached */
+	return NULL;
+}
+
+static bool
+ucl_patch_array_index (const ucl_object_t *ar, UT_string *token,
+		bool allow_end, unsigned *idx)
+{
+	char *endptr;
+	unsigned long res;
+	const char *s = utstring_body (token);
+
+	if (allow_end && utstring_len (token) == 1 && s[0] == '-') {
+		*idx = ar->len;
+		return true;
+	}
+
+	/* Leading zeroes are not allowed by RFC 6901 */
+	if (utstring_len (token) == 0 || !isdigit (s[0]) ||
+			(s[0] == '0' && utstring_len (token) > 1)) {
+		return false;
+	}
+
+	res = strtoul (s, &endptr, 10);
+
+	if (*endptr != '\0' || res > ar->len || (!allow_end && res == ar->len)) {
+		return false;
+	}
+
+	*idx = res;
+
+	return true;
+}
+
+static bool
+ucl_patch_array_insert (ucl_object_t *ar, ucl_object_t *elt, unsigned idx)
+{
+	UCL_ARRAY_GET (vec, ar);
+
+	if (vec == NULL || idx == vec->n) {
+		return ucl_array_append (ar, elt);
+	}
+
+	kv_push (ucl_object_t *, *vec, NULL);
+	memmove (vec->a + idx + 1, vec->a + idx,
+			sizeof (ucl_object_t *) * (vec->n - idx - 1));
+	kv_A (*vec, idx) = elt;
+	ar->len ++;
+
+	return true;
+}
+
+/* Detaches and returns an element referenced by `token` in `parent` */
+static ucl_object_t *
+ucl_patch_detach (ucl_object_t *parent, UT_string *token)
+{
+	ucl_object_t *elt;
+	unsigned idx;
+
+	if (parent == NULL) {
+		return NULL;
+	}
+
+	if (parent->type == UCL_OBJECT) {
+		return ucl_object_pop_keyl (parent, utstring_body (token),
+				utstring_len (token));
+	}
+	else if (parent->type == UCL_ARRAY) {
+		if (!ucl_patch_array_index (parent, token, false, &idx)) {
+			return NULL;
+		}
+
+		elt = __DECONST (ucl_object_t *, ucl_array_find_index (parent, idx));
+
+		return ucl_array_delete (parent, elt);
+	}
+
+	return NULL;
+}
+
+/* Inserts `elt` to `parent`, consumes `elt` in any case */
+static bool
+ucl_patch_attach (ucl_object_t *parent, UT_string *token, ucl_object_t *elt)
+{
+	unsigned idx;
+
+	if (parent != NULL && parent->type == UCL_OBJECT) {
+		ucl_object_delete_keyl (parent, utstring_body (token),
+				utstring_len (token));
+
+		if (ucl_object_insert_key (parent, elt, utstring_body (token),
+				utstring_len (token), true)) {
+			return true;
+		}
+	}
+	else if (parent != NULL && parent->type == UCL_ARRAY) {
+		if (ucl_patch_array_index (parent, token, true, &idx)) {
+			return ucl_patch_array_insert (parent, elt, idx);
+		}
+	}
+
+	ucl_object_unref (elt);
+
+	return false;
+}
+
+static const ucl_object_t *
+ucl_patch_lookup (ucl_object_t *top, const char *path, UT_string *token)
+{
+	ucl_object_t *parent;
+	unsigned idx;
+
+	if (*path == '\0') {
+		return top;
+	}
+
+	parent = ucl_patch_resolve_parent (top, path, token);
+
+	if (parent == NULL) {
+		return NULL;
+	}
+
+	if (parent->type == UCL_OBJECT) {
+		return ucl_object_lookup_len (parent, utstring_body (token),
+				utstring_len (token));
+	}
+	else if (parent->type == UCL_ARRAY &&
+			ucl_patch_array_index (parent, token, false, &idx)) {
+		return ucl_array_find_index (parent, idx);
+	}
+
+	return NULL;
+}
+
+static bool
+ucl_patch_apply_op (ucl_object_t **top, const ucl_object_t *op,
+		UT_string *token)
+{
+	const char *opname, *path, *from = NULL;
+	const ucl_object_t *value, *src;
+	ucl_object_t *parent, *elt;
+	size_t flen;
+
+	if (ucl_object_type (op) != UCL_OBJECT ||
+			!ucl_object_tostring_safe (ucl_object_lookup (op, "op"), &opname) ||
+			!ucl_object_tostring_safe (ucl_object_lookup (op, "path"), &path)) {
+		return false;
+	}
+
+	value = ucl_object_lookup (op, "value");
+	ucl_object_tostring_safe (ucl_object_lookup (op, "from"), &from);
+
+	if (strcmp (opname, "test") == 0) {
+		src = ucl_patch_lookup (*top, path, token);
+
+		return value != NULL && src != NULL && ucl_object_compare (src, value) == 0;
+	}
+	else if (strcmp (opname, "remove") == 0) {
+		parent = ucl_patch_resolve_parent (*top, path, token);
+		elt = ucl_patch_detach (parent, token);
+
+		if (elt == NULL) {
+			return false;
+		}
+
+		ucl_object_unref (elt);
+
+		return true;
+	}
+
+	/* All other operations insert some value to `path` */
+	if (strcmp (opname, "add") == 0 || strcmp (opname, "replace") == 0) {
+		if (value == NULL) {
+			return false;
+		}
+
+		elt = ucl_object_copy (value);
+	}
+	else if (strcmp (opname, "copy") == 0 || strcmp (opname, "move") == 0) {
+		if (from == NULL) {
+			return false;
+		}
+
+		if (opname[0] == 'm') {
+			flen = strlen (from);
+
+			/* Cannot move object to its own child */
+			if (strncmp (path, from, flen) == 0 &&
+					(path[flen] == '/' || path[flen] == '\0')) {
+				return path[flen] == '\0';
+			}
+
+			if (*from == '\0') {
+				return false;
+			}
+
+			parent = ucl_patch_resolve_parent (*top, from, token);
+			elt = ucl_patch_detach (parent, token);
+		}
+		else {
+			src = ucl_patch_lookup (*top, from, token);
+			elt = src ? ucl_object_copy (src) : NULL;
+		}
+
+		if (elt == NULL) {
+			return false;
+		}
+	}
+	else {
+		return false;
+	}
+
+	if (*path == '\0') {
+		/* Replace the whole document */
+		if (opname[0] == 'r' && *top == NULL) {
+			ucl_object_unref (elt);
+			return false;
+		}
+
+		ucl_object_unref (*top);
+		*top = elt;
+
+		return true;
+	}
+
+	parent = ucl_patch_resolve_parent (*top, path, token);
+
+	if (opname[0] == 'r') {
+		/* Replace requires the target to exist */
+		src = ucl_patch_detach (parent, token);
+
+		if (src == NULL) {
+			ucl_object_unref (elt);
+			return false;
+		}
+
+		ucl_object_unref (__DECONST (ucl_object_t *, src));
+	}
+
+	return ucl_patch_attach (parent, token, elt);
+}
+
+bool
+ucl_object_patch (ucl_object_t **top, const ucl_object_t *patch)
+{
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+	ucl_object_t *res;
+	UT_string *token;
+	bool ret = true;
+
+	if (top == NULL || ucl_object_type (patch) != UCL_ARRAY) {
+		return false;
+	}
+
+	/* Patch is applied atomically, so we work on a copy */
+	res = *top ? ucl_object_copy (*top) : NULL;
+	utstring_new (token);
+
+	while ((cur = ucl_object_iterate (patch, &it, true)) != NULL) {
+		if (!ucl_patch_apply_op (&res, cur, token)) {
+			ret = false;
+			break;
+		}
+	}
+
+	utstring_free (token);
+
+	if (ret) {
+		ucl_object_unref (*top);
+		*top = res;
+	}
+	else {
+		ucl_object_unref (res);
+	}
+
+	return ret;
+}
+
+static bool
+ucl_merge_patch_internal (ucl_object_t **ptarget, const ucl_object_t *patch)
+{
+	const ucl_object_t *cur;
+	ucl_object_t *target = *ptarget, *found;
+	ucl_object_iter_t it = NULL;
+	bool ret = true;
+
+	if (patch->type != UCL_OBJECT) {
+		ucl_object_unref (target);
+		*ptarget = ucl_object_copy (patch);
+
+		return *ptarget != NULL;
+	}
+
+	if (target == NULL || target->type != UCL_OBJECT) {
+		ucl_object_unref (target);
+		target = ucl_object_typed_new (UCL_OBJECT);
+	}
+	else if (target->flags & UCL_OBJECT_SEALED) {
+		/* Copy on write, sealed trees are left intact */
+		found = ucl_object_copy (target);
+		ucl_object_unref (target);
+		target = found;
+	}
+
+	*ptarget = target;
+
+	if (target == NULL) {
+		return false;
+	}
+
+	while ((cur = ucl_object_iterate (patch, &it, true)) != NULL) {
+		if (!ret) {
+			/* Finish iteration to release the iterator */
+			continue;
+		}
+
+		if (cur->type == UCL_NULL) {
+			ucl_object_delete_keyl (target, cur->key, cur->keylen);
+		}
+		else {
+			found = ucl_object_pop_keyl (target, cur->key, cur->keylen);
+
+			if (!ucl_merge_patch_internal (&found, cur) ||
+					!ucl_object_insert_key (target, found, cur->key,
+							cur->keylen, true)) {
+				ucl_object_unref (found);
+				ret = false;
+			}
+		}
+	}
+
+	return ret;
+}
+
+bool
+ucl_object_merge_patch (ucl_object_t **top, const ucl_object_t *patch)
+{
+	if (top == NULL || patch == NULL) {
+		return false;
+	}
+
+	return ucl_merge_patch_internal (top, patch);
+}
@@ -266,7 +266,19 @@ ucl_emitter_common_start_array (struct ucl_emitter_context *ctx,
 
 	ctx->indent ++;
 
-	if (obj->type == UCL_ARRAY) {
+	if (obj->type == UCL_ARRAY && ucl_array_is_packed (obj)) {
+		/* packed array, emit values without unpacking */
+		UCL_ARRAY_GET_RAW (vec, obj);
+		ucl_object_t elt;
+		size_t i;
+
+		for (i = 0; i < vec->npacked; i ++) {
+			ucl_array_packed_elt (vec, i, &elt);
+			ucl_emitter_common_elt (ctx, &elt, first, false, compact);
+			first = false;
+		}
+	}
+	else if (obj->type == UCL_ARRAY) {
 		/* explicit array */
 		while ((cur = ucl_object_iterate (obj, &iter, true)) != NULL) {
 			ucl_emitter_common_elt (ctx, cur, first, false, compact);
@@ -301,6 +313,7 @@ ucl_emitter_common_start_object (struct ucl_emitter_context *ctx,
 	const struct ucl_emitter_functions *func = ctx->func;
 	bool first = true;
 
+	ucl_container_materialize (obj);
 	ucl_emitter_print_key (print_key, ctx, obj, compact);
 	/*
 	 * Print <ident_level>{
@@ -423,6 +436,7 @@ ucl_emitter_common_elt (struct ucl_emitter_context *ctx,
 		ucl_emitter_finish_object (ctx, obj, compact, !print_key);
 		break;
 	case UCL_STRING:
+		ucl_string_materialize (obj);
 		ucl_emitter_print_key (print_key, ctx, obj, compact);
 		if (ctx->id == UCL_EMIT_CONFIG && ucl_maybe_long_string (obj)) {
 			ucl_elt_string_write_multiline (obj->value.sv, obj->len, ctx);
@@ -530,6 +544,7 @@ ucl_emit_msgpack_elt (struct ucl_emitter_context *ctx,
 		break;
 
 	case UCL_STRING:
+		ucl_string_materialize (obj);
 		ucl_emitter_print_key_msgpack (print_key, ctx, obj);
 
 		if (obj->flags & UCL_OBJECT_BINARY) {
@@ -570,8 +585,20 @@ ucl_emit_msgpack_elt (struct ucl_emitter_context *ctx,
 		ucl_emit_msgpack_start_array (ctx, obj, print_key);
 		it = NULL;
 
-		while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
-			ucl_emit_msgpack_elt (ctx, cur, false, false);
+		if (ucl_array_is_packed (obj)) {
+			UCL_ARRAY_GET_RAW (vec, obj);
+			ucl_object_t elt;
+			size_t i;
+
+			for (i = 0; i < vec->npacked; i ++) {
+				ucl_array_packed_elt (vec, i, &elt);
+				ucl_emit_msgpack_elt (ctx, &elt, false, false);
+			}
+		}
+		else {
+			while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
+				ucl_emit_msgpack_elt (ctx, cur, false, false);
+			}
 		}
 
 		break;
@@ -595,6 +622,7 @@ static void
 ucl_emit_msgpack_start_obj (struct ucl_emitter_context *ctx,
 		const ucl_object_t *obj, bool print_key)
 {
+	ucl_container_materialize (obj);
 	ucl_emitter_print_object_msgpack (ctx, obj->len);
 }
 
@@ -602,6 +630,7 @@ static void
 ucl_emit_msgpack_start_array (struct ucl_emitter_context *ctx,
 		const ucl_object_t *obj, bool print_key)
 {
+	ucl_container_materialize (obj);
 	ucl_emitter_print_array_msgpack (ctx, obj->len);
 }
 
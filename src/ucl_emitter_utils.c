@@ -215,6 +215,22 @@ ucl_utstring_append_double (double val, void *ud)
 	return 0;
 }
 
+int
+ucl_emitter_format_double (double val, char *buf, size_t buflen)
+{
+	const double delta = 0.0000001;
+
+	if (val == (double)(int)val) {
+		return snprintf (buf, buflen, "%.1lf", val);
+	}
+	else if (fabs (val - (double)(int)val) < delta) {
+		/* Write at maximum precision */
+		return snprintf (buf, buflen, "%.*lg", DBL_DIG, val);
+	}
+
+	return snprintf (buf, buflen, "%lf", val);
+}
+
 /*
  * Generic file output
  */
@@ -327,21 +343,12 @@ static int
 ucl_fd_append_double (double val, void *ud)
 {
 	int fd = *(int *)ud;
-	const double delta = 0.0000001;
 	char nbuf[64];
+	int r;
 
-	if (val == (double)(int)val) {
-		snprintf (nbuf, sizeof (nbuf), "%.1lf", val);
-	}
-	else if (fabs (val - (double)(int)val) < delta) {
-		/* Write at maximum precision */
-		snprintf (nbuf, sizeof (nbuf), "%.*lg", DBL_DIG, val);
-	}
-	else {
-		snprintf (nbuf, sizeof (nbuf), "%lf", val);
-	}
+	r = ucl_emitter_format_double (val, nbuf, sizeof (nbuf));
 
-	return write (fd, nbuf, strlen (nbuf));
+	return write (fd, nbuf, r);
 }
 
 struct ucl_emitter_functions*
@@ -464,6 +471,7 @@ ucl_object_emit_single_json (const ucl_object_t *obj)
 			}
 			break;
 		case UCL_STRING:
+			ucl_string_materialize (obj);
 			ucl_utstring_append_len (obj->value.sv, obj->len, buf);
 			break;
 		case UCL_USERDATA:
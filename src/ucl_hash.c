@@ -37,6 +37,8 @@ struct ucl_hash_elt {
 struct ucl_hash_struct {
 	void *hash;
 	kvec_t(const ucl_object_t *) ar;
+	uint64_t digest;
+	struct ucl_backing_list *backings;
 	bool caseless;
 };
 
@@ -234,6 +236,8 @@ ucl_hash_create (bool ignore_case)
 	if (new != NULL) {
 		kv_init (new->ar);
 
+		new->digest = 0;
+		new->backings = NULL;
 		new->caseless = ignore_case;
 		if (ignore_case) {
 			khash_t(ucl_hash_caseless_node) *h = kh_init (ucl_hash_caseless_node);
@@ -413,6 +417,25 @@ ucl_hash_iter_has_next (ucl_hash_t *hashlin, ucl_hash_iter_t iter)
 	return it->cur < it->end - 1;
 }
 
+uint64_t *
+ucl_hash_digest (ucl_hash_t *hashlin)
+{
+	if (hashlin == NULL) {
+		return NULL;
+	}
+
+	return &hashlin->digest;
+}
+
+struct ucl_backing_list**
+ucl_hash_backings (ucl_hash_t *hashlin)
+{
+	if (hashlin == NULL) {
+		return NULL;
+	}
+
+	return &hashlin->backings;
+}
 
 const ucl_object_t*
 ucl_hash_search (ucl_hash_t* hashlin, const char *key, unsigned keylen)
@@ -452,11 +475,90 @@ ucl_hash_search (ucl_hash_t* hashlin, const char *key, unsigned keylen)
 	return ret;
 }
 
+bool
+ucl_hash_position (ucl_hash_t* hashlin, const ucl_object_t *obj, size_t *pos)
+{
+	khiter_t k;
+
+	if (hashlin == NULL) {
+		return false;
+	}
+
+	if (hashlin->caseless) {
+		khash_t(ucl_hash_caseless_node) *h = (khash_t(ucl_hash_caseless_node) *)
+						hashlin->hash;
+
+		k = kh_get (ucl_hash_caseless_node, h, obj);
+		if (k != kh_end (h)) {
+			*pos = kh_value (h, k).ar_idx;
+			return true;
+		}
+	}
+	else {
+		khash_t(ucl_hash_node) *h = (khash_t(ucl_hash_node) *)
+						hashlin->hash;
+		k = kh_get (ucl_hash_node, h, obj);
+		if (k != kh_end (h)) {
+			*pos = kh_value (h, k).ar_idx;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool
+ucl_hash_reserve (ucl_hash_t *hashlin, size_t sz)
+{
+	const ucl_object_t **nar;
+	khint_t nbuckets;
+
+	if (hashlin == NULL || sz > UINT_MAX / 2) {
+		return false;
+	}
+
+	if (sz > hashlin->ar.m) {
+		nar = realloc (hashlin->ar.a, sz * sizeof (*nar));
+
+		if (nar == NULL) {
+			return false;
+		}
+
+		hashlin->ar.a = nar;
+		hashlin->ar.m = sz;
+	}
+
+	/* Keep the load factor below khash upper bound */
+	nbuckets = sz + sz / 3 + 1;
+
+	if (hashlin->caseless) {
+		khash_t(ucl_hash_caseless_node) *h = (khash_t(ucl_hash_caseless_node) *)
+				hashlin->hash;
+
+		if (nbuckets > kh_n_buckets (h) &&
+				kh_resize (ucl_hash_caseless_node, h, nbuckets) < 0) {
+			return false;
+		}
+	}
+	else {
+		khash_t(ucl_hash_node) *h = (khash_t(ucl_hash_node) *)
+				hashlin->hash;
+
+		if (nbuckets > kh_n_buckets (h) &&
+				kh_resize (ucl_hash_node, h, nbuckets) < 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void
 ucl_hash_delete (ucl_hash_t* hashlin, const ucl_object_t *obj)
 {
 	khiter_t k;
 	struct ucl_hash_elt *elt;
+	size_t i;
 
 	if (hashlin == NULL) {
 		return;
@@ -469,8 +571,17 @@ ucl_hash_delete (ucl_hash_t* hashlin, const ucl_object_t *obj)
 		k = kh_get (ucl_hash_caseless_node, h, obj);
 		if (k != kh_end (h)) {
 			elt = &kh_value (h, k);
+			i = elt->ar_idx;
 			kv_del (const ucl_object_t *, hashlin->ar, elt->ar_idx);
 			kh_del (ucl_hash_caseless_node, h, k);
+
+			/* Update indicies of the subsequent elements */
+			for (; i < kv_size (hashlin->ar); i ++) {
+				k = kh_get (ucl_hash_caseless_node, h, kv_A (hashlin->ar, i));
+				if (k != kh_end (h)) {
+					kh_value (h, k).ar_idx --;
+				}
+			}
 		}
 	}
 	else {
@@ -479,8 +590,17 @@ ucl_hash_delete (ucl_hash_t* hashlin, const ucl_object_t *obj)
 		k = kh_get (ucl_hash_node, h, obj);
 		if (k != kh_end (h)) {
 			elt = &kh_value (h, k);
+			i = elt->ar_idx;
 			kv_del (const ucl_object_t *, hashlin->ar, elt->ar_idx);
 			kh_del (ucl_hash_node, h, k);
+
+			/* Update indicies of the subsequent elements */
+			for (; i < kv_size (hashlin->ar); i ++) {
+				k = kh_get (ucl_hash_node, h, kv_A (hashlin->ar, i));
+				if (k != kh_end (h)) {
+					kh_value (h, k).ar_idx --;
+				}
+			}
 		}
 	}
 }
@@ -70,12 +70,24 @@ void ucl_hash_replace (ucl_hash_t* hashlin, const ucl_object_t *old,
  */
 void ucl_hash_delete (ucl_hash_t* hashlin, const ucl_object_t *obj);
 
+/**
+ * Preallocate space for `sz` elements, so that inserting them does not
+ * cause any reallocations or rehashing
+ */
+bool ucl_hash_reserve (ucl_hash_t *hashlin, size_t sz);
+
 /**
  * Searches an element in the hashtable.
  */
 const ucl_object_t* ucl_hash_search (ucl_hash_t* hashlin, const char *key,
 		unsigned keylen);
 
+/**
+ * Get the position of an element in the insertion order
+ * @return false if there is no element with the key of `obj`
+ */
+bool ucl_hash_position (ucl_hash_t* hashlin, const ucl_object_t *obj,
+		size_t *pos);
 
 /**
  * Iterate over hash table
@@ -90,4 +102,16 @@ const void* ucl_hash_iterate (ucl_hash_t *hashlin, ucl_hash_iter_t *iter);
  */
 bool ucl_hash_iter_has_next (ucl_hash_t *hashlin, ucl_hash_iter_t iter);
 
+/**
+ * Returns a slot for the cached content hash of the owning object
+ */
+uint64_t* ucl_hash_digest (ucl_hash_t *hashlin);
+
+struct ucl_backing_list;
+
+/**
+ * Returns a slot for the backing stores the owning object refers to
+ */
+struct ucl_backing_list** ucl_hash_backings (ucl_hash_t *hashlin);
+
 #endif
@@ -48,6 +48,9 @@
 #ifndef _WIN32
 # define HAVE_REGEX_H
 #endif
+#ifdef __linux__
+# define HAVE_SYS_INOTIFY_H
+#endif
 #endif
 
 #ifdef HAVE_SYS_TYPES_H
@@ -94,6 +97,7 @@
 #include "ucl.h"
 #include "ucl_hash.h"
 #include "xxhash.h"
+#include "kvec.h"
 
 #ifdef HAVE_OPENSSL
 #include <openssl/evp.h>
@@ -109,9 +113,182 @@
  */
 
 #define UCL_MAX_RECURSION 16
+/* Initial size of buffers for descriptors that cannot be mapped */
+#define UCL_READ_BUFFER_SIZE (64 * 1024)
+/* Larger read buffers are not kept by the parser for the next read */
+#define UCL_READ_BUFFER_KEEP_MAX (4 * 1024 * 1024)
+/* Size of input and output buffers of compressed emitter functions */
+#define UCL_COMPRESS_BUFFER_SIZE (64 * 1024)
+/* Default limit of decompressed input */
+#define UCL_MAX_DECOMPRESSED_SIZE (256 * 1024 * 1024)
+/* Sizes stored in compressed input are not trusted beyond this ratio */
+#define UCL_DECOMPRESS_HINT_RATIO 16
 #define UCL_TRASH_KEY 0
 #define UCL_TRASH_VALUE 1
 
+/*
+ * Buffer that objects parsed in zero-copy mode point into, e.g. a mapped
+ * file. Containers filled from such a buffer hold references to it, so it is
+ * released together with the last of them.
+ */
+struct ucl_backing {
+	void *data;
+	size_t len;
+	unsigned int ref;
+	void (*dtor) (void *data, size_t len);
+};
+
+struct ucl_backing_list {
+	struct ucl_backing *backing;
+	struct ucl_backing_list *next;
+};
+
+/*
+ * Layout compatible with kvec_t(ucl_object_t *), `digest` caches the content
+ * hash of sealed arrays (0 means not computed). Homogeneous numeric arrays
+ * could be packed: values are stored in `packed` and `a` is empty. Readers
+ * of packed elements as objects get ephemeral copies from `view`
+ */
+typedef struct ucl_array_s {
+	size_t n, m;
+	ucl_object_t **a;
+	uint64_t digest;
+	void *packed;
+	size_t npacked;
+	ucl_type_t packed_type;
+	ucl_object_t *view;
+	struct ucl_backing_list *backings;
+} ucl_array_t;
+
+/* Minimum number of elements in a parsed array to pack it */
+#define UCL_ARRAY_PACK_MIN 8
+
+/**
+ * Convert packed array storage to ucl objects
+ * @param top array object
+ * @return false if element objects cannot be allocated, storage is left packed
+ */
+bool ucl_array_unpack (const ucl_object_t *top);
+
+/**
+ * Fill a temporary scalar object with a value of packed array
+ * @param vec packed array storage
+ * @param idx index of an element
+ * @param elt object to fill
+ */
+void ucl_array_packed_elt (const ucl_array_t *vec, size_t idx,
+		ucl_object_t *elt);
+
+/**
+ * Get an element of an array without unpacking its storage
+ * @param vec array storage
+ * @param idx index of an element
+ * @param tmp temporary object to hold a packed value
+ * @return element, `tmp` filled with a packed value or NULL if out of range
+ */
+const ucl_object_t* ucl_array_elt_at (const ucl_array_t *vec, size_t idx,
+		ucl_object_t *tmp);
+
+/**
+ * Get an element of an array as an object without unpacking its storage.
+ * Elements of packed arrays are ephemeral objects valid until the array is
+ * modified or freed
+ * @param top array object
+ * @param idx index of an element
+ * @return element or NULL if out of range or cannot be allocated
+ */
+const ucl_object_t* ucl_array_elt_view (const ucl_object_t *top, size_t idx);
+
+/**
+ * Find the index of an ephemeral element returned by `ucl_array_elt_view`
+ * @param vec packed array storage
+ * @param elt element to find
+ * @return index of an element or (size_t)-1 if `elt` is not in the view
+ */
+size_t ucl_array_view_index (const ucl_array_t *vec, const ucl_object_t *elt);
+
+/**
+ * Copy storage of a packed array
+ * @param vec packed array storage
+ * @return new array storage
+ */
+ucl_array_t* ucl_array_packed_copy (const ucl_array_t *vec);
+
+/*
+ * Input range of a container skipped by the parser, stored in the value
+ * trash slot of an object with UCL_OBJECT_DEFERRED flag
+ */
+struct ucl_deferred_container {
+	const unsigned char *begin;
+	size_t len;
+	int flags;
+	unsigned priority;
+	enum ucl_duplicate_strategy strategy;
+};
+
+/**
+ * Parse a deferred container in place
+ * @param obj object or array with UCL_OBJECT_DEFERRED flag
+ * @return false if the container cannot be parsed
+ */
+bool ucl_object_parse_deferred (const ucl_object_t *obj);
+
+/*
+ * Must be called before direct access to `value` and `len` of containers
+ */
+static inline void
+ucl_container_materialize (const ucl_object_t *obj)
+{
+	if (obj != NULL && (obj->flags & UCL_OBJECT_DEFERRED)) {
+		ucl_object_parse_deferred (obj);
+	}
+}
+
+static inline ucl_array_t *
+ucl_array_get_vec (const ucl_object_t *obj)
+{
+	ucl_array_t *vec;
+
+	if (obj == NULL) {
+		return NULL;
+	}
+
+	ucl_container_materialize (obj);
+	vec = (ucl_array_t *)obj->value.av;
+
+	if (vec != NULL && obj->type == UCL_ARRAY && vec->packed != NULL) {
+		/* Sealed arrays are read concurrently and cannot be modified anyway */
+		if (obj->flags & UCL_OBJECT_SEALED) {
+			return NULL;
+		}
+		/* Element objects are required, so we need to materialize them */
+		if (!ucl_array_unpack (obj)) {
+			return NULL;
+		}
+	}
+
+	return vec;
+}
+
+#define UCL_ARRAY_GET(ar, obj) ucl_array_t *ar = ucl_array_get_vec (obj)
+/* Packed storage of an array exists but could not be unpacked */
+#define UCL_ARRAY_UNPACK_FAILED(ar, obj) ((ar) == NULL && (obj) != NULL && \
+		(obj)->type == UCL_ARRAY && (obj)->value.av != NULL)
+static inline ucl_array_t *
+ucl_array_get_raw (const ucl_object_t *obj)
+{
+	if (obj == NULL) {
+		return NULL;
+	}
+
+	ucl_container_materialize (obj);
+
+	return (ucl_array_t *)obj->value.av;
+}
+
+/* Does not unpack packed arrays */
+#define UCL_ARRAY_GET_RAW(ar, obj) ucl_array_t *ar = ucl_array_get_raw (obj)
+
 enum ucl_parser_state {
 	UCL_STATE_INIT = 0,
 	UCL_STATE_OBJECT,
@@ -158,6 +335,7 @@ struct ucl_stack {
 	ucl_object_t *obj;
 	struct ucl_stack *next;
 	uint64_t level;
+	const ucl_object_t *proj; /* Selected keys of this container, NULL for all */
 };
 
 struct ucl_chunk {
@@ -165,8 +343,10 @@ struct ucl_chunk {
 	const unsigned char *end;
 	const unsigned char *pos;
 	size_t remain;
-	unsigned int line;
+	unsigned int line; /* Line and column of line_pos, see ucl_chunk_position */
 	unsigned int column;
+	const unsigned char *line_pos;
+	struct ucl_backing *backing; /* Buffer owning the data in zero-copy mode */
 	unsigned priority;
 	enum ucl_duplicate_strategy strategy;
 	enum ucl_parse_type parse_type;
@@ -184,14 +364,83 @@ struct ucl_pubkey {
 };
 #endif
 
+/*
+ * Identity of a file, any write to it changes the status change time
+ */
+struct ucl_file_id {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t ctime;
+	long ctime_nsec;
+};
+
+/* Files with signatures verified by the parser */
+struct ucl_sig_cache {
+	struct {
+		struct ucl_file_id file;
+		struct ucl_file_id sig;
+	} id;
+	UT_hash_handle hh;
+};
+
+#define UCL_SIG_CACHE_MAX 1024
+/* Time of sliced parsing is checked after parsing this many bytes */
+#define UCL_SLICE_TIME_STEP (16 * 1024)
+
 struct ucl_variable {
 	char *var;
 	char *value;
 	size_t var_len;
 	size_t value_len;
+	unsigned int seq; /* Registration order, resolves prefix matches */
+	UT_hash_handle hh;
 	struct ucl_variable *prev, *next;
 };
 
+/* Number of idle parsers kept by each thread's parser pool */
+#define UCL_PARSER_POOL_SIZE 8
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && \
+	!defined(__STDC_NO_THREADS__)
+#define UCL_THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define UCL_THREAD_LOCAL __declspec(thread)
+#else
+#define UCL_THREAD_LOCAL __thread
+#endif
+
+/* Maximum number of distinct macro argument strings cached per parser */
+#define UCL_MACRO_ARGS_CACHE_MAX 256
+
+struct ucl_macro_args {
+	char *text;
+	size_t len;
+	ucl_object_t *args;
+	UT_hash_handle hh;
+};
+
+/*
+ * A file included while parsing, recorded so that a watcher can reparse it
+ * alone and replace the keys it has added to its container
+ */
+struct ucl_include_track {
+	char *path; /* Real path of a file or a pattern of files */
+	bool pattern; /* Files matching the path may appear later */
+	bool merged; /* Contents are mixed with other data */
+	bool done;
+	unsigned int gen; /* Update of a watcher that has parsed the file */
+	unsigned priority;
+	enum ucl_duplicate_strategy strat;
+	enum ucl_parse_type parse_type;
+	ucl_object_t *cpath; /* Keys from the top object to the container */
+	ucl_object_t *keys; /* Keys added to the container, in order */
+	const ucl_object_t *container; /* Valid while parsing only */
+	size_t start; /* Number of keys in the container before the file */
+	struct ucl_include_track *parent; /* Including file */
+	struct ucl_include_track *prev, *next;
+};
+
 struct ucl_parser {
 	enum ucl_parser_state state;
 	enum ucl_parser_state prev_state;
@@ -206,22 +455,108 @@ struct ucl_parser {
 	char *cur_file;
 	struct ucl_macro *macroes;
 	struct ucl_stack *stack;
+	struct ucl_stack *stack_free; /* Released frames kept for reuse */
+	unsigned int stack_depth;
+	unsigned int max_depth; /* Containers nesting limit, 0 means unlimited */
+	unsigned int max_recursion; /* Includes nesting limit */
+	size_t max_decompressed; /* Limit of decompressed input, 0 means unlimited */
 	struct ucl_chunk *chunks;
 	struct ucl_pubkey *keys;
 	struct ucl_variable *variables;
+	struct ucl_variable *vars_hash;
+	uint64_t var_lens; /* Bit N is set if there is a variable of length N + 1 */
+	unsigned int var_seq;
+	struct ucl_macro_args *macro_args;
+	unsigned int macro_args_count;
 	ucl_variable_handler var_handler;
 	void *var_data;
 	ucl_object_t *comments;
 	ucl_object_t *last_comment;
+	unsigned lazy_depth;
+	bool deferred; /* Parses the range of a deferred container */
+	ucl_object_t *projection;
+	const ucl_object_t *proj_next;
+	bool skip_value;
+	struct ucl_sig_cache *sig_cache;
+	unsigned int sig_cache_count;
+	ucl_include_fetcher include_fetcher;
+	void *include_fetcher_ud;
+	struct ucl_pending_include *pending_includes; /* In document order */
+	unsigned int include_seq;
+	unsigned int parse_depth; /* Chunks being parsed */
+	bool suspended; /* Top chunk is parsed in slices and is not finished */
+	bool sliced;
+	size_t slice_bytes;
+	double slice_time;
+	const unsigned char *slice_end;
+	const unsigned char *slice_checked; /* Position of the last time check */
+	double slice_deadline;
+	bool track_includes; /* Record included files for a watcher */
+	struct ucl_include_track *tracked;
+	struct ucl_include_track *cur_track; /* File being parsed */
+	unsigned char *read_buf; /* Reused for descriptors that cannot be mapped */
+	size_t read_buf_size;
 	UT_string *err;
 };
 
+/**
+ * Bring line and column of a chunk up to its current position. The parser
+ * advances only `pos` while scanning, so lines are counted on demand over
+ * the range consumed since the previous call. This is also done when the
+ * chunk is finished, so no data is read after the input is released.
+ * @param chunk chunk to update
+ */
+static inline void
+ucl_chunk_position (struct ucl_chunk *chunk)
+{
+	const unsigned char *p = chunk->line_pos, *nl;
+
+	if (chunk->pos < p) {
+		/* Position has been restored backwards, count from the beginning */
+		p = chunk->begin;
+		chunk->line = 1;
+		chunk->column = 0;
+	}
+
+	while ((nl = memchr (p, '\n', chunk->pos - p)) != NULL) {
+		chunk->line ++;
+		chunk->column = 0;
+		p = nl + 1;
+	}
+
+	chunk->column += chunk->pos - p;
+	chunk->line_pos = chunk->pos;
+}
+
 struct ucl_object_userdata {
 	ucl_object_t obj;
 	ucl_userdata_dtor dtor;
 	ucl_userdata_emitter emitter;
 };
 
+/**
+ * Register a variable in the parser
+ * @param parser
+ * @param var variable to add, must not be registered
+ */
+void ucl_parser_variable_add (struct ucl_parser *parser,
+		struct ucl_variable *var);
+
+/**
+ * Unregister a variable without freeing it
+ * @param parser
+ * @param var registered variable
+ */
+void ucl_parser_variable_remove (struct ucl_parser *parser,
+		struct ucl_variable *var);
+
+/**
+ * Drop everything configured on a parser after ucl_parser_new: user macros
+ * and variables, keys, include paths, projection, limits and hooks
+ * @param parser parser that has been reset
+ */
+void ucl_parser_reset_config (struct ucl_parser *parser);
+
 /**
  * Unescape json string inplace
  * @param str
@@ -325,6 +660,225 @@ ucl_create_err (UT_string **err, const char *fmt, ...)
 #endif
 }
 
+/**
+ * Create a backing store for a buffer with a single reference
+ * @param data buffer
+ * @param len length of buffer
+ * @param dtor function that releases the buffer
+ * @return new backing store or NULL
+ */
+struct ucl_backing *ucl_backing_new (void *data, size_t len,
+		void (*dtor) (void *data, size_t len));
+
+/**
+ * Acquire a reference to a backing store
+ * @param backing backing store
+ * @return the same backing store
+ */
+struct ucl_backing *ucl_backing_ref (struct ucl_backing *backing);
+
+/**
+ * Release a reference to a backing store, the buffer is released with the
+ * last reference
+ * @param backing backing store
+ */
+void ucl_backing_unref (struct ucl_backing *backing);
+
+/**
+ * Detect compressed data by its magic bytes
+ * @param data input
+ * @param len length of input
+ * @return compression type or UCL_COMPRESSION_NONE
+ */
+enum ucl_compression_type ucl_compression_detect (const unsigned char *data,
+		size_t len);
+
+/**
+ * Decompress input to a newly allocated buffer
+ * @param type compression type
+ * @param in compressed input
+ * @param inlen length of input
+ * @param limit maximum length of decompressed data, 0 means no limit
+ * @param out decompressed data, must be freed by a caller
+ * @param outlen length of decompressed data
+ * @param err error
+ * @return true on success
+ */
+bool ucl_decompress (enum ucl_compression_type type,
+		const unsigned char *in, size_t inlen, size_t limit,
+		unsigned char **out, size_t *outlen, UT_string **err);
+
+/**
+ * Parse a chunk whose data is owned by a backing store, containers filled from
+ * it hold references to the store, so zero-copy strings stay valid after the
+ * caller releases its own reference
+ * @param backing backing store or NULL for data owned by the caller
+ */
+bool ucl_parser_add_backed_chunk (struct ucl_parser *parser,
+		const unsigned char *data, size_t len, unsigned priority,
+		enum ucl_duplicate_strategy strat, enum ucl_parse_type parse_type,
+		struct ucl_backing *backing);
+
+/**
+ * Parse the contents of deferred includes that have been supplied, in the
+ * order of include directives, does nothing while a chunk is being parsed
+ * @param parser parser
+ * @return false if an include has failed
+ */
+bool ucl_parser_apply_includes (struct ucl_parser *parser);
+
+/**
+ * Drop all deferred includes
+ * @param parser parser
+ */
+void ucl_parser_free_pending_includes (struct ucl_parser *parser);
+
+/**
+ * Start recording of a file included into the current container
+ * @param parser parser
+ * @param path real path of the file
+ * @param priority priority of the include
+ * @param strat duplicate strategy of the include
+ * @param parse_type format of the file
+ * @return record to be passed to #ucl_include_track_finish
+ */
+struct ucl_include_track *ucl_include_track_start (struct ucl_parser *parser,
+		const char *path, unsigned priority,
+		enum ucl_duplicate_strategy strat, enum ucl_parse_type parse_type);
+
+/**
+ * Record keys added by an included file once it is parsed
+ * @param parser parser
+ * @param tr record of the file
+ */
+void ucl_include_track_finish (struct ucl_parser *parser,
+		struct ucl_include_track *tr);
+
+/**
+ * Record a glob pattern or a missing file, creating a file that matches it
+ * changes the including file
+ * @param parser parser
+ * @param pattern pattern or path as written in the include
+ */
+void ucl_include_track_pattern (struct ucl_parser *parser,
+		const char *pattern);
+
+/**
+ * Mark included files whose data is mixed when a key of a container is added
+ * again
+ * @param parser parser
+ * @param container container object
+ * @param existing element that is already in the container
+ */
+void ucl_include_track_dup (struct ucl_parser *parser,
+		const ucl_object_t *container, const ucl_object_t *existing);
+
+/**
+ * Free a list of included files records
+ * @param list records
+ */
+void ucl_include_track_free (struct ucl_include_track *list);
+
+/**
+ * Make a container hold a reference to a backing store
+ * @param obj object or array
+ * @param backing backing store
+ */
+void ucl_object_attach_backing (ucl_object_t *obj, struct ucl_backing *backing);
+
+/**
+ * Make a container hold references to all backing stores of another one,
+ * used when objects are copied or moved between containers
+ * @param dst destination object or array
+ * @param src source object or array
+ */
+void ucl_object_share_backings (ucl_object_t *dst, const ucl_object_t *src);
+
+/**
+ * Attach the backing store of the current chunk to a container filled from it
+ * @param parser parser structure
+ * @param obj container object
+ */
+static inline void
+ucl_parser_attach_backing (struct ucl_parser *parser, ucl_object_t *obj)
+{
+	if (obj != NULL && parser->chunks != NULL &&
+			parser->chunks->backing != NULL) {
+		ucl_object_attach_backing (obj, parser->chunks->backing);
+	}
+}
+
+/**
+ * Push a container frame to the parser stack, frames released by
+ * ucl_parser_stack_pop are reused before allocating new ones
+ * @param parser parser structure
+ * @param obj container object
+ * @param level nesting level of the frame
+ * @return new stack top or NULL if nesting limit is reached or no memory
+ */
+static inline struct ucl_stack *
+ucl_parser_stack_push (struct ucl_parser *parser, ucl_object_t *obj,
+		uint64_t level)
+{
+	struct ucl_stack *st;
+
+	if (parser->max_depth != 0 && parser->stack_depth >= parser->max_depth) {
+		return NULL;
+	}
+
+	if (parser->stack_free != NULL) {
+		st = parser->stack_free;
+		parser->stack_free = st->next;
+	}
+	else {
+		st = UCL_ALLOC (sizeof (struct ucl_stack));
+
+		if (st == NULL) {
+			return NULL;
+		}
+	}
+
+	st->obj = obj;
+	st->level = level;
+	st->proj = NULL;
+	st->next = parser->stack;
+	parser->stack = st;
+	parser->stack_depth ++;
+	ucl_parser_attach_backing (parser, obj);
+
+	return st;
+}
+
+/**
+ * Remove the top frame from the parser stack
+ * @param parser parser structure
+ */
+static inline void
+ucl_parser_stack_pop (struct ucl_parser *parser)
+{
+	struct ucl_stack *st = parser->stack;
+
+	parser->stack = st->next;
+	st->next = parser->stack_free;
+	parser->stack_free = st;
+	parser->stack_depth --;
+}
+
+/**
+ * Return an error message explaining why ucl_parser_stack_push has failed
+ * @param parser parser structure
+ * @return static string
+ */
+static inline const char *
+ucl_parser_stack_error (struct ucl_parser *parser)
+{
+	if (parser->max_depth != 0 && parser->stack_depth >= parser->max_depth) {
+		return "maximum nesting depth is reached";
+	}
+
+	return "cannot allocate memory for an object";
+}
+
 /**
  * Check whether a given string contains a boolean value
  * @param obj object to set
@@ -448,6 +1002,15 @@ void ucl_elt_string_write_multiline (const char *str, size_t size,
  */
 unsigned char * ucl_object_emit_single_json (const ucl_object_t *obj);
 
+/**
+ * Format a double the way all emitter sinks print it
+ * @param val value
+ * @param buf output buffer
+ * @param buflen size of the buffer
+ * @return number of characters written as returned by snprintf
+ */
+int ucl_emitter_format_double (double val, char *buf, size_t buflen);
+
 /**
  * Check whether a specified string is long and should be likely printed in
  * multiline mode
@@ -525,6 +1088,42 @@ void ucl_emitter_print_key_msgpack (bool print_key,
 		struct ucl_emitter_context *ctx,
 		const ucl_object_t *obj);
 
+/*
+ * Document stored in the url cache
+ */
+struct ucl_url_cache_entry {
+	unsigned char *body;
+	size_t len;
+	char *etag; /* NULL if not sent by the server */
+	int64_t mtime; /* Last-Modified time or -1 */
+};
+
+/**
+ * Load a cached copy of a url
+ * @param url url
+ * @param entry filled with the cached document, must be released with
+ * `ucl_url_cache_entry_free` if this function returns true
+ * @return true if the url is cached
+ */
+bool ucl_url_cache_load (const char *url, struct ucl_url_cache_entry *entry);
+
+/**
+ * Save a document fetched from a url to the cache, errors are ignored
+ * @param url url
+ * @param body document
+ * @param len length of document
+ * @param etag ETag sent by the server or NULL
+ * @param mtime Last-Modified time sent by the server or -1
+ */
+void ucl_url_cache_store (const char *url, const unsigned char *body,
+		size_t len, const char *etag, int64_t mtime);
+
+/**
+ * Release a cache entry
+ * @param entry entry
+ */
+void ucl_url_cache_entry_free (struct ucl_url_cache_entry *entry);
+
 /**
  * Fetch URL into a buffer
  * @param url url to fetch
@@ -545,11 +1144,13 @@ bool ucl_fetch_url (const unsigned char *url,
  * @param len length of filename
  * @param buf target buffer
  * @param buflen target length
+ * @param st if not NULL, filled with the status of the file that was mapped
  * @return
  */
 bool ucl_fetch_file (const unsigned char *filename,
 		unsigned char **buf,
 		size_t *buflen,
+		struct stat *st,
 		UT_string **err,
 		bool must_exist);
 
@@ -562,6 +1163,14 @@ bool ucl_fetch_file (const unsigned char *filename,
 bool ucl_parser_process_object_element (struct ucl_parser *parser,
 		ucl_object_t *nobj);
 
+/**
+ * Pack a finished array of numbers if requested by parser flags
+ * @param parser
+ * @param obj
+ * @return true if an array has been packed
+ */
+bool ucl_parser_maybe_pack (struct ucl_parser *parser, ucl_object_t *obj);
+
 /**
  * Parse msgpack chunk
  * @param parser
@@ -569,4 +1178,43 @@ bool ucl_parser_process_object_element (struct ucl_parser *parser,
  */
 bool ucl_parse_msgpack (struct ucl_parser *parser);
 
+/**
+ * Deep copy of an object
+ * @param other object to copy
+ * @param allow_array copy implicit array elements linked to `other` as well
+ * @return new object
+ */
+ucl_object_t* ucl_object_copy_internal (const ucl_object_t *other,
+		bool allow_array);
+
+/**
+ * Unescape a string parsed with UCL_PARSER_LAZY_UNESCAPE
+ * @param obj string object
+ */
+void ucl_object_unescape_deferred (const ucl_object_t *obj);
+
+/*
+ * Must be called before direct access to `value.sv` and `len` of strings
+ */
+static inline void
+ucl_string_materialize (const ucl_object_t *obj)
+{
+	if (obj->flags & UCL_OBJECT_NEED_UNESCAPE) {
+		ucl_object_unescape_deferred (obj);
+	}
+}
+
+typedef uint64_t (*ucl_object_hash_func) (const ucl_object_t *obj, void *ud);
+
+/**
+ * Calculate hash of an object and its implicit array elements using
+ * `child_hash` to hash nested elements
+ * @param obj object to hash
+ * @param child_hash function to calculate hashes of children
+ * @param ud opaque data for `child_hash`
+ * @return hash value
+ */
+uint64_t ucl_object_hash_full (const ucl_object_t *obj,
+		ucl_object_hash_func child_hash, void *ud);
+
 #endif /* UCL_INTERNAL_H_ */
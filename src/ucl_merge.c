@@ -0,0 +1,327 @@
+/* Copyright (c) 2016, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Single pass merge of multiple configuration layers
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ucl.h"
+#include "ucl_internal.h"
+
+struct ucl_merge_src {
+	const ucl_object_t *obj;
+	const struct ucl_merge_layer *layer;
+};
+
+typedef kvec_t(struct ucl_merge_src) ucl_merge_srcs_t;
+
+/* Resolution state of a single key */
+struct ucl_merge_state {
+	/* Values forming an implicit array, the first one is the head */
+	ucl_merge_srcs_t items;
+	/* Containers merged into the head */
+	ucl_merge_srcs_t group;
+	unsigned priority;
+};
+
+static ucl_object_t *ucl_merge_objects (const struct ucl_merge_src *srcs,
+		size_t nsrcs);
+
+/*
+ * Containers release all elements of implicit arrays individually, so each
+ * of them needs a reference
+ */
+static ucl_object_t *
+ucl_merge_ref_chain (const ucl_object_t *obj)
+{
+	const ucl_object_t *cur;
+
+	LL_FOREACH (obj, cur) {
+		ucl_object_ref (cur);
+	}
+
+	return __DECONST (ucl_object_t *, obj);
+}
+
+static void
+ucl_merge_state_reset (struct ucl_merge_state *st,
+		const ucl_object_t *obj, const struct ucl_merge_layer *layer)
+{
+	struct ucl_merge_src src;
+
+	src.obj = obj;
+	src.layer = layer;
+	st->items.n = 0;
+	st->group.n = 0;
+	st->priority = layer->priority;
+	kv_push (struct ucl_merge_src, st->items, src);
+}
+
+/*
+ * Applies a value from the next layer, follows the logic of
+ * ucl_parser_process_object_element
+ */
+static bool
+ucl_merge_state_apply (struct ucl_merge_state *st,
+		const ucl_object_t *obj, const struct ucl_merge_layer *layer)
+{
+	struct ucl_merge_src src;
+	const ucl_object_t *head;
+
+	if (st->items.n == 0) {
+		ucl_merge_state_reset (st, obj, layer);
+
+		return true;
+	}
+
+	src.obj = obj;
+	src.layer = layer;
+
+	switch (layer->strategy) {
+	case UCL_DUPLICATE_APPEND:
+		if (layer->priority == st->priority) {
+			kv_push (struct ucl_merge_src, st->items, src);
+		}
+		else if (layer->priority > st->priority) {
+			ucl_merge_state_reset (st, obj, layer);
+		}
+		break;
+	case UCL_DUPLICATE_REWRITE:
+		ucl_merge_state_reset (st, obj, layer);
+		break;
+	case UCL_DUPLICATE_ERROR:
+		return false;
+	case UCL_DUPLICATE_MERGE:
+		head = kv_A (st->items, 0).obj;
+
+		if ((head->type == UCL_OBJECT || head->type == UCL_ARRAY) &&
+				head->type == obj->type &&
+				head->next == NULL && obj->next == NULL) {
+			if (st->group.n == 0) {
+				kv_push (struct ucl_merge_src, st->group, kv_A (st->items, 0));
+			}
+
+			kv_push (struct ucl_merge_src, st->group, src);
+		}
+		else {
+			/* For other types we create implicit array as usual */
+			kv_push (struct ucl_merge_src, st->items, src);
+		}
+		break;
+	}
+
+	return true;
+}
+
+static ucl_object_t *
+ucl_merge_group (const struct ucl_merge_state *st)
+{
+	const ucl_object_t *first = kv_A (st->group, 0).obj, *cur;
+	ucl_object_t *res;
+	ucl_object_iter_t it;
+	size_t i, nelts = 0;
+
+	if (first->type == UCL_OBJECT) {
+		res = ucl_merge_objects (st->group.a, st->group.n);
+	}
+	else {
+		for (i = 0; i < st->group.n; i ++) {
+			nelts += kv_A (st->group, i).obj->len;
+		}
+
+		res = ucl_object_new_reserved (UCL_ARRAY, 0, nelts);
+
+		for (i = 0; res != NULL && i < st->group.n; i ++) {
+			it = NULL;
+
+			while ((cur = ucl_object_iterate (kv_A (st->group, i).obj, &it,
+					true)) != NULL) {
+				ucl_array_append (res, ucl_merge_ref_chain (cur));
+			}
+
+			ucl_object_share_backings (res, kv_A (st->group, i).obj);
+		}
+	}
+
+	if (res != NULL) {
+		res->key = first->key;
+		res->keylen = first->keylen;
+		ucl_copy_key_trash (res);
+		ucl_object_set_priority (res, st->priority);
+	}
+
+	return res;
+}
+
+static ucl_object_t *
+ucl_merge_state_finish (const struct ucl_merge_state *st)
+{
+	ucl_object_t *res = NULL, *cp;
+	const ucl_object_t *cur;
+	size_t i;
+
+	if (st->items.n == 1 && st->group.n == 0) {
+		/* Value from a single layer is shared as is */
+		return ucl_merge_ref_chain (kv_A (st->items, 0).obj);
+	}
+
+	for (i = 0; i < st->items.n; i ++) {
+		if (i == 0 && st->group.n > 0) {
+			cp = ucl_merge_group (st);
+
+			if (cp == NULL) {
+				ucl_object_unref (res);
+
+				return NULL;
+			}
+
+			DL_APPEND (res, cp);
+			continue;
+		}
+
+		/* Elements of implicit arrays cannot be shared */
+		LL_FOREACH (kv_A (st->items, i).obj, cur) {
+			cp = ucl_object_copy_internal (cur, false);
+
+			if (cp == NULL) {
+				ucl_object_unref (res);
+
+				return NULL;
+			}
+
+			DL_APPEND (res, cp);
+		}
+	}
+
+	return res;
+}
+
+static ucl_object_t *
+ucl_merge_objects (const struct ucl_merge_src *srcs, size_t nsrcs)
+{
+	struct ucl_merge_state st;
+	const ucl_object_t *cur, *val;
+	ucl_object_t *res, *nobj;
+	ucl_object_iter_t it;
+	size_t i, j, nkeys = 0;
+
+	for (i = 0; i < nsrcs; i ++) {
+		if (srcs[i].obj->len > nkeys) {
+			nkeys = srcs[i].obj->len;
+		}
+	}
+
+	res = ucl_object_new_reserved (UCL_OBJECT, 0, nkeys);
+
+	if (res == NULL) {
+		return NULL;
+	}
+
+	memset (&st, 0, sizeof (st));
+
+	for (i = 0; i < nsrcs; i ++) {
+		it = NULL;
+
+		while ((cur = ucl_object_iterate (srcs[i].obj, &it, true)) != NULL) {
+			if (i > 0 && res->value.ov != NULL &&
+					ucl_hash_search (res->value.ov, cur->key, cur->keylen)) {
+				/* Already resolved from one of the previous layers */
+				continue;
+			}
+
+			ucl_merge_state_reset (&st, cur, srcs[i].layer);
+
+			for (j = i + 1; j < nsrcs; j ++) {
+				val = ucl_object_lookup_len (srcs[j].obj, cur->key,
+						cur->keylen);
+
+				if (val != NULL && !ucl_merge_state_apply (&st, val,
+						srcs[j].layer)) {
+					goto err;
+				}
+			}
+
+			nobj = ucl_merge_state_finish (&st);
+
+			if (nobj == NULL) {
+				goto err;
+			}
+
+			res->value.ov = ucl_hash_insert_object (res->value.ov, nobj, false);
+			res->len ++;
+		}
+
+		ucl_object_share_backings (res, srcs[i].obj);
+	}
+
+	kv_destroy (st.items);
+	kv_destroy (st.group);
+
+	return res;
+
+err:
+	kv_destroy (st.items);
+	kv_destroy (st.group);
+	ucl_object_unref (res);
+
+	return NULL;
+}
+
+ucl_object_t *
+ucl_object_merge_layers (const struct ucl_merge_layer *layers, size_t nlayers)
+{
+	struct ucl_merge_src *srcs;
+	ucl_object_t *res;
+	size_t i;
+
+	if (layers == NULL || nlayers == 0) {
+		return NULL;
+	}
+
+	srcs = malloc (nlayers * sizeof (*srcs));
+
+	if (srcs == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < nlayers; i ++) {
+		if (layers[i].obj == NULL || layers[i].obj->type != UCL_OBJECT) {
+			free (srcs);
+
+			return NULL;
+		}
+
+		srcs[i].obj = layers[i].obj;
+		srcs[i].layer = &layers[i];
+	}
+
+	/* Top level objects are always merged */
+	res = ucl_merge_objects (srcs, nlayers);
+	free (srcs);
+
+	return res;
+}
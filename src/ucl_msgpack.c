@@ -772,28 +772,13 @@ ucl_msgpack_get_container (struct ucl_parser *parser,
 		/*
 		 * Insert new container to the stack
 		 */
-		if (parser->stack == NULL) {
-			parser->stack = calloc (1, sizeof (struct ucl_stack));
+		stack = ucl_parser_stack_push (parser, NULL, len | MSGPACK_CONTAINER_BIT);
 
-			if (parser->stack == NULL) {
-				ucl_create_err (&parser->err, "no memory");
-				return NULL;
-			}
-		}
-		else {
-			stack = calloc (1, sizeof (struct ucl_stack));
-
-			if (stack == NULL) {
-				ucl_create_err (&parser->err, "no memory");
-				return NULL;
-			}
-
-			stack->next = parser->stack;
-			parser->stack = stack;
+		if (stack == NULL) {
+			ucl_create_err (&parser->err, "%s", ucl_parser_stack_error (parser));
+			return NULL;
 		}
 
-		parser->stack->level = len | MSGPACK_CONTAINER_BIT;
-
 #ifdef MSGPACK_DEBUG_PARSER
 		stack = parser->stack;
 		while (stack) {
@@ -867,6 +852,9 @@ ucl_msgpack_insert_object (struct ucl_parser *parser,
 		if (!(parser->flags & UCL_PARSER_ZEROCOPY)) {
 			ucl_copy_key_trash (obj);
 		}
+		else {
+			obj->flags |= UCL_OBJECT_BORROWED;
+		}
 
 		ucl_parser_process_object_element (parser, obj);
 	}
@@ -900,9 +888,9 @@ ucl_msgpack_get_next_container (struct ucl_parser *parser)
 
 		if (level == 0) {
 			/* We need to switch to the previous container */
-			parser->stack = cur->next;
+			ucl_parser_stack_pop (parser);
 			parser->cur_obj = cur->obj;
-			free (cur);
+			ucl_parser_maybe_pack (parser, cur->obj);
 
 #ifdef MSGPACK_DEBUG_PARSER
 			cur = parser->stack;
@@ -1106,8 +1094,9 @@ ucl_msgpack_consume (struct ucl_parser *parser)
 			break;
 
 		case start_array:
-			parser->cur_obj = ucl_object_new_full (UCL_ARRAY,
-					parser->chunks->priority);
+			/* Storage is reserved once the number of elements is known */
+			parser->cur_obj = ucl_object_new_reserved (UCL_ARRAY,
+					parser->chunks->priority, 0);
 			/* Insert to the previous level container */
 			if (parser->stack && !ucl_msgpack_insert_object (parser,
 					key, keylen, parser->cur_obj)) {
@@ -1252,9 +1241,9 @@ ucl_msgpack_consume (struct ucl_parser *parser)
 			return false;
 		}
 
-		parser->cur_obj = ucl_object_new_full (
+		parser->cur_obj = ucl_object_new_reserved (
 				state == start_array ? UCL_ARRAY : UCL_OBJECT,
-				parser->chunks->priority);
+				parser->chunks->priority, 0);
 		/* Insert to the previous level container */
 		if (!ucl_msgpack_insert_object (parser,
 				key, keylen, parser->cur_obj)) {
@@ -1362,6 +1351,21 @@ ucl_msgpack_parse_map (struct ucl_parser *parser,
 		const unsigned char *pos, size_t remain)
 {
 	container->obj = parser->cur_obj;
+	ucl_parser_attach_backing (parser, container->obj);
+
+	/*
+	 * Each key-value pair takes at least two bytes, so do not trust huge
+	 * lengths from the header
+	 */
+	if (len > 0) {
+		if (parser->cur_obj->value.ov == NULL) {
+			parser->cur_obj->value.ov = ucl_hash_create (
+					parser->flags & UCL_PARSER_KEY_LOWERCASE);
+		}
+
+		ucl_object_reserve (parser->cur_obj,
+				len < remain / 2 ? len : remain / 2);
+	}
 
 	return 0;
 }
@@ -1372,6 +1376,12 @@ ucl_msgpack_parse_array (struct ucl_parser *parser,
 		const unsigned char *pos, size_t remain)
 {
 	container->obj = parser->cur_obj;
+	ucl_parser_attach_backing (parser, container->obj);
+
+	/* Each element takes at least one byte */
+	if (len > 0) {
+		ucl_object_reserve (parser->cur_obj, len < remain ? len : remain);
+	}
 
 	return 0;
 }
@@ -1407,6 +1417,9 @@ ucl_msgpack_parse_string (struct ucl_parser *parser,
 			ucl_copy_value_trash (obj);
 		}
 	}
+	else {
+		obj->flags |= UCL_OBJECT_BORROWED;
+	}
 
 	parser->cur_obj = obj;
 
@@ -0,0 +1,648 @@
+/* Copyright (c) 2016, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Packed storage for homogeneous arrays of integers and floats
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ucl.h"
+#include "ucl_internal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static ucl_object_t *
+ucl_array_new_packed (ucl_type_t type, const void *values, size_t nelts)
+{
+	ucl_object_t *top;
+	ucl_array_t *vec;
+
+	top = ucl_object_new_reserved (UCL_ARRAY, 0, 0);
+
+	if (top == NULL) {
+		return NULL;
+	}
+
+	vec = top->value.av;
+
+	if (nelts > 0) {
+		vec->packed = malloc (nelts * sizeof (int64_t));
+
+		if (vec->packed == NULL) {
+			ucl_object_unref (top);
+
+			return NULL;
+		}
+
+		memcpy (vec->packed, values, nelts * sizeof (int64_t));
+		vec->npacked = nelts;
+		vec->packed_type = type;
+		top->len = nelts;
+	}
+
+	return top;
+}
+
+ucl_object_t *
+ucl_array_new_packed_int (const int64_t *values, size_t nelts)
+{
+	return ucl_array_new_packed (UCL_INT, values, nelts);
+}
+
+ucl_object_t *
+ucl_array_new_packed_double (const double *values, size_t nelts)
+{
+	return ucl_array_new_packed (UCL_FLOAT, values, nelts);
+}
+
+bool
+ucl_array_pack (ucl_object_t *top)
+{
+	UCL_ARRAY_GET_RAW (vec, top);
+	const ucl_object_t *cur;
+	ucl_type_t type;
+	int64_t *iv;
+	double *dv;
+	size_t i;
+
+	if (top == NULL || top->type != UCL_ARRAY || vec == NULL ||
+			(top->flags & UCL_OBJECT_SEALED)) {
+		return false;
+	}
+
+	if (vec->packed != NULL) {
+		return true;
+	}
+
+	if (vec->n == 0 || vec->a[0] == NULL) {
+		return false;
+	}
+
+	type = vec->a[0]->type;
+
+	if (type != UCL_INT && type != UCL_FLOAT) {
+		return false;
+	}
+
+	/* Elements must be plain values owned by this array only */
+	for (i = 0; i < vec->n; i ++) {
+		cur = kv_A (*vec, i);
+
+		if (cur == NULL || cur->type != type || cur->next != NULL ||
+				cur->ref != 1 || cur->key != NULL) {
+			return false;
+		}
+	}
+
+	vec->packed = malloc (vec->n * sizeof (int64_t));
+
+	if (vec->packed == NULL) {
+		return false;
+	}
+
+	iv = vec->packed;
+	dv = vec->packed;
+
+	for (i = 0; i < vec->n; i ++) {
+		cur = kv_A (*vec, i);
+
+		if (type == UCL_INT) {
+			iv[i] = cur->value.iv;
+		}
+		else {
+			dv[i] = cur->value.dv;
+		}
+
+		ucl_object_unref (kv_A (*vec, i));
+	}
+
+	vec->npacked = vec->n;
+	vec->packed_type = type;
+	kv_destroy (*vec);
+	kv_init (*vec);
+	vec->digest = 0;
+
+	return true;
+}
+
+bool
+ucl_array_unpack (const ucl_object_t *top)
+{
+	ucl_array_t *vec = top->value.av;
+	ucl_object_t **elts;
+	unsigned priority;
+	size_t i;
+
+	elts = malloc (vec->npacked * sizeof (*elts));
+
+	if (elts == NULL) {
+		return false;
+	}
+
+	priority = ucl_object_get_priority (top);
+
+	for (i = 0; i < vec->npacked; i ++) {
+		elts[i] = ucl_object_new_full (vec->packed_type, priority);
+
+		if (elts[i] == NULL) {
+			while (i > 0) {
+				ucl_object_unref (elts[--i]);
+			}
+
+			free (elts);
+
+			return false;
+		}
+
+		ucl_array_packed_elt (vec, i, elts[i]);
+		/* Restore fields of a real object */
+		elts[i]->prev = elts[i];
+		ucl_object_set_priority (elts[i], priority);
+	}
+
+	kv_destroy (*vec);
+	vec->a = elts;
+	vec->n = vec->m = vec->npacked;
+	free (vec->packed);
+	vec->packed = NULL;
+	vec->npacked = 0;
+	free (vec->view);
+	vec->view = NULL;
+
+	return true;
+}
+
+void
+ucl_array_packed_elt (const ucl_array_t *vec, size_t idx, ucl_object_t *elt)
+{
+	memset (elt, 0, sizeof (*elt));
+	elt->type = vec->packed_type;
+	elt->ref = 1;
+	elt->prev = elt;
+
+	if (vec->packed_type == UCL_INT) {
+		elt->value.iv = ((const int64_t *)vec->packed)[idx];
+	}
+	else {
+		elt->value.dv = ((const double *)vec->packed)[idx];
+	}
+}
+
+const ucl_object_t *
+ucl_array_elt_at (const ucl_array_t *vec, size_t idx, ucl_object_t *tmp)
+{
+	if (vec->packed != NULL) {
+		if (idx >= vec->npacked) {
+			return NULL;
+		}
+
+		ucl_array_packed_elt (vec, idx, tmp);
+
+		return tmp;
+	}
+
+	return idx < vec->n ? kv_A (*vec, idx) : NULL;
+}
+
+/*
+ * Builds ephemeral element objects for all packed values once, the storage
+ * itself is left packed
+ */
+static ucl_object_t *
+ucl_array_packed_view (const ucl_object_t *top)
+{
+	ucl_array_t *vec = top->value.av;
+	ucl_object_t *view;
+	unsigned priority;
+	size_t i;
+
+	if (vec->view != NULL) {
+		return vec->view;
+	}
+
+	view = malloc (vec->npacked * sizeof (*view));
+
+	if (view == NULL) {
+		return NULL;
+	}
+
+	priority = ucl_object_get_priority (top);
+
+	for (i = 0; i < vec->npacked; i ++) {
+		ucl_array_packed_elt (vec, i, &view[i]);
+		ucl_object_set_priority (&view[i], priority);
+		/* Refs of ephemeral objects are copies, so views are never freed */
+		view[i].flags = UCL_OBJECT_EPHEMERAL |
+				(top->flags & UCL_OBJECT_SEALED);
+	}
+
+	/* Sealed arrays may be read from many threads at once */
+#ifdef HAVE_ATOMIC_BUILTINS
+	if (!__sync_bool_compare_and_swap (&vec->view, NULL, view)) {
+		free (view);
+	}
+#else
+	vec->view = view;
+#endif
+
+	return vec->view;
+}
+
+const ucl_object_t *
+ucl_array_elt_view (const ucl_object_t *top, size_t idx)
+{
+	UCL_ARRAY_GET_RAW (vec, top);
+	const ucl_object_t *view;
+
+	if (vec == NULL) {
+		return NULL;
+	}
+
+	if (vec->packed != NULL) {
+		if (idx >= vec->npacked) {
+			return NULL;
+		}
+
+		view = ucl_array_packed_view (top);
+
+		return view != NULL ? &view[idx] : NULL;
+	}
+
+	return idx < vec->n ? kv_A (*vec, idx) : NULL;
+}
+
+size_t
+ucl_array_view_index (const ucl_array_t *vec, const ucl_object_t *elt)
+{
+	if (vec->packed == NULL || vec->view == NULL || elt < vec->view ||
+			elt >= vec->view + vec->npacked) {
+		return (size_t)-1;
+	}
+
+	return elt - vec->view;
+}
+
+ucl_array_t *
+ucl_array_packed_copy (const ucl_array_t *vec)
+{
+	ucl_array_t *nvec;
+
+	nvec = UCL_ALLOC (sizeof (*nvec));
+
+	if (nvec == NULL) {
+		return NULL;
+	}
+
+	memset (nvec, 0, sizeof (*nvec));
+	nvec->packed = malloc (vec->npacked * sizeof (int64_t));
+
+	if (nvec->packed == NULL) {
+		UCL_FREE (sizeof (*nvec), nvec);
+
+		return NULL;
+	}
+
+	memcpy (nvec->packed, vec->packed, vec->npacked * sizeof (int64_t));
+	nvec->npacked = vec->npacked;
+	nvec->packed_type = vec->packed_type;
+
+	return nvec;
+}
+
+bool
+ucl_array_is_packed (const ucl_object_t *top)
+{
+	UCL_ARRAY_GET_RAW (vec, top);
+
+	return top != NULL && top->type == UCL_ARRAY && vec != NULL &&
+			vec->packed != NULL;
+}
+
+const int64_t *
+ucl_array_packed_int (const ucl_object_t *top, size_t *nelts)
+{
+	UCL_ARRAY_GET_RAW (vec, top);
+
+	if (!ucl_array_is_packed (top) || vec->packed_type != UCL_INT) {
+		return NULL;
+	}
+
+	if (nelts != NULL) {
+		*nelts = vec->npacked;
+	}
+
+	return vec->packed;
+}
+
+const double *
+ucl_array_packed_double (const ucl_object_t *top, size_t *nelts)
+{
+	UCL_ARRAY_GET_RAW (vec, top);
+
+	if (!ucl_array_is_packed (top) || vec->packed_type != UCL_FLOAT) {
+		return NULL;
+	}
+
+	if (nelts != NULL) {
+		*nelts = vec->npacked;
+	}
+
+	return vec->packed;
+}
+
+static void
+ucl_packed_int_stats (const int64_t *v, size_t n,
+		int64_t *psum, int64_t *pmin, int64_t *pmax)
+{
+	uint64_t sum = 0;
+	int64_t min = v[0], max = v[0];
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	if (n >= 4) {
+		__m256i vsum = _mm256_setzero_si256 (),
+				vmin = _mm256_set1_epi64x (min),
+				vmax = _mm256_set1_epi64x (max);
+		int64_t lanes[4];
+		unsigned j;
+
+		for (; i + 4 <= n; i += 4) {
+			__m256i x = _mm256_loadu_si256 ((const __m256i *)(v + i));
+
+			vsum = _mm256_add_epi64 (vsum, x);
+			vmin = _mm256_blendv_epi8 (vmin, x, _mm256_cmpgt_epi64 (vmin, x));
+			vmax = _mm256_blendv_epi8 (vmax, x, _mm256_cmpgt_epi64 (x, vmax));
+		}
+
+		_mm256_storeu_si256 ((__m256i *)lanes, vsum);
+		for (j = 0; j < 4; j ++) {
+			sum += (uint64_t)lanes[j];
+		}
+		_mm256_storeu_si256 ((__m256i *)lanes, vmin);
+		for (j = 0; j < 4; j ++) {
+			min = lanes[j] < min ? lanes[j] : min;
+		}
+		_mm256_storeu_si256 ((__m256i *)lanes, vmax);
+		for (j = 0; j < 4; j ++) {
+			max = lanes[j] > max ? lanes[j] : max;
+		}
+	}
+#elif defined(__SSE2__)
+	if (n >= 2) {
+		/* SSE2 has no 64 bit comparisons, so only the sum is vectorized */
+		__m128i vsum = _mm_setzero_si128 ();
+		int64_t lanes[2];
+
+		for (; i + 2 <= n; i += 2) {
+			vsum = _mm_add_epi64 (vsum,
+					_mm_loadu_si128 ((const __m128i *)(v + i)));
+			min = v[i] < min ? v[i] : min;
+			max = v[i] > max ? v[i] : max;
+			min = v[i + 1] < min ? v[i + 1] : min;
+			max = v[i + 1] > max ? v[i + 1] : max;
+		}
+
+		_mm_storeu_si128 ((__m128i *)lanes, vsum);
+		sum = (uint64_t)lanes[0] + (uint64_t)lanes[1];
+	}
+#endif
+
+	for (; i < n; i ++) {
+		sum += (uint64_t)v[i];
+		min = v[i] < min ? v[i] : min;
+		max = v[i] > max ? v[i] : max;
+	}
+
+	if (psum) {
+		*psum = (int64_t)sum;
+	}
+	if (pmin) {
+		*pmin = min;
+	}
+	if (pmax) {
+		*pmax = max;
+	}
+}
+
+static void
+ucl_packed_double_stats (const double *v, size_t n,
+		double *psum, double *pmin, double *pmax)
+{
+	double sum = 0, min = v[0], max = v[0];
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	if (n >= 4) {
+		__m256d vsum = _mm256_setzero_pd (),
+				vmin = _mm256_set1_pd (min),
+				vmax = _mm256_set1_pd (max);
+		double lanes[4];
+		unsigned j;
+
+		for (; i + 4 <= n; i += 4) {
+			__m256d x = _mm256_loadu_pd (v + i);
+
+			vsum = _mm256_add_pd (vsum, x);
+			vmin = _mm256_min_pd (vmin, x);
+			vmax = _mm256_max_pd (vmax, x);
+		}
+
+		_mm256_storeu_pd (lanes, vsum);
+		sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+		_mm256_storeu_pd (lanes, vmin);
+		for (j = 0; j < 4; j ++) {
+			min = lanes[j] < min ? lanes[j] : min;
+		}
+		_mm256_storeu_pd (lanes, vmax);
+		for (j = 0; j < 4; j ++) {
+			max = lanes[j] > max ? lanes[j] : max;
+		}
+	}
+#elif defined(__SSE2__)
+	if (n >= 2) {
+		__m128d vsum = _mm_setzero_pd (),
+				vmin = _mm_set1_pd (min),
+				vmax = _mm_set1_pd (max);
+		double lanes[2];
+
+		for (; i + 2 <= n; i += 2) {
+			__m128d x = _mm_loadu_pd (v + i);
+
+			vsum = _mm_add_pd (vsum, x);
+			vmin = _mm_min_pd (vmin, x);
+			vmax = _mm_max_pd (vmax, x);
+		}
+
+		_mm_storeu_pd (lanes, vsum);
+		sum = lanes[0] + lanes[1];
+		_mm_storeu_pd (lanes, vmin);
+		min = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+		_mm_storeu_pd (lanes, vmax);
+		max = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+	}
+#endif
+
+	for (; i < n; i ++) {
+		sum += v[i];
+		min = v[i] < min ? v[i] : min;
+		max = v[i] > max ? v[i] : max;
+	}
+
+	if (psum) {
+		*psum = sum;
+	}
+	if (pmin) {
+		*pmin = min;
+	}
+	if (pmax) {
+		*pmax = max;
+	}
+}
+
+bool
+ucl_array_int_stats (const ucl_object_t *top,
+		int64_t *sum, int64_t *min, int64_t *max)
+{
+	UCL_ARRAY_GET_RAW (vec, top);
+	const ucl_object_t *cur;
+	uint64_t lsum;
+	int64_t lmin, lmax;
+	size_t i;
+
+	if (top == NULL || top->type != UCL_ARRAY || vec == NULL) {
+		return false;
+	}
+
+	if (vec->packed != NULL) {
+		if (vec->packed_type != UCL_INT || vec->npacked == 0) {
+			return false;
+		}
+
+		ucl_packed_int_stats (vec->packed, vec->npacked, sum, min, max);
+
+		return true;
+	}
+
+	if (vec->n == 0) {
+		return false;
+	}
+
+	/* Elements are not contiguous, so just use plain loop */
+	lsum = 0;
+	lmin = lmax = 0;
+
+	for (i = 0; i < vec->n; i ++) {
+		cur = kv_A (*vec, i);
+
+		if (cur == NULL || cur->type != UCL_INT) {
+			return false;
+		}
+
+		if (i == 0) {
+			lmin = lmax = cur->value.iv;
+		}
+
+		lsum += (uint64_t)cur->value.iv;
+		lmin = cur->value.iv < lmin ? cur->value.iv : lmin;
+		lmax = cur->value.iv > lmax ? cur->value.iv : lmax;
+	}
+
+	if (sum) {
+		*sum = (int64_t)lsum;
+	}
+	if (min) {
+		*min = lmin;
+	}
+	if (max) {
+		*max = lmax;
+	}
+
+	return true;
+}
+
+bool
+ucl_array_double_stats (const ucl_object_t *top,
+		double *sum, double *min, double *max)
+{
+	UCL_ARRAY_GET_RAW (vec, top);
+	const ucl_object_t *cur;
+	double lsum, lmin, lmax;
+	size_t i;
+
+	if (top == NULL || top->type != UCL_ARRAY || vec == NULL) {
+		return false;
+	}
+
+	if (vec->packed != NULL) {
+		if (vec->packed_type != UCL_FLOAT || vec->npacked == 0) {
+			return false;
+		}
+
+		ucl_packed_double_stats (vec->packed, vec->npacked, sum, min, max);
+
+		return true;
+	}
+
+	if (vec->n == 0) {
+		return false;
+	}
+
+	/* Elements are not contiguous, so just use plain loop */
+	lsum = 0;
+	lmin = lmax = 0;
+
+	for (i = 0; i < vec->n; i ++) {
+		cur = kv_A (*vec, i);
+
+		if (cur == NULL || cur->type != UCL_FLOAT) {
+			return false;
+		}
+
+		if (i == 0) {
+			lmin = lmax = cur->value.dv;
+		}
+
+		lsum += cur->value.dv;
+		lmin = cur->value.dv < lmin ? cur->value.dv : lmin;
+		lmax = cur->value.dv > lmax ? cur->value.dv : lmax;
+	}
+
+	if (sum) {
+		*sum = lsum;
+	}
+	if (min) {
+		*min = lmin;
+	}
+	if (max) {
+		*max = lmax;
+	}
+
+	return true;
+}
@@ -25,14 +25,18 @@
 #include "ucl_internal.h"
 #include "ucl_chartable.h"
 
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /**
  * @file ucl_parser.c
  * The implementation of ucl parser
  */
 
 struct ucl_parser_saved_state {
-	unsigned int line;
-	unsigned int column;
 	size_t remain;
 	const unsigned char *pos;
 };
@@ -45,16 +49,94 @@ struct ucl_parser_saved_state {
  * @return new position in chunk
  */
 #define ucl_chunk_skipc(chunk, p)    do{					\
-    if (*(p) == '\n') {										\
-        (chunk)->line ++;									\
-        (chunk)->column = 0;								\
-    }														\
-    else (chunk)->column ++;								\
     (p++);													\
     (chunk)->pos ++;										\
     (chunk)->remain --;										\
     } while (0)
 
+/**
+ * Skip a run of whitespace characters, `p` must be equal to the chunk position
+ */
+#define ucl_chunk_skip_whitespace(chunk, p) do {			\
+    (p) = ucl_skip_whitespace ((p), (chunk)->end);			\
+    (chunk)->remain -= (p) - (chunk)->pos;					\
+    (chunk)->pos = (p);										\
+    } while (0)
+
+/**
+ * Find the end of a run of whitespace characters (including newlines)
+ * @param p start of the run
+ * @param end end of input
+ * @return the first non-space character or end
+ */
+static inline const unsigned char *
+ucl_skip_whitespace (const unsigned char *p, const unsigned char *end)
+{
+#if defined(__SSE2__)
+	const __m128i space = _mm_set1_epi8 (' '), tab = _mm_set1_epi8 ('\t'),
+			four = _mm_set1_epi8 (4);
+	__m128i v, t;
+	unsigned int mask;
+
+	/* Spaces are ' ' and the '\t'..'\r' range */
+	while (end - p >= 16) {
+		v = _mm_loadu_si128 ((const __m128i *)p);
+		t = _mm_sub_epi8 (v, tab);
+		mask = _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (v, space),
+				_mm_cmpeq_epi8 (_mm_min_epu8 (t, four), t)));
+
+		if (mask != 0xffff) {
+			return p + __builtin_ctz (~mask);
+		}
+
+		p += 16;
+	}
+#endif
+
+	while (p < end && ucl_test_character (*p, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
+		p ++;
+	}
+
+	return p;
+}
+
+/**
+ * Find the next character that is significant inside of a multiline
+ * comment: '*', '/' or '"'
+ * @param p start of the search
+ * @param end end of input
+ * @return pointer to the character found or end
+ */
+static inline const unsigned char *
+ucl_find_comment_char (const unsigned char *p, const unsigned char *end)
+{
+#if defined(__SSE2__)
+	const __m128i star = _mm_set1_epi8 ('*'), slash = _mm_set1_epi8 ('/'),
+			quote = _mm_set1_epi8 ('"');
+	__m128i v;
+	unsigned int mask;
+
+	while (end - p >= 16) {
+		v = _mm_loadu_si128 ((const __m128i *)p);
+		mask = _mm_movemask_epi8 (_mm_or_si128 (
+				_mm_or_si128 (_mm_cmpeq_epi8 (v, star), _mm_cmpeq_epi8 (v, slash)),
+				_mm_cmpeq_epi8 (v, quote)));
+
+		if (mask != 0) {
+			return p + __builtin_ctz (mask);
+		}
+
+		p += 16;
+	}
+#endif
+
+	while (p < end && *p != '*' && *p != '/' && *p != '"') {
+		p ++;
+	}
+
+	return p;
+}
+
 static inline void
 ucl_set_err (struct ucl_parser *parser, int code, const char *str, UT_string **err)
 {
@@ -68,6 +150,8 @@ ucl_set_err (struct ucl_parser *parser, int code, const char *str, UT_string **e
 		filename = "<unknown>";
 	}
 
+	ucl_chunk_position (chunk);
+
 	if (chunk->pos < chunk->end) {
 		if (isgraph (*chunk->pos)) {
 			fmt_string = "error while parsing %s: "
@@ -142,61 +226,68 @@ start:
 		if (parser->state != UCL_STATE_SCOMMENT &&
 				parser->state != UCL_STATE_MCOMMENT) {
 			beg = p;
+			p = memchr (p, '\n', chunk->end - p);
 
-			while (p < chunk->end) {
-				if (*p == '\n') {
-					if (parser->flags & UCL_PARSER_SAVE_COMMENTS) {
-						ucl_save_comment (parser, beg, p - beg);
-						beg = NULL;
-					}
+			if (p == NULL) {
+				p = chunk->end;
+			}
+			else {
+				if (parser->flags & UCL_PARSER_SAVE_COMMENTS) {
+					ucl_save_comment (parser, beg, p - beg);
+					beg = NULL;
+				}
 
-					ucl_chunk_skipc (chunk, p);
+				p ++;
+			}
 
-					goto start;
-				}
-				ucl_chunk_skipc (chunk, p);
+			chunk->remain -= p - chunk->pos;
+			chunk->pos = p;
+
+			if (p < chunk->end) {
+				goto start;
 			}
 		}
 	}
 	else if (chunk->remain >= 2 && *p == '/') {
 		if (p[1] == '*') {
 			beg = p;
-			ucl_chunk_skipc (chunk, p);
+			p += 2;
 			comments_nested ++;
-			ucl_chunk_skipc (chunk, p);
 
-			while (p < chunk->end) {
-				if (*p == '"' && *(p - 1) != '\\') {
-					quoted = !quoted;
+			while ((p = ucl_find_comment_char (p, chunk->end)) < chunk->end) {
+				if (*p == '"') {
+					if (p[-1] != '\\') {
+						quoted = !quoted;
+					}
 				}
+				else if (!quoted) {
+					if (*p == '*' && p + 1 < chunk->end && p[1] == '/') {
+						p ++;
 
-				if (!quoted) {
-					if (*p == '*') {
-						ucl_chunk_skipc (chunk, p);
-						if (*p == '/') {
-							comments_nested --;
-							if (comments_nested == 0) {
-								if (parser->flags & UCL_PARSER_SAVE_COMMENTS) {
-									ucl_save_comment (parser, beg, p - beg + 1);
-									beg = NULL;
-								}
-
-								ucl_chunk_skipc (chunk, p);
-								goto start;
+						if (-- comments_nested == 0) {
+							if (parser->flags & UCL_PARSER_SAVE_COMMENTS) {
+								ucl_save_comment (parser, beg, p - beg + 1);
+								beg = NULL;
 							}
+
+							p ++;
+							chunk->remain -= p - chunk->pos;
+							chunk->pos = p;
+							goto start;
 						}
-						ucl_chunk_skipc (chunk, p);
 					}
-					else if (p[0] == '/' && chunk->remain >= 2 && p[1] == '*') {
+					else if (*p == '/' && p + 1 < chunk->end && p[1] == '*') {
 						comments_nested ++;
-						ucl_chunk_skipc (chunk, p);
-						ucl_chunk_skipc (chunk, p);
-						continue;
+						p ++;
 					}
 				}
 
-				ucl_chunk_skipc (chunk, p);
+				p ++;
 			}
+
+			chunk->remain -= p - chunk->pos;
+			chunk->pos = p;
+
 			if (comments_nested != 0) {
 				ucl_set_err (parser, UCL_ENESTED,
 						"unfinished multiline comment", &parser->err);
@@ -298,192 +389,86 @@ ucl_lex_is_comment (const unsigned char c1, const unsigned char c2)
 }
 
 /**
- * Check variable found
+ * Find a variable by name
  * @param parser
- * @param ptr
- * @param remain
- * @param out_len
- * @param strict
- * @param found
- * @return
+ * @param name start of the name
+ * @param remain length of the name or of the rest of the string
+ * @param exact `remain` is the exact name length, otherwise any variable that
+ * is a prefix of the string matches, the earliest registered wins
+ * @return variable found or NULL
  */
-static inline const char *
-ucl_check_variable_safe (struct ucl_parser *parser, const char *ptr, size_t remain,
-		size_t *out_len, bool strict, bool *found)
-{
-	struct ucl_variable *var;
-	unsigned char *dst;
-	size_t dstlen;
-	bool need_free = false;
-
-	LL_FOREACH (parser->variables, var) {
-		if (strict) {
-			if (remain == var->var_len) {
-				if (memcmp (ptr, var->var, var->var_len) == 0) {
-					*out_len += var->value_len;
-					*found = true;
-					return (ptr + var->var_len);
-				}
-			}
-		}
-		else {
-			if (remain >= var->var_len) {
-				if (memcmp (ptr, var->var, var->var_len) == 0) {
-					*out_len += var->value_len;
-					*found = true;
-					return (ptr + var->var_len);
-				}
-			}
-		}
-	}
+static const struct ucl_variable *
+ucl_parser_find_variable (struct ucl_parser *parser, const char *name,
+		size_t remain, bool exact)
+{
+	struct ucl_variable *var, *found = NULL;
+	uint64_t lens;
+	size_t len;
 
-	/* XXX: can only handle ${VAR} */
-	if (!(*found) && parser->var_handler != NULL && strict) {
-		/* Call generic handler */
-		if (parser->var_handler (ptr, remain, &dst, &dstlen, &need_free,
-				parser->var_data)) {
-			*found = true;
-			if (need_free) {
-				free (dst);
-			}
-			return (ptr + remain);
-		}
+	if (exact) {
+		HASH_FIND (hh, parser->vars_hash, name, remain, found);
+
+		return found;
 	}
 
-	return ptr;
-}
+	/* Only lengths of registered variables are checked */
+	lens = parser->var_lens & ~(1ULL << 63);
 
-/**
- * Check for a variable in a given string
- * @param parser
- * @param ptr
- * @param remain
- * @param out_len
- * @param vars_found
- * @return
- */
-static const char *
-ucl_check_variable (struct ucl_parser *parser, const char *ptr,
-		size_t remain, size_t *out_len, bool *vars_found)
-{
-	const char *p, *end, *ret = ptr;
-	bool found = false;
-
-	if (*ptr == '{') {
-		/* We need to match the variable enclosed in braces */
-		p = ptr + 1;
-		end = ptr + remain;
-		while (p < end) {
-			if (*p == '}') {
-				ret = ucl_check_variable_safe (parser, ptr + 1, p - ptr - 1,
-						out_len, true, &found);
-				if (found) {
-					/* {} must be excluded actually */
-					ret ++;
-					if (!*vars_found) {
-						*vars_found = true;
-					}
-				}
-				else {
-					*out_len += 2;
-				}
-				break;
+	for (len = 1; lens != 0 && len <= remain; len ++, lens >>= 1) {
+		if (lens & 1) {
+			HASH_FIND (hh, parser->vars_hash, name, len, var);
+
+			if (var != NULL && (found == NULL || var->seq < found->seq)) {
+				found = var;
 			}
-			p ++;
 		}
 	}
-	else if (*ptr != '$') {
-		/* Not count escaped dollar sign */
-		ret = ucl_check_variable_safe (parser, ptr, remain, out_len, false, &found);
-		if (found && !*vars_found) {
-			*vars_found = true;
-		}
-		if (!found) {
-			(*out_len) ++;
+
+	if (parser->var_lens & (1ULL << 63)) {
+		/* Long names are rare, so they are not indexed by length */
+		LL_FOREACH (parser->variables, var) {
+			if (var->var_len >= 64 && var->var_len <= remain &&
+					(found == NULL || var->seq < found->seq) &&
+					memcmp (name, var->var, var->var_len) == 0) {
+				found = var;
+			}
 		}
 	}
-	else {
-		ret ++;
-		(*out_len) ++;
-	}
 
-	return ret;
+	return found;
 }
 
-/**
- * Expand a single variable
- * @param parser
- * @param ptr
- * @param remain
- * @param dest
- * @return
+/*
+ * Append data to the expansion buffer growing it as needed
  */
-static const char *
-ucl_expand_single_variable (struct ucl_parser *parser, const char *ptr,
-		size_t remain, unsigned char **dest)
-{
-	unsigned char *d = *dest, *dst;
-	const char *p = ptr + 1, *ret;
-	struct ucl_variable *var;
-	size_t dstlen;
-	bool need_free = false;
-	bool found = false;
-	bool strict = false;
-
-	ret = ptr + 1;
-	remain --;
-
-	if (*p == '$') {
-		*d++ = *p++;
-		*dest = d;
-		return p;
-	}
-	else if (*p == '{') {
-		p ++;
-		strict = true;
-		ret += 2;
-		remain -= 2;
-	}
-
-	LL_FOREACH (parser->variables, var) {
-		if (remain >= var->var_len) {
-			if (memcmp (p, var->var, var->var_len) == 0) {
-				memcpy (d, var->value, var->value_len);
-				ret += var->var_len;
-				d += var->value_len;
-				found = true;
-				break;
-			}
-		}
-	}
-	if (!found) {
-		if (strict && parser->var_handler != NULL) {
-			if (parser->var_handler (ptr, remain, &dst, &dstlen, &need_free,
-							parser->var_data)) {
-				memcpy (d, dst, dstlen);
-				ret += dstlen;
-				d += remain;
-				found = true;
-			}
+static bool
+ucl_expand_append (unsigned char **buf, size_t *len, size_t *size,
+		const void *data, size_t dlen)
+{
+	unsigned char *nbuf;
+	size_t nsize;
+
+	if (*buf == NULL || *len + dlen + 1 > *size) {
+		nsize = *buf == NULL ? *size : *size * 2;
+
+		if (nsize < *len + dlen + 1) {
+			nsize = *len + dlen + 1;
 		}
 
-		/* Leave variable as is */
-		if (!found) {
-			if (strict) {
-				/* Copy '${' */
-				memcpy (d, ptr, 2);
-				d += 2;
-				ret --;
-			}
-			else {
-				memcpy (d, ptr, 1);
-				d ++;
-			}
+		nbuf = realloc (*buf, nsize);
+
+		if (nbuf == NULL) {
+			return false;
 		}
+
+		*buf = nbuf;
+		*size = nsize;
 	}
 
-	*dest = d;
-	return ret;
+	memcpy (*buf + *len, data, dlen);
+	*len += dlen;
+
+	return true;
 }
 
 /**
@@ -498,50 +483,108 @@ static ssize_t
 ucl_expand_variable (struct ucl_parser *parser, unsigned char **dst,
 		const char *src, size_t in_len)
 {
-	const char *p, *end = src + in_len;
-	unsigned char *d;
-	size_t out_len = 0;
-	bool vars_found = false;
+	const char *p = src, *copied = src, *end = src + in_len, *dollar, *brace,
+			*next;
+	const struct ucl_variable *var;
+	const unsigned char *val;
+	unsigned char *out = NULL, *hdst;
+	size_t out_len = 0, out_size, val_len;
+	bool vars_found = false, need_free;
+
+	*dst = NULL;
 
 	if (parser->flags & UCL_PARSER_DISABLE_MACRO) {
-		*dst = NULL;
 		return in_len;
 	}
 
-	p = src;
-	while (p != end) {
-		if (*p == '$') {
-			p = ucl_check_variable (parser, p + 1, end - p - 1, &out_len, &vars_found);
+	out_size = in_len + 64;
+
+	while (p < end && (dollar = memchr (p, '$', end - p)) != NULL) {
+		next = dollar + 1;
+		val = NULL;
+		val_len = 0;
+		hdst = NULL;
+		need_free = false;
+
+		if (next < end && *next == '$') {
+			/* Escaped dollar sign, it is unescaped if anything is expanded */
+			val = (const unsigned char *)next;
+			val_len = 1;
+			next ++;
+		}
+		else if (next < end && *next == '{') {
+			brace = memchr (next + 1, '}', end - next - 1);
+
+			if (brace != NULL) {
+				var = ucl_parser_find_variable (parser, next + 1,
+						brace - next - 1, true);
+
+				if (var != NULL) {
+					val = (const unsigned char *)var->value;
+					val_len = var->value_len;
+				}
+				else if (parser->var_handler != NULL &&
+						parser->var_handler ((const unsigned char *)next + 1,
+						brace - next - 1, &hdst, &val_len, &need_free,
+						parser->var_data)) {
+					val = hdst;
+				}
+
+				if (val != NULL) {
+					vars_found = true;
+					next = brace + 1;
+				}
+			}
 		}
 		else {
-			p ++;
-			out_len ++;
+			var = ucl_parser_find_variable (parser, next, end - next, false);
+
+			if (var != NULL) {
+				val = (const unsigned char *)var->value;
+				val_len = var->value_len;
+				vars_found = true;
+				next += var->var_len;
+			}
 		}
+
+		if (val != NULL) {
+			if (!ucl_expand_append (&out, &out_len, &out_size, copied,
+					dollar - copied) ||
+					!ucl_expand_append (&out, &out_len, &out_size, val, val_len)) {
+				if (need_free) {
+					free (hdst);
+				}
+				free (out);
+
+				return in_len;
+			}
+
+			copied = next;
+		}
+
+		if (need_free) {
+			free (hdst);
+		}
+
+		/* Unknown variables are left as is */
+		p = next;
 	}
 
 	if (!vars_found) {
 		/* Trivial case */
-		*dst = NULL;
-		return in_len;
-	}
+		free (out);
 
-	*dst = UCL_ALLOC (out_len + 1);
-	if (*dst == NULL) {
 		return in_len;
 	}
 
-	d = *dst;
-	p = src;
-	while (p != end) {
-		if (*p == '$') {
-			p = ucl_expand_single_variable (parser, p, end - p, &d);
-		}
-		else {
-			*d++ = *p++;
-		}
+	if (!ucl_expand_append (&out, &out_len, &out_size, copied, end - copied)) {
+		free (out);
+
+		return in_len;
 	}
 
-	*d = '\0';
+	out[out_len] = '\0';
+	*dst = out;
 
 	return out_len;
 }
@@ -556,10 +599,11 @@ ucl_expand_variable (struct ucl_parser *parser, unsigned char **dst,
  * @param need_unescape need to unescape source (and copy it)
  * @param need_lowercase need to lowercase value (and copy)
  * @param need_expand need to expand variables (and copy as well)
+ * @param obj object that is marked as borrowing the input if no copy is made
  * @return output length (excluding \0 symbol)
  */
 static inline ssize_t
-ucl_copy_or_store_ptr (struct ucl_parser *parser,
+ucl_copy_or_store_ptr (struct ucl_parser *parser, ucl_object_t *obj,
 		const unsigned char *src, unsigned char **dst,
 		const char **dst_const, size_t in_len,
 		bool need_unescape, bool need_lowercase, bool need_expand)
@@ -605,12 +649,63 @@ ucl_copy_or_store_ptr (struct ucl_parser *parser,
 	}
 	else {
 		*dst_const = src;
+		obj->flags |= UCL_OBJECT_BORROWED;
 		ret = in_len;
 	}
 
 	return ret;
 }
 
+/**
+ * Store a string value as a slice of the input deferring unescaping till
+ * the first access if UCL_PARSER_LAZY_UNESCAPE is set
+ * @param parser
+ * @param obj string object
+ * @param src start of the string
+ * @param in_len length of the string
+ * @param need_unescape string contains escape sequences
+ * @param need_expand string may contain variables
+ * @return true if a string has been stored
+ */
+static inline bool
+ucl_parser_defer_string (struct ucl_parser *parser, ucl_object_t *obj,
+		const unsigned char *src, size_t in_len,
+		bool need_unescape, bool need_expand)
+{
+	if (!(parser->flags & UCL_PARSER_LAZY_UNESCAPE) ||
+			(need_expand && parser->variables != NULL)) {
+		return false;
+	}
+
+	obj->value.sv = (const char *)src;
+	obj->len = in_len;
+	obj->flags |= UCL_OBJECT_BORROWED;
+
+	if (need_unescape) {
+		obj->flags |= UCL_OBJECT_NEED_UNESCAPE;
+	}
+
+	return true;
+}
+
+/*
+ * Returns the selected keys for a container that is opened at the current
+ * position of the parser
+ */
+static inline const ucl_object_t *
+ucl_parser_child_projection (struct ucl_parser *parser)
+{
+	if (parser->stack == NULL) {
+		return parser->projection;
+	}
+	else if (parser->stack->obj->type == UCL_ARRAY) {
+		/* Paths are applied to each element of an array */
+		return parser->stack->proj;
+	}
+
+	return parser->proj_next;
+}
+
 /**
  * Create and append an object at the specified level
  * @param parser
@@ -623,6 +718,14 @@ ucl_parser_add_container (ucl_object_t *obj, struct ucl_parser *parser,
 		bool is_array, int level)
 {
 	struct ucl_stack *st;
+	const ucl_object_t *proj;
+	bool created = (obj == NULL);
+
+	if (parser->max_depth != 0 && parser->stack_depth >= parser->max_depth) {
+		ucl_set_err (parser, UCL_ENESTED, ucl_parser_stack_error (parser),
+				&parser->err);
+		return NULL;
+	}
 
 	if (!is_array) {
 		if (obj == NULL) {
@@ -646,18 +749,19 @@ ucl_parser_add_container (ucl_object_t *obj, struct ucl_parser *parser,
 		parser->state = UCL_STATE_VALUE;
 	}
 
-	st = UCL_ALLOC (sizeof (struct ucl_stack));
+	proj = ucl_parser_child_projection (parser);
+	st = ucl_parser_stack_push (parser, obj, level);
 
 	if (st == NULL) {
-		ucl_set_err (parser, UCL_EINTERNAL, "cannot allocate memory for an object",
+		ucl_set_err (parser, UCL_EINTERNAL, ucl_parser_stack_error (parser),
 				&parser->err);
-		ucl_object_unref (obj);
+		if (created) {
+			ucl_object_unref (obj);
+		}
 		return NULL;
 	}
 
-	st->obj = obj;
-	st->level = level;
-	LL_PREPEND (parser->stack, st);
+	st->proj = proj;
 	parser->cur_obj = obj;
 
 	return obj;
@@ -938,7 +1042,6 @@ ucl_lex_number (struct ucl_parser *parser,
 
 	if (ret == 0) {
 		chunk->remain -= pos - chunk->pos;
-		chunk->column += pos - chunk->pos;
 		chunk->pos = pos;
 		return true;
 	}
@@ -1082,6 +1185,11 @@ ucl_parser_process_object_element (struct ucl_parser *parser, ucl_object_t *nobj
 	else {
 		unsigned priold = ucl_object_get_priority (tobj),
 				prinew = ucl_object_get_priority (nobj);
+
+		if (parser->track_includes) {
+			ucl_include_track_dup (parser, parser->stack->obj, tobj);
+		}
+
 		switch (parser->chunks->strategy) {
 
 		case UCL_DUPLICATE_APPEND:
@@ -1126,6 +1234,7 @@ ucl_parser_process_object_element (struct ucl_parser *parser, ucl_object_t *nobj
 			break;
 
 		case UCL_DUPLICATE_ERROR:
+			ucl_chunk_position (parser->chunks);
 			ucl_create_err (&parser->err, "error while parsing %s: "
 					"line: %d, column: %d: duplicate element for key '%s' "
 					"has been found",
@@ -1139,6 +1248,7 @@ ucl_parser_process_object_element (struct ucl_parser *parser, ucl_object_t *nobj
 			 */
 			if (tobj->type == UCL_OBJECT || tobj->type == UCL_ARRAY) {
 				ucl_object_unref (nobj);
+				ucl_container_materialize (tobj);
 				nobj = tobj;
 			}
 			else {
@@ -1157,80 +1267,262 @@ ucl_parser_process_object_element (struct ucl_parser *parser, ucl_object_t *nobj
 }
 
 /**
- * Parse a key in an object
- * @param parser
- * @param chunk
- * @param next_key
- * @param end_of_object
- * @return true if a key has been parsed
+ * Find the end of a container without parsing it
+ * @param p opening bracket
+ * @param end end of input
+ * @param standalone the container is to be parsed separately from the
+ * current parser, so it must not depend on variables and macros
+ * @return position after the closing bracket or NULL if the end cannot be
+ * found reliably
  */
-static bool
-ucl_parse_key (struct ucl_parser *parser, struct ucl_chunk *chunk,
-		bool *next_key, bool *end_of_object)
+static const unsigned char *
+ucl_parser_container_end (const unsigned char *p, const unsigned char *end,
+		bool standalone)
 {
-	const unsigned char *p, *c = NULL, *end, *t;
-	const char *key = NULL;
-	bool got_quote = false, got_eq = false, got_semicolon = false,
-			need_unescape = false, ucl_escape = false, var_expand = false,
-			got_content = false, got_sep = false;
-	ucl_object_t *nobj;
-	ssize_t keylen;
-
-	p = chunk->pos;
+	unsigned int depth = 0;
+	int comments_nested;
+	bool token_start = true;
 
-	if (*p == '.') {
-		/* It is macro actually */
-		if (!(parser->flags & UCL_PARSER_DISABLE_MACRO)) {
-			ucl_chunk_skipc (chunk, p);
-		}
-
-		parser->prev_state = parser->state;
-		parser->state = UCL_STATE_MACRO_NAME;
-		*end_of_object = false;
-		return true;
-	}
-	while (p < chunk->end) {
-		/*
-		 * A key must start with alpha, number, '/' or '_' and end with space character
-		 */
-		if (c == NULL) {
-			if (chunk->remain >= 2 && ucl_lex_is_comment (p[0], p[1])) {
-				if (!ucl_skip_comments (parser)) {
-					return false;
-				}
-				p = chunk->pos;
+	while (p < end) {
+		switch (*p) {
+		case '{':
+		case '[':
+			if (!token_start) {
+				/* Part of an unquoted value, e.g. `a = x{y` */
+				return NULL;
 			}
-			else if (ucl_test_character (*p, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
-				ucl_chunk_skipc (chunk, p);
+			depth ++;
+			break;
+		case '}':
+		case ']':
+			if (--depth == 0) {
+				return p + 1;
 			}
-			else if (ucl_test_character (*p, UCL_CHARACTER_KEY_START)) {
-				/* The first symbol */
-				c = p;
-				ucl_chunk_skipc (chunk, p);
-				got_content = true;
+			token_start = false;
+			break;
+		case '"':
+			if (!token_start) {
+				/* Not a string but a part of an unquoted value */
+				return NULL;
 			}
-			else if (*p == '"') {
-				/* JSON style key */
-				c = p + 1;
-				got_quote = true;
-				got_content = true;
-				ucl_chunk_skipc (chunk, p);
+			p ++;
+			while (p < end && *p != '"') {
+				if (*p == '\\') {
+					p ++;
+				}
+				p ++;
 			}
-			else if (*p == '}') {
-				/* We have actually end of an object */
-				*end_of_object = true;
-				return true;
+			if (p >= end) {
+				return NULL;
 			}
-			else if (*p == '.') {
-				ucl_chunk_skipc (chunk, p);
-				parser->prev_state = parser->state;
-				parser->state = UCL_STATE_MACRO_NAME;
-				return true;
+			token_start = false;
+			break;
+		case '\'':
+			/*
+			 * Single quotes are not string delimiters for this parser but
+			 * readers may expect them to be, so do not guess where such
+			 * a container ends and parse it right away
+			 */
+			return NULL;
+		case '#':
+			while (p < end && *p != '\n') {
+				p ++;
 			}
-			else {
-				/* Invalid identifier */
-				ucl_set_err (parser, UCL_ESYNTAX, "key must begin with a letter",
-						&parser->err);
+			token_start = true;
+			break;
+		case '/':
+			if (end - p >= 2 && p[1] == '*') {
+				comments_nested = 1;
+				p += 2;
+
+				while (p < end && comments_nested > 0) {
+					if (end - p >= 2 && p[0] == '*' && p[1] == '/') {
+						comments_nested --;
+						p += 2;
+					}
+					else if (end - p >= 2 && p[0] == '/' && p[1] == '*') {
+						comments_nested ++;
+						p += 2;
+					}
+					else {
+						p ++;
+					}
+				}
+				if (comments_nested > 0) {
+					return NULL;
+				}
+				token_start = true;
+				continue;
+			}
+			token_start = false;
+			break;
+		case '$':
+			if (standalone) {
+				/* Variables are expanded using the parser's registry */
+				return NULL;
+			}
+			token_start = false;
+			break;
+		case '<':
+			if (end - p >= 2 && p[1] == '<') {
+				/* Heredocs may contain unbalanced brackets */
+				return NULL;
+			}
+			token_start = false;
+			break;
+		case '.':
+			if (token_start && standalone) {
+				/* Possibly a macro */
+				return NULL;
+			}
+			break;
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+		case ',':
+		case ';':
+		case '=':
+		case ':':
+			token_start = true;
+			break;
+		default:
+			token_start = false;
+			break;
+		}
+		p ++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Check whether a key of the current object is selected by the projection
+ * and remember the selection for its value
+ */
+static bool
+ucl_parser_select_key (struct ucl_parser *parser, const char *key,
+		size_t keylen)
+{
+	const ucl_object_t *found;
+
+	parser->proj_next = NULL;
+
+	if (parser->stack->proj == NULL) {
+		return true;
+	}
+
+	found = ucl_object_lookup_len (parser->stack->proj, key, keylen);
+
+	if (found == NULL) {
+		return false;
+	}
+	else if (found->type == UCL_OBJECT) {
+		parser->proj_next = found;
+	}
+
+	return true;
+}
+
+/*
+ * Mark the value of the current key to be skipped
+ */
+static void
+ucl_parser_skip_key (struct ucl_parser *parser, struct ucl_chunk *chunk,
+		bool nested)
+{
+	const unsigned char *p = chunk->pos;
+
+	if (nested) {
+		/* Nested keys belong to the skipped value */
+		while (p < chunk->end && *p != '{' && *p != '[') {
+			ucl_chunk_skipc (chunk, p);
+		}
+	}
+
+	if (parser->last_comment) {
+		ucl_object_unref (parser->last_comment);
+		parser->last_comment = NULL;
+	}
+
+	parser->skip_value = true;
+}
+
+/**
+ * Parse a key in an object
+ * @param parser
+ * @param chunk
+ * @param next_key
+ * @param end_of_object
+ * @return true if a key has been parsed
+ */
+static bool
+ucl_parse_key (struct ucl_parser *parser, struct ucl_chunk *chunk,
+		bool *next_key, bool *end_of_object)
+{
+	const unsigned char *p, *c = NULL, *end, *t;
+	const char *key = NULL;
+	bool got_quote = false, got_eq = false, got_semicolon = false,
+			need_unescape = false, ucl_escape = false, var_expand = false,
+			got_content = false, got_sep = false, raw_key;
+	ucl_object_t *nobj;
+	ssize_t keylen;
+
+	p = chunk->pos;
+
+	if (*p == '.') {
+		/* It is macro actually */
+		if (!(parser->flags & UCL_PARSER_DISABLE_MACRO)) {
+			ucl_chunk_skipc (chunk, p);
+		}
+
+		parser->prev_state = parser->state;
+		parser->state = UCL_STATE_MACRO_NAME;
+		*end_of_object = false;
+		return true;
+	}
+	while (p < chunk->end) {
+		/*
+		 * A key must start with alpha, number, '/' or '_' and end with space character
+		 */
+		if (c == NULL) {
+			if (chunk->remain >= 2 && ucl_lex_is_comment (p[0], p[1])) {
+				if (!ucl_skip_comments (parser)) {
+					return false;
+				}
+				p = chunk->pos;
+			}
+			else if (ucl_test_character (*p, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
+				ucl_chunk_skip_whitespace (chunk, p);
+			}
+			else if (ucl_test_character (*p, UCL_CHARACTER_KEY_START)) {
+				/* The first symbol */
+				c = p;
+				ucl_chunk_skipc (chunk, p);
+				got_content = true;
+			}
+			else if (*p == '"') {
+				/* JSON style key */
+				c = p + 1;
+				got_quote = true;
+				got_content = true;
+				ucl_chunk_skipc (chunk, p);
+			}
+			else if (*p == '}') {
+				/* We have actually end of an object */
+				*end_of_object = true;
+				return true;
+			}
+			else if (*p == '.') {
+				ucl_chunk_skipc (chunk, p);
+				parser->prev_state = parser->state;
+				parser->state = UCL_STATE_MACRO_NAME;
+				return true;
+			}
+			else {
+				/* Invalid identifier */
+				ucl_set_err (parser, UCL_ESYNTAX, "key must begin with a letter",
+						&parser->err);
 				return false;
 			}
 		}
@@ -1347,9 +1639,18 @@ ucl_parse_key (struct ucl_parser *parser, struct ucl_chunk *chunk,
 		}
 	}
 
+	/* Keys that need no transformation are checked before allocation */
+	raw_key = !need_unescape && !(parser->flags & UCL_PARSER_KEY_LOWERCASE);
+
+	if (raw_key && !ucl_parser_select_key (parser, (const char *)c, end - c)) {
+		ucl_parser_skip_key (parser, chunk, !got_sep && *next_key);
+		*next_key = false;
+		return true;
+	}
+
 	/* Create a new object */
 	nobj = ucl_object_new_full (UCL_NULL, parser->chunks->priority);
-	keylen = ucl_copy_or_store_ptr (parser, c, &nobj->trash_stack[UCL_TRASH_KEY],
+	keylen = ucl_copy_or_store_ptr (parser, nobj, c, &nobj->trash_stack[UCL_TRASH_KEY],
 			&key, end - c, need_unescape, parser->flags & UCL_PARSER_KEY_LOWERCASE, false);
 	if (keylen == -1) {
 		ucl_object_unref (nobj);
@@ -1364,6 +1665,13 @@ ucl_parse_key (struct ucl_parser *parser, struct ucl_chunk *chunk,
 	nobj->key = key;
 	nobj->keylen = keylen;
 
+	if (!raw_key && !ucl_parser_select_key (parser, key, keylen)) {
+		ucl_object_unref (nobj);
+		ucl_parser_skip_key (parser, chunk, !got_sep && *next_key);
+		*next_key = false;
+		return true;
+	}
+
 	if (!ucl_parser_process_object_element (parser, nobj)) {
 		return false;
 	}
@@ -1462,43 +1770,34 @@ ucl_parse_multiline_string (struct ucl_parser *parser,
 		bool *var_expand)
 {
 	const unsigned char *p, *c, *tend;
-	bool newline = false;
 	int len = 0;
 
 	p = chunk->pos;
-
 	c = p;
 
-	while (p < chunk->end) {
-		if (newline) {
-			if (chunk->end - p < term_len) {
-				return 0;
-			}
-			else if (memcmp (p, term, term_len) == 0) {
-				tend = p + term_len;
-				if (*tend != '\n' && *tend != ';' && *tend != ',') {
-					/* Incomplete terminator */
-					ucl_chunk_skipc (chunk, p);
-					continue;
-				}
+	/* The terminator must start a line, so jump between newlines */
+	while ((p = memchr (p, '\n', chunk->end - p)) != NULL) {
+		p ++;
+
+		if (chunk->end - p < term_len) {
+			return 0;
+		}
+		else if (memcmp (p, term, term_len) == 0) {
+			tend = p + term_len;
+
+			if (tend < chunk->end &&
+					(*tend == '\n' || *tend == ';' || *tend == ',')) {
 				len = p - c;
-				chunk->remain -= term_len;
-				chunk->pos = p + term_len;
-				chunk->column = term_len;
+				chunk->remain -= tend - chunk->pos;
+				chunk->pos = tend;
 				*beg = c;
+
+				if (memchr (c, '$', len) != NULL) {
+					*var_expand = true;
+				}
 				break;
 			}
 		}
-		if (*p == '\n') {
-			newline = true;
-		}
-		else {
-			if (*p == '$') {
-				*var_expand = true;
-			}
-			newline = false;
-		}
-		ucl_chunk_skipc (chunk, p);
 	}
 
 	return len;
@@ -1534,6 +1833,154 @@ ucl_parser_get_container (struct ucl_parser *parser)
 	return obj;
 }
 
+/**
+ * Skip a value that is not selected by the projection
+ * @param parser
+ * @param chunk
+ * @return true if the value has been skipped or prepared to be parsed and
+ * dropped
+ */
+static bool
+ucl_parser_skip_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
+{
+	const unsigned char *p = chunk->pos, *end;
+	bool need_unescape = false, ucl_escape = false, var_expand = false;
+	ucl_object_t *obj;
+
+	switch (*p) {
+	case '{':
+	case '[':
+		end = ucl_parser_container_end (p, chunk->end, false);
+
+		if (end != NULL) {
+			while (p < end) {
+				ucl_chunk_skipc (chunk, p);
+			}
+			/* No delimiter is required after a container */
+			while (p < chunk->end &&
+					(ucl_test_character (*p, UCL_CHARACTER_WHITESPACE_UNSAFE) ||
+					*p == ';' || *p == ',')) {
+				ucl_chunk_skipc (chunk, p);
+			}
+
+			parser->state = UCL_STATE_KEY;
+			return true;
+		}
+		break;
+	case '"':
+		ucl_chunk_skipc (chunk, p);
+
+		if (!ucl_lex_json_string (parser, chunk, &need_unescape, &ucl_escape,
+				&var_expand)) {
+			return false;
+		}
+
+		parser->state = UCL_STATE_AFTER_VALUE;
+		return true;
+	case '<':
+		if (chunk->end - p > 1 && p[1] == '<') {
+			/* Heredoc */
+			break;
+		}
+		/* FALLTHROUGH */
+	default:
+		if (!ucl_parse_string_value (parser, chunk, &var_expand,
+				&need_unescape)) {
+			return false;
+		}
+
+		parser->state = UCL_STATE_AFTER_VALUE;
+		return true;
+	}
+
+	/* Parse the value as usual but do not attach it anywhere */
+	obj = ucl_object_new_full (UCL_NULL, parser->chunks->priority);
+
+	if (obj == NULL) {
+		ucl_set_err (parser, UCL_EINTERNAL, "cannot allocate memory for an object",
+				&parser->err);
+		return false;
+	}
+
+	DL_APPEND (parser->trash_objs, obj);
+	parser->cur_obj = obj;
+
+	return true;
+}
+
+/**
+ * Store a container as an input range to be parsed on the first access
+ * @param parser
+ * @param chunk
+ * @param is_array
+ * @return true if the container has been deferred
+ */
+static bool
+ucl_parser_defer_container (struct ucl_parser *parser, struct ucl_chunk *chunk,
+		bool is_array)
+{
+	const unsigned char *p = chunk->pos, *end;
+	struct ucl_deferred_container *dc;
+	ucl_object_t *obj;
+
+	if (parser->lazy_depth == 0 || parser->stack == NULL ||
+			(parser->flags & UCL_PARSER_SAVE_COMMENTS) ||
+			ucl_parser_child_projection (parser) != NULL) {
+		return false;
+	}
+
+	if (parser->stack_depth < parser->lazy_depth ||
+			(parser->max_depth != 0 &&
+			parser->stack_depth >= parser->max_depth) ||
+			(parser->stack->obj->type == UCL_OBJECT &&
+			parser->cur_obj != NULL &&
+			(parser->cur_obj->type == UCL_OBJECT ||
+			parser->cur_obj->type == UCL_ARRAY))) {
+		/* Merging into an existing container must be done right now */
+		return false;
+	}
+
+	end = ucl_parser_container_end (p, chunk->end, true);
+
+	if (end == NULL) {
+		return false;
+	}
+
+	dc = UCL_ALLOC (sizeof (*dc));
+
+	if (dc == NULL) {
+		return false;
+	}
+
+	obj = ucl_parser_get_container (parser);
+
+	if (obj == NULL || ucl_parser_stack_push (parser, obj,
+			parser->stack->level) == NULL) {
+		UCL_FREE (sizeof (*dc), dc);
+		return false;
+	}
+
+	dc->begin = p;
+	dc->len = end - p;
+	dc->flags = parser->flags;
+	dc->priority = parser->chunks->priority;
+	dc->strategy = parser->chunks->strategy;
+
+	obj->type = is_array ? UCL_ARRAY : UCL_OBJECT;
+	obj->flags |= UCL_OBJECT_DEFERRED;
+	obj->trash_stack[UCL_TRASH_VALUE] = (char *)dc;
+
+	/* The closing bracket is left to pop the container as usual */
+	while (p < end - 1) {
+		ucl_chunk_skipc (chunk, p);
+	}
+
+	parser->cur_obj = obj;
+	parser->state = UCL_STATE_AFTER_VALUE;
+
+	return true;
+}
+
 /**
  * Handle value data
  * @param parser
@@ -1554,15 +2001,24 @@ ucl_parse_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 	/* Skip any spaces and comments */
 	if (ucl_test_character (*p, UCL_CHARACTER_WHITESPACE_UNSAFE) ||
 			(chunk->remain >= 2 && ucl_lex_is_comment (p[0], p[1]))) {
-		while (p < chunk->end && ucl_test_character (*p, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
-			ucl_chunk_skipc (chunk, p);
-		}
+		ucl_chunk_skip_whitespace (chunk, p);
 		if (!ucl_skip_comments (parser)) {
 			return false;
 		}
 		p = chunk->pos;
 	}
 
+	if (parser->skip_value) {
+		parser->skip_value = false;
+
+		if (!ucl_parser_skip_value (parser, chunk)) {
+			return false;
+		}
+		if (parser->state != UCL_STATE_VALUE) {
+			return true;
+		}
+	}
+
 	while (p < chunk->end) {
 		c = p;
 		switch (*p) {
@@ -1581,13 +2037,16 @@ ucl_parse_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 
 			str_len = chunk->pos - c - 2;
 			obj->type = UCL_STRING;
-			if ((str_len = ucl_copy_or_store_ptr (parser, c + 1,
-					&obj->trash_stack[UCL_TRASH_VALUE],
-					&obj->value.sv, str_len, need_unescape, false,
-					var_expand)) == -1) {
-				return false;
+			if (!ucl_parser_defer_string (parser, obj, c + 1, str_len,
+					need_unescape, var_expand)) {
+				if ((str_len = ucl_copy_or_store_ptr (parser, obj, c + 1,
+						&obj->trash_stack[UCL_TRASH_VALUE],
+						&obj->value.sv, str_len, need_unescape, false,
+						var_expand)) == -1) {
+					return false;
+				}
+				obj->len = str_len;
 			}
-			obj->len = str_len;
 
 			parser->state = UCL_STATE_AFTER_VALUE;
 			p = chunk->pos;
@@ -1595,6 +2054,9 @@ ucl_parse_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 			return true;
 			break;
 		case '{':
+			if (ucl_parser_defer_container (parser, chunk, false)) {
+				return true;
+			}
 			obj = ucl_parser_get_container (parser);
 			/* We have a new object */
 			obj = ucl_parser_add_container (obj, parser, false, parser->stack->level);
@@ -1607,6 +2069,9 @@ ucl_parse_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 			return true;
 			break;
 		case '[':
+			if (ucl_parser_defer_container (parser, chunk, true)) {
+				return true;
+			}
 			obj = ucl_parser_get_container (parser);
 			/* We have a new array */
 			obj = ucl_parser_add_container (obj, parser, true, parser->stack->level);
@@ -1643,8 +2108,6 @@ ucl_parse_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 						c += 2;
 						chunk->remain -= p - c;
 						chunk->pos = p + 1;
-						chunk->column = 0;
-						chunk->line ++;
 						if ((str_len = ucl_parse_multiline_string (parser, chunk, c,
 								p - c, &c, &var_expand)) == 0) {
 							ucl_set_err (parser, UCL_ESYNTAX,
@@ -1654,7 +2117,7 @@ ucl_parse_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 
 						obj->type = UCL_STRING;
 						obj->flags |= UCL_OBJECT_MULTILINE;
-						if ((str_len = ucl_copy_or_store_ptr (parser, c,
+						if ((str_len = ucl_copy_or_store_ptr (parser, obj, c,
 								&obj->trash_stack[UCL_TRASH_VALUE],
 								&obj->value.sv, str_len - 1, false,
 								false, var_expand)) == -1) {
@@ -1711,13 +2174,16 @@ parse_string:
 			}
 			else if (!ucl_maybe_parse_boolean (obj, c, str_len)) {
 				obj->type = UCL_STRING;
-				if ((str_len = ucl_copy_or_store_ptr (parser, c,
-						&obj->trash_stack[UCL_TRASH_VALUE],
-						&obj->value.sv, str_len, need_unescape,
-						false, var_expand)) == -1) {
-					return false;
+				if (!ucl_parser_defer_string (parser, obj, c, str_len,
+						need_unescape, var_expand)) {
+					if ((str_len = ucl_copy_or_store_ptr (parser, obj, c,
+							&obj->trash_stack[UCL_TRASH_VALUE],
+							&obj->value.sv, str_len, need_unescape,
+							false, var_expand)) == -1) {
+						return false;
+					}
+					obj->len = str_len;
 				}
-				obj->len = str_len;
 			}
 			parser->state = UCL_STATE_AFTER_VALUE;
 			p = chunk->pos;
@@ -1730,6 +2196,19 @@ parse_string:
 	return true;
 }
 
+bool
+ucl_parser_maybe_pack (struct ucl_parser *parser, ucl_object_t *obj)
+{
+	/* Saved comments refer to elements, so they must be kept */
+	if ((parser->flags & UCL_PARSER_PACK_ARRAYS) &&
+			!(parser->flags & UCL_PARSER_SAVE_COMMENTS) &&
+			obj->type == UCL_ARRAY && obj->len >= UCL_ARRAY_PACK_MIN) {
+		return ucl_array_pack (obj);
+	}
+
+	return false;
+}
+
 /**
  * Handle after value data
  * @param parser
@@ -1772,13 +2251,17 @@ ucl_parse_after_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 
 					/* Pop all nested objects from a stack */
 					st = parser->stack;
-					parser->stack = st->next;
-					UCL_FREE (sizeof (struct ucl_stack), st);
+					ucl_parser_stack_pop (parser);
 
 					if (parser->cur_obj) {
 						ucl_attach_comment (parser, parser->cur_obj, true);
 					}
 
+					if (*p == ']' && ucl_parser_maybe_pack (parser, st->obj)) {
+						/* The last element has been freed */
+						parser->cur_obj = st->obj;
+					}
+
 					while (parser->stack != NULL) {
 						st = parser->stack;
 
@@ -1786,9 +2269,8 @@ ucl_parse_after_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 							break;
 						}
 
-						parser->stack = st->next;
 						parser->cur_obj = st->obj;
-						UCL_FREE (sizeof (struct ucl_stack), st);
+						ucl_parser_stack_pop (parser);
 					}
 				}
 				else {
@@ -1799,6 +2281,13 @@ ucl_parse_after_value (struct ucl_parser *parser, struct ucl_chunk *chunk)
 				}
 
 				if (parser->stack == NULL) {
+					if (parser->deferred && p + 1 < chunk->end) {
+						/* The scanner has found a different end */
+						ucl_set_err (parser, UCL_ESYNTAX,
+								"deferred container ends before its bounds",
+								&parser->err);
+						return false;
+					}
 					/* Ignore everything after a top object */
 					return true;
 				}
@@ -2010,6 +2499,278 @@ ucl_parse_macro_value (struct ucl_parser *parser,
 	return true;
 }
 
+/**
+ * Parse a single atom of macro arguments list
+ * @param parser parser structure
+ * @param p start of the atom
+ * @param end end of the atom (trailing spaces are already stripped)
+ * @return new object or NULL if an atom needs the full parser
+ */
+static ucl_object_t *
+ucl_macro_args_atom (struct ucl_parser *parser, const unsigned char *p,
+		const unsigned char *end)
+{
+	ucl_object_t *obj;
+	const char *pos;
+	size_t len = end - p;
+
+	obj = ucl_object_typed_new (UCL_STRING);
+
+	if (ucl_test_character (*p, UCL_CHARACTER_VALUE_DIGIT_START)) {
+		if (ucl_maybe_parse_number (obj, p, end, &pos, true, false,
+				(parser->flags & UCL_PARSER_NO_TIME) == 0) == 0) {
+			if ((const unsigned char *)pos == end) {
+				return obj;
+			}
+			/* Garbage after number, let the full parser report it */
+			ucl_object_unref (obj);
+
+			return NULL;
+		}
+		obj->type = UCL_STRING;
+	}
+
+	if (len == 4 && memcmp (p, "null", 4) == 0) {
+		obj->type = UCL_NULL;
+	}
+	else if (!ucl_maybe_parse_boolean (obj, p, len)) {
+		obj->type = UCL_STRING;
+		obj->trash_stack[UCL_TRASH_VALUE] = malloc (len + 1);
+
+		if (obj->trash_stack[UCL_TRASH_VALUE] == NULL) {
+			ucl_object_unref (obj);
+			return NULL;
+		}
+
+		memcpy (obj->trash_stack[UCL_TRASH_VALUE], p, len);
+		obj->trash_stack[UCL_TRASH_VALUE][len] = '\0';
+		obj->value.sv = obj->trash_stack[UCL_TRASH_VALUE];
+		obj->len = len;
+	}
+
+	return obj;
+}
+
+/**
+ * Parse a flat list of `key = value` macro arguments without creating a
+ * separate parser. Anything beyond plain keys, quoted strings and atoms
+ * (nested objects, comments, heredocs, duplicate keys and so on) makes this
+ * function give up, so the caller can fall back to the full parser.
+ * @param parser parser structure
+ * @param p arguments text
+ * @param len length of text
+ * @return new object or NULL
+ */
+static ucl_object_t *
+ucl_macro_args_lex (struct ucl_parser *parser, const unsigned char *p,
+		size_t len)
+{
+	const unsigned char *end = p + len, *key, *c, *last;
+	ucl_object_t *res, *obj;
+	size_t keylen;
+	char *dst;
+	bool escaped;
+
+	if (parser->flags & UCL_PARSER_KEY_LOWERCASE) {
+		return NULL;
+	}
+
+	res = ucl_object_typed_new (UCL_OBJECT);
+
+	for (;;) {
+		while (p < end && ucl_test_character (*p,
+				UCL_CHARACTER_WHITESPACE_UNSAFE)) {
+			p ++;
+		}
+		if (p == end) {
+			break;
+		}
+
+		/* Key */
+		if (!ucl_test_character (*p, UCL_CHARACTER_KEY_START)) {
+			goto fallback;
+		}
+		key = p;
+		while (p < end && ucl_test_character (*p, UCL_CHARACTER_KEY)) {
+			p ++;
+		}
+		keylen = p - key;
+
+		while (p < end && ucl_test_character (*p, UCL_CHARACTER_WHITESPACE)) {
+			p ++;
+		}
+		if (p == end || (*p != '=' && *p != ':')) {
+			goto fallback;
+		}
+		p ++;
+		while (p < end && ucl_test_character (*p, UCL_CHARACTER_WHITESPACE)) {
+			p ++;
+		}
+		if (p == end ||
+				ucl_object_lookup_len (res, (const char *)key, keylen) != NULL) {
+			goto fallback;
+		}
+
+		/* Value */
+		if (*p == '"') {
+			c = ++p;
+			escaped = false;
+
+			while (p < end && *p != '"') {
+				if (*p < 0x20) {
+					goto fallback;
+				}
+				if (*p == '\\') {
+					escaped = true;
+					if (++p == end) {
+						goto fallback;
+					}
+				}
+				p ++;
+			}
+			if (p == end) {
+				goto fallback;
+			}
+
+			obj = ucl_object_typed_new (UCL_STRING);
+			dst = malloc (p - c + 1);
+
+			if (dst == NULL) {
+				ucl_object_unref (obj);
+				goto fallback;
+			}
+
+			memcpy (dst, c, p - c);
+			dst[p - c] = '\0';
+			obj->trash_stack[UCL_TRASH_VALUE] = dst;
+			obj->value.sv = dst;
+			obj->len = escaped ? ucl_unescape_json_string (dst, p - c) : p - c;
+			p ++;
+		}
+		else {
+			c = p;
+			last = p;
+
+			while (p < end && *p != ',' && *p != ';' && *p != '\n' &&
+					*p != '\r') {
+				switch (*p) {
+				case '{': case '}': case '[': case ']': case '(': case ')':
+				case '"': case '\'': case '#': case '$': case '\\': case '<':
+					goto fallback;
+				case '/':
+					if (p + 1 < end && (p[1] == '*' || p[1] == '/')) {
+						goto fallback;
+					}
+					break;
+				}
+				if (!ucl_test_character (*p, UCL_CHARACTER_WHITESPACE)) {
+					last = p + 1;
+				}
+				p ++;
+			}
+
+			obj = ucl_macro_args_atom (parser, c, last);
+
+			if (obj == NULL) {
+				goto fallback;
+			}
+		}
+
+		ucl_object_insert_key (res, obj, (const char *)key, keylen, true);
+
+		while (p < end && ucl_test_character (*p, UCL_CHARACTER_WHITESPACE)) {
+			p ++;
+		}
+		if (p < end) {
+			if (*p == ',' || *p == ';') {
+				p ++;
+			}
+			else if (*p != '\n' && *p != '\r') {
+				goto fallback;
+			}
+		}
+	}
+
+	if (res->len > 0) {
+		return res;
+	}
+
+fallback:
+	ucl_object_unref (res);
+
+	return NULL;
+}
+
+/**
+ * Return parsed macro arguments, reusing the object parsed for an identical
+ * arguments string earlier
+ * @param parser parser structure
+ * @param text arguments text
+ * @param len length of text
+ * @return new reference to an arguments object or NULL on error
+ */
+static ucl_object_t *
+ucl_macro_args_get (struct ucl_parser *parser, const unsigned char *text,
+		size_t len)
+{
+	struct ucl_macro_args *cached;
+	struct ucl_parser *params_parser;
+	ucl_object_t *res;
+
+	HASH_FIND (hh, parser->macro_args, text, len, cached);
+
+	if (cached != NULL) {
+		return ucl_object_ref (cached->args);
+	}
+
+	res = ucl_macro_args_lex (parser, text, len);
+
+	if (res == NULL) {
+		/*
+		 * Arguments are copied, so they can outlive the current chunk when
+		 * cached
+		 */
+		params_parser = ucl_parser_new (parser->flags &
+				~(UCL_PARSER_ZEROCOPY|UCL_PARSER_LAZY_UNESCAPE));
+
+		if (!ucl_parser_add_chunk (params_parser, text, len)) {
+			ucl_set_err (parser, UCL_ESYNTAX, "macro arguments parsing error",
+					&parser->err);
+		}
+		else {
+			res = ucl_parser_get_object (params_parser);
+		}
+
+		ucl_parser_free (params_parser);
+
+		if (res == NULL) {
+			return NULL;
+		}
+	}
+
+	if (parser->macro_args_count < UCL_MACRO_ARGS_CACHE_MAX) {
+		cached = UCL_ALLOC (sizeof (*cached));
+
+		if (cached != NULL) {
+			cached->text = malloc (len);
+
+			if (cached->text == NULL) {
+				UCL_FREE (sizeof (*cached), cached);
+			}
+			else {
+				memcpy (cached->text, text, len);
+				cached->len = len;
+				cached->args = ucl_object_ref (res);
+				HASH_ADD_KEYPTR (hh, parser->macro_args, cached->text, len,
+						cached);
+				parser->macro_args_count ++;
+			}
+		}
+	}
+
+	return res;
+}
+
 /**
  * Parse macro arguments as UCL object
  * @param parser parser structure
@@ -2020,15 +2781,11 @@ static ucl_object_t *
 ucl_parse_macro_arguments (struct ucl_parser *parser,
 		struct ucl_chunk *chunk)
 {
-	ucl_object_t *res = NULL;
-	struct ucl_parser *params_parser;
 	int obraces = 1, ebraces = 0, state = 0;
 	const unsigned char *p, *c;
 	size_t args_len = 0;
 	struct ucl_parser_saved_state saved;
 
-	saved.column = chunk->column;
-	saved.line = chunk->line;
 	saved.pos = chunk->pos;
 	saved.remain = chunk->remain;
 	p = chunk->pos;
@@ -2083,48 +2840,89 @@ ucl_parse_macro_arguments (struct ucl_parser *parser,
 			 * We have read the full body of arguments, so we need to parse and set
 			 * object from that
 			 */
-			params_parser = ucl_parser_new (parser->flags);
-			if (!ucl_parser_add_chunk (params_parser, c, args_len)) {
-				ucl_set_err (parser, UCL_ESYNTAX, "macro arguments parsing error",
-						&parser->err);
-			}
-			else {
-				res = ucl_parser_get_object (params_parser);
-			}
-			ucl_parser_free (params_parser);
+			return ucl_macro_args_get (parser, c, args_len);
 
-			return res;
+			break;
+		}
+	}
+
+	return NULL;
+
+restore_chunk:
+	chunk->pos = saved.pos;
+	chunk->remain = saved.remain;
+
+	return NULL;
+}
+
+#define SKIP_SPACES_COMMENTS(parser, chunk, p) do {								\
+	ucl_chunk_skip_whitespace (chunk, p);										\
+	if ((chunk)->remain >= 2 && ucl_lex_is_comment ((p)[0], (p)[1])) {			\
+		if (!ucl_skip_comments (parser)) {										\
+			return false;														\
+		}																		\
+		p = (chunk)->pos;														\
+	}																			\
+} while(0)
+
+static double
+ucl_monotonic_time (void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0) {
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+#endif
+
+	return (double)time (NULL);
+}
+
+/**
+ * Set limits of a slice when parsing of the top chunk starts or resumes
+ */
+static void
+ucl_parser_slice_start (struct ucl_parser *parser, struct ucl_chunk *chunk)
+{
+	parser->slice_end = chunk->end;
+	if (parser->slice_bytes > 0 &&
+			parser->slice_bytes < (size_t)(chunk->end - chunk->pos)) {
+		parser->slice_end = chunk->pos + parser->slice_bytes;
+	}
+
+	parser->slice_checked = chunk->pos;
+	parser->slice_deadline = parser->slice_time > 0 ?
+			ucl_monotonic_time () + parser->slice_time : 0;
+}
+
+/**
+ * Check whether parsing of the top chunk should be suspended, this is possible
+ * only between keys and values as the other states keep data in locals
+ */
+static inline bool
+ucl_parser_slice_done (struct ucl_parser *parser, struct ucl_chunk *chunk)
+{
+	if (parser->parse_depth != 1 || (parser->state != UCL_STATE_KEY &&
+			parser->state != UCL_STATE_VALUE &&
+			parser->state != UCL_STATE_AFTER_VALUE)) {
+		return false;
+	}
 
-			break;
-		}
+	if (chunk->pos >= parser->slice_end) {
+		return true;
 	}
 
-	return res;
+	if (parser->slice_deadline > 0 &&
+			chunk->pos - parser->slice_checked >= UCL_SLICE_TIME_STEP) {
+		parser->slice_checked = chunk->pos;
 
-restore_chunk:
-	chunk->column = saved.column;
-	chunk->line = saved.line;
-	chunk->pos = saved.pos;
-	chunk->remain = saved.remain;
+		return ucl_monotonic_time () >= parser->slice_deadline;
+	}
 
-	return NULL;
+	return false;
 }
 
-#define SKIP_SPACES_COMMENTS(parser, chunk, p) do {								\
-	while ((p) < (chunk)->end) {												\
-		if (!ucl_test_character (*(p), UCL_CHARACTER_WHITESPACE_UNSAFE)) {		\
-			if ((chunk)->remain >= 2 && ucl_lex_is_comment ((p)[0], (p)[1])) {	\
-				if (!ucl_skip_comments (parser)) {								\
-					return false;												\
-				}																\
-				p = (chunk)->pos;												\
-			}																	\
-			break;																\
-		}																		\
-		ucl_chunk_skipc (chunk, p);												\
-	}																			\
-} while(0)
-
 /**
  * Handle the main states of rcl parser
  * @param parser parser structure
@@ -2144,9 +2942,17 @@ ucl_state_machine (struct ucl_parser *parser)
 	if (parser->top_obj == NULL) {
 		parser->state = UCL_STATE_INIT;
 	}
+	if (parser->sliced && parser->parse_depth == 1) {
+		ucl_parser_slice_start (parser, chunk);
+	}
 
 	p = chunk->pos;
 	while (chunk->pos < chunk->end) {
+		if (parser->sliced && ucl_parser_slice_done (parser, chunk)) {
+			parser->suspended = true;
+			return true;
+		}
+
 		switch (parser->state) {
 		case UCL_STATE_INIT:
 			/*
@@ -2161,12 +2967,8 @@ ucl_state_machine (struct ucl_parser *parser)
 			}
 			else {
 				/* Skip any spaces */
-				while (p < chunk->end && ucl_test_character (*p,
-						UCL_CHARACTER_WHITESPACE_UNSAFE)) {
-					ucl_chunk_skipc (chunk, p);
-				}
-
 				p = chunk->pos;
+				ucl_chunk_skip_whitespace (chunk, p);
 
 				if (*p == '[') {
 					parser->state = UCL_STATE_VALUE;
@@ -2199,9 +3001,7 @@ ucl_state_machine (struct ucl_parser *parser)
 			break;
 		case UCL_STATE_KEY:
 			/* Skip any spaces */
-			while (p < chunk->end && ucl_test_character (*p, UCL_CHARACTER_WHITESPACE_UNSAFE)) {
-				ucl_chunk_skipc (chunk, p);
-			}
+			ucl_chunk_skip_whitespace (chunk, p);
 			if (p == chunk->end || *p == '}') {
 				/* We have the end of an object */
 				parser->state = UCL_STATE_AFTER_VALUE;
@@ -2280,6 +3080,7 @@ ucl_state_machine (struct ucl_parser *parser)
 			if (parser->flags & UCL_PARSER_DISABLE_MACRO) {
 				if (!ucl_skip_macro_as_comment (parser, chunk)) {
 					/* We have invalid macro */
+					ucl_chunk_position (chunk);
 					ucl_create_err (&parser->err,
 							"error on line %d at column %d: invalid macro",
 							chunk->line,
@@ -2303,6 +3104,7 @@ ucl_state_machine (struct ucl_parser *parser)
 						macro_len = (size_t) (p - c);
 						HASH_FIND (hh, parser->macroes, c, macro_len, macro);
 						if (macro == NULL) {
+							ucl_chunk_position (chunk);
 							ucl_create_err (&parser->err,
 									"error on line %d at column %d: "
 									"unknown macro: '%.*s', character: '%c'",
@@ -2320,6 +3122,7 @@ ucl_state_machine (struct ucl_parser *parser)
 					}
 					else {
 						/* We have invalid macro name */
+						ucl_chunk_position (chunk);
 						ucl_create_err (&parser->err,
 								"error on line %d at column %d: invalid macro name",
 								chunk->line,
@@ -2416,6 +3219,71 @@ ucl_state_machine (struct ucl_parser *parser)
 	return true;
 }
 
+/* Macros registered by ucl_parser_new */
+static const struct {
+	const char *name;
+	ucl_macro_handler handler;
+	ucl_context_macro_handler context_handler;
+} ucl_default_macros[] = {
+	{"include", ucl_include_handler, NULL},
+	{"try_include", ucl_try_include_handler, NULL},
+	{"includes", ucl_includes_handler, NULL},
+	{"priority", ucl_priority_handler, NULL},
+	{"load", ucl_load_handler, NULL},
+	{"inherit", NULL, ucl_inherit_handler}
+};
+
+static void
+ucl_parser_register_default_macros (struct ucl_parser *parser)
+{
+	struct ucl_macro *macro;
+	unsigned int i;
+
+	for (i = 0; i < sizeof (ucl_default_macros) / sizeof (ucl_default_macros[0]);
+			i ++) {
+		HASH_FIND_STR (parser->macroes, ucl_default_macros[i].name, macro);
+
+		if (macro != NULL) {
+			continue;
+		}
+
+		if (ucl_default_macros[i].handler != NULL) {
+			ucl_parser_register_macro (parser, ucl_default_macros[i].name,
+					ucl_default_macros[i].handler, parser);
+		}
+		else {
+			ucl_parser_register_context_macro (parser,
+					ucl_default_macros[i].name,
+					ucl_default_macros[i].context_handler, parser);
+		}
+	}
+}
+
+static bool
+ucl_parser_macro_is_default (struct ucl_parser *parser,
+		const struct ucl_macro *macro)
+{
+	unsigned int i;
+
+	if (macro->ud != parser) {
+		return false;
+	}
+
+	for (i = 0; i < sizeof (ucl_default_macros) / sizeof (ucl_default_macros[0]);
+			i ++) {
+		if (strcmp (macro->name, ucl_default_macros[i].name) == 0) {
+			if (macro->is_context) {
+				return macro->h.context_handler ==
+						ucl_default_macros[i].context_handler;
+			}
+
+			return macro->h.handler == ucl_default_macros[i].handler;
+		}
+	}
+
+	return false;
+}
+
 struct ucl_parser*
 ucl_parser_new (int flags)
 {
@@ -2428,15 +3296,12 @@ ucl_parser_new (int flags)
 
 	memset (parser, 0, sizeof (struct ucl_parser));
 
-	ucl_parser_register_macro (parser, "include", ucl_include_handler, parser);
-	ucl_parser_register_macro (parser, "try_include", ucl_try_include_handler, parser);
-	ucl_parser_register_macro (parser, "includes", ucl_includes_handler, parser);
-	ucl_parser_register_macro (parser, "priority", ucl_priority_handler, parser);
-	ucl_parser_register_macro (parser, "load", ucl_load_handler, parser);
-	ucl_parser_register_context_macro (parser, "inherit", ucl_inherit_handler, parser);
+	ucl_parser_register_default_macros (parser);
 
 	parser->flags = flags;
 	parser->includepaths = NULL;
+	parser->max_recursion = UCL_MAX_RECURSION;
+	parser->max_decompressed = UCL_MAX_DECOMPRESSED_SIZE;
 
 	if (flags & UCL_PARSER_SAVE_COMMENTS) {
 		parser->comments = ucl_object_typed_new (UCL_OBJECT);
@@ -2448,6 +3313,83 @@ ucl_parser_new (int flags)
 	return parser;
 }
 
+void
+ucl_parser_reset_config (struct ucl_parser *parser)
+{
+	struct ucl_macro *macro, *mtmp;
+	struct ucl_pubkey *key, *ktmp;
+	struct ucl_variable *var, *vtmp;
+	struct ucl_macro_args *margs, *matmp;
+	struct ucl_sig_cache *sc, *sctmp;
+
+	HASH_ITER (hh, parser->macroes, macro, mtmp) {
+		if (!ucl_parser_macro_is_default (parser, macro)) {
+			HASH_DEL (parser->macroes, macro);
+			free (macro->name);
+			UCL_FREE (sizeof (struct ucl_macro), macro);
+		}
+	}
+	/* Defaults overridden by the user have just been removed */
+	ucl_parser_register_default_macros (parser);
+
+	LL_FOREACH_SAFE (parser->variables, var, vtmp) {
+		if (strcmp (var->var, "FILENAME") != 0 &&
+				strcmp (var->var, "CURDIR") != 0) {
+			ucl_parser_variable_remove (parser, var);
+			free (var->value);
+			free (var->var);
+			UCL_FREE (sizeof (struct ucl_variable), var);
+		}
+	}
+	ucl_parser_set_filevars (parser, NULL, false);
+	parser->var_handler = NULL;
+	parser->var_data = NULL;
+
+	HASH_ITER (hh, parser->macro_args, margs, matmp) {
+		HASH_DEL (parser->macro_args, margs);
+		ucl_object_unref (margs->args);
+		free (margs->text);
+		UCL_FREE (sizeof (struct ucl_macro_args), margs);
+	}
+	parser->macro_args_count = 0;
+
+	/* Signatures verified with the removed keys are not trusted anymore */
+	LL_FOREACH_SAFE (parser->keys, key, ktmp) {
+#ifdef HAVE_OPENSSL
+		EVP_PKEY_free (key->key);
+#endif
+		UCL_FREE (sizeof (struct ucl_pubkey), key);
+	}
+	parser->keys = NULL;
+	HASH_ITER (hh, parser->sig_cache, sc, sctmp) {
+		HASH_DEL (parser->sig_cache, sc);
+		free (sc);
+	}
+	parser->sig_cache_count = 0;
+
+	if (parser->includepaths != NULL) {
+		ucl_object_unref (parser->includepaths);
+		parser->includepaths = NULL;
+	}
+
+	if (parser->projection != NULL) {
+		ucl_object_unref (parser->projection);
+		parser->projection = NULL;
+	}
+
+	parser->include_fetcher = NULL;
+	parser->include_fetcher_ud = NULL;
+	parser->default_priority = 0;
+	parser->lazy_depth = 0;
+	parser->max_depth = 0;
+	parser->max_recursion = UCL_MAX_RECURSION;
+	parser->max_decompressed = UCL_MAX_DECOMPRESSED_SIZE;
+	parser->sliced = false;
+	parser->slice_bytes = 0;
+	parser->slice_time = 0;
+	parser->track_includes = false;
+}
+
 void
 ucl_parser_set_filename (struct ucl_parser *parser, const char *filename)
 {
@@ -2470,6 +3412,191 @@ ucl_parser_set_default_priority (struct ucl_parser *parser, unsigned prio)
 	return true;
 }
 
+bool
+ucl_parser_set_lazy_depth (struct ucl_parser *parser, unsigned depth)
+{
+	if (parser == NULL) {
+		return false;
+	}
+
+	parser->lazy_depth = depth;
+
+	return true;
+}
+
+bool
+ucl_parser_set_max_depth (struct ucl_parser *parser, unsigned depth)
+{
+	if (parser == NULL) {
+		return false;
+	}
+
+	parser->max_depth = depth;
+
+	return true;
+}
+
+bool
+ucl_parser_set_max_recursion (struct ucl_parser *parser, unsigned recursion)
+{
+	if (parser == NULL || recursion == 0) {
+		return false;
+	}
+
+	parser->max_recursion = recursion;
+
+	return true;
+}
+
+bool
+ucl_parser_set_max_decompressed_size (struct ucl_parser *parser, size_t size)
+{
+	if (parser == NULL) {
+		return false;
+	}
+
+	parser->max_decompressed = size;
+
+	return true;
+}
+
+bool
+ucl_parser_add_projection (struct ucl_parser *parser, const char *path)
+{
+	const char *p, *c;
+	ucl_object_t *node, *found;
+
+	if (parser == NULL || path == NULL || *path == '\0' || *path == '.') {
+		return false;
+	}
+
+	for (p = path; *p != '\0'; p ++) {
+		if (*p == '.' && (p[1] == '.' || p[1] == '\0')) {
+			/* Empty components are not allowed */
+			return false;
+		}
+	}
+
+	if (parser->projection == NULL) {
+		parser->projection = ucl_object_typed_new (UCL_OBJECT);
+
+		if (parser->projection == NULL) {
+			return false;
+		}
+	}
+
+	node = parser->projection;
+	p = path;
+
+	for (;;) {
+		c = p;
+
+		while (*p != '\0' && *p != '.') {
+			p ++;
+		}
+
+		found = __DECONST (ucl_object_t *,
+				ucl_object_lookup_len (node, c, p - c));
+
+		if (*p == '\0') {
+			/* The whole subtree is selected */
+			if (found == NULL) {
+				ucl_object_insert_key (node, ucl_object_frombool (true),
+						c, p - c, true);
+			}
+			else if (found->type == UCL_OBJECT) {
+				ucl_object_replace_key (node, ucl_object_frombool (true),
+						c, p - c, true);
+			}
+			break;
+		}
+
+		if (found == NULL) {
+			found = ucl_object_typed_new (UCL_OBJECT);
+			ucl_object_insert_key (node, found, c, p - c, true);
+		}
+		else if (found->type != UCL_OBJECT) {
+			/* A parent path is already selected */
+			break;
+		}
+
+		node = found;
+		p ++;
+	}
+
+	return true;
+}
+
+bool
+ucl_object_parse_deferred (const ucl_object_t *cobj)
+{
+	ucl_object_t *obj = __DECONST (ucl_object_t *, cobj), *top;
+	struct ucl_deferred_container *dc;
+	struct ucl_parser *parser;
+	bool ret = false;
+
+	dc = (struct ucl_deferred_container *)obj->trash_stack[UCL_TRASH_VALUE];
+	obj->trash_stack[UCL_TRASH_VALUE] = NULL;
+	obj->flags &= ~UCL_OBJECT_DEFERRED;
+
+	parser = ucl_parser_new (dc->flags);
+
+	if (parser != NULL) {
+		/* Nested containers are deferred again */
+		parser->lazy_depth = 1;
+		parser->deferred = true;
+
+		if (ucl_parser_add_chunk_full (parser, dc->begin, dc->len,
+				dc->priority, dc->strategy, UCL_PARSE_UCL)) {
+			top = ucl_parser_get_object (parser);
+
+			if (top != NULL && top->type == obj->type) {
+				obj->value = top->value;
+				obj->len = top->len;
+				memset (&top->value, 0, sizeof (top->value));
+				top->len = 0;
+				ret = true;
+			}
+
+			ucl_object_unref (top);
+		}
+
+		ucl_parser_free (parser);
+	}
+
+	UCL_FREE (sizeof (*dc), dc);
+
+	return ret;
+}
+
+bool
+ucl_object_materialize (const ucl_object_t *obj, bool recursive)
+{
+	const ucl_object_t *elt, *cur;
+	ucl_object_iter_t it;
+	bool ret = true;
+
+	LL_FOREACH (obj, elt) {
+		if ((elt->flags & UCL_OBJECT_DEFERRED) &&
+				!ucl_object_parse_deferred (elt)) {
+			ret = false;
+		}
+
+		if (recursive && (elt->type == UCL_OBJECT ||
+				(elt->type == UCL_ARRAY && !ucl_array_is_packed (elt)))) {
+			it = NULL;
+
+			while ((cur = ucl_object_iterate (elt, &it, true)) != NULL) {
+				if (!ucl_object_materialize (cur, true)) {
+					ret = false;
+				}
+			}
+		}
+	}
+
+	return ret;
+}
+
 void
 ucl_parser_register_macro (struct ucl_parser *parser, const char *macro,
 		ucl_macro_handler handler, void* ud)
@@ -2515,29 +3642,42 @@ ucl_parser_register_context_macro (struct ucl_parser *parser, const char *macro,
 	HASH_ADD_KEYPTR (hh, parser->macroes, new->name, strlen (new->name), new);
 }
 
+void
+ucl_parser_variable_add (struct ucl_parser *parser, struct ucl_variable *var)
+{
+	var->seq = parser->var_seq ++;
+	/* Names of 64 symbols and longer share the last bit */
+	parser->var_lens |= 1ULL << (var->var_len < 64 ? var->var_len - 1 : 63);
+	HASH_ADD_KEYPTR (hh, parser->vars_hash, var->var, var->var_len, var);
+	DL_APPEND (parser->variables, var);
+}
+
+void
+ucl_parser_variable_remove (struct ucl_parser *parser, struct ucl_variable *var)
+{
+	/* Length bits are kept as they only cost an extra lookup */
+	HASH_DELETE (hh, parser->vars_hash, var);
+	DL_DELETE (parser->variables, var);
+}
+
 void
 ucl_parser_register_variable (struct ucl_parser *parser, const char *var,
 		const char *value)
 {
-	struct ucl_variable *new = NULL, *cur;
+	struct ucl_variable *new = NULL;
 
-	if (var == NULL) {
+	if (var == NULL || *var == '\0') {
 		return;
 	}
 
 	/* Find whether a variable already exists */
-	LL_FOREACH (parser->variables, cur) {
-		if (strcmp (cur->var, var) == 0) {
-			new = cur;
-			break;
-		}
-	}
+	HASH_FIND (hh, parser->vars_hash, var, strlen (var), new);
 
 	if (value == NULL) {
 
 		if (new != NULL) {
 			/* Remove variable */
-			DL_DELETE (parser->variables, new);
+			ucl_parser_variable_remove (parser, new);
 			free (new->var);
 			free (new->value);
 			UCL_FREE (sizeof (struct ucl_variable), new);
@@ -2559,7 +3699,7 @@ ucl_parser_register_variable (struct ucl_parser *parser, const char *var,
 			new->value = strdup (value);
 			new->value_len = strlen (value);
 
-			DL_APPEND (parser->variables, new);
+			ucl_parser_variable_add (parser, new);
 		}
 		else {
 			free (new->value);
@@ -2578,11 +3718,13 @@ ucl_parser_set_variables_handler (struct ucl_parser *parser,
 }
 
 bool
-ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
-		size_t len, unsigned priority, enum ucl_duplicate_strategy strat,
-		enum ucl_parse_type parse_type)
+ucl_parser_add_backed_chunk (struct ucl_parser *parser,
+		const unsigned char *data, size_t len, unsigned priority,
+		enum ucl_duplicate_strategy strat, enum ucl_parse_type parse_type,
+		struct ucl_backing *backing)
 {
 	struct ucl_chunk *chunk;
+	bool res;
 
 	if (parser == NULL) {
 		return false;
@@ -2592,6 +3734,10 @@ ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
 		ucl_create_err (&parser->err, "invalid chunk added");
 		return false;
 	}
+	if (parser->suspended && parser->parse_depth == 0) {
+		ucl_create_err (&parser->err, "a chunk is being parsed in slices");
+		return false;
+	}
 	if (len == 0) {
 		parser->top_obj = ucl_object_new_full (UCL_OBJECT, priority);
 		return true;
@@ -2608,25 +3754,59 @@ ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
 		chunk->end = chunk->begin + len;
 		chunk->line = 1;
 		chunk->column = 0;
+		chunk->line_pos = chunk->begin;
+		chunk->backing = backing;
 		chunk->priority = priority;
 		chunk->strategy = strat;
 		chunk->parse_type = parse_type;
 		LL_PREPEND (parser->chunks, chunk);
 		parser->recursion ++;
 
-		if (parser->recursion > UCL_MAX_RECURSION) {
+		if (backing != NULL) {
+			/* Held until the chunk is released */
+			ucl_backing_ref (backing);
+
+			/* Included data is also added to the current container */
+			if (parser->stack != NULL) {
+				ucl_parser_attach_backing (parser, parser->stack->obj);
+			}
+			ucl_parser_attach_backing (parser, parser->top_obj);
+		}
+
+		if (parser->recursion > parser->max_recursion) {
 			ucl_create_err (&parser->err, "maximum include nesting limit is reached: %d",
 					parser->recursion);
 			return false;
 		}
 
+		parser->parse_depth ++;
+
 		switch (parse_type) {
 		default:
 		case UCL_PARSE_UCL:
-			return ucl_state_machine (parser);
+			res = ucl_state_machine (parser);
+			break;
 		case UCL_PARSE_MSGPACK:
-			return ucl_parse_msgpack (parser);
+			res = ucl_parse_msgpack (parser);
+			break;
+		}
+
+		parser->parse_depth --;
+
+		if (parser->suspended) {
+			/* Continued by ucl_parser_resume */
+			return res;
 		}
+
+		/* Input may be released once parsed, so do not count lines later */
+		ucl_chunk_position (chunk);
+
+		if (res && parser->pending_includes != NULL) {
+			/* Contents could be supplied while the chunk was parsed */
+			res = ucl_parser_apply_includes (parser);
+		}
+
+		return res;
 	}
 
 	ucl_create_err (&parser->err, "a parser is in an invalid state");
@@ -2634,6 +3814,82 @@ ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
 	return false;
 }
 
+bool
+ucl_parser_add_chunk_full (struct ucl_parser *parser, const unsigned char *data,
+		size_t len, unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
+{
+	return ucl_parser_add_backed_chunk (parser, data, len, priority, strat,
+			parse_type, NULL);
+}
+
+static enum ucl_parser_progress
+ucl_parser_slice_finish (struct ucl_parser *parser, bool res)
+{
+	parser->sliced = false;
+
+	if (!res) {
+		parser->suspended = false;
+		return UCL_PROGRESS_ERROR;
+	}
+
+	return parser->suspended ? UCL_PROGRESS_AGAIN : UCL_PROGRESS_DONE;
+}
+
+enum ucl_parser_progress
+ucl_parser_add_chunk_sliced (struct ucl_parser *parser,
+		const unsigned char *data, size_t len, size_t max_bytes,
+		double max_time)
+{
+	bool res;
+
+	if (parser == NULL) {
+		return UCL_PROGRESS_ERROR;
+	}
+
+	parser->sliced = true;
+	parser->slice_bytes = max_bytes;
+	parser->slice_time = max_time;
+	res = ucl_parser_add_chunk_full (parser, data, len,
+			parser->default_priority, UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
+
+	return ucl_parser_slice_finish (parser, res);
+}
+
+enum ucl_parser_progress
+ucl_parser_resume (struct ucl_parser *parser, size_t max_bytes,
+		double max_time)
+{
+	bool res;
+
+	if (parser == NULL) {
+		return UCL_PROGRESS_ERROR;
+	}
+	if (!parser->suspended) {
+		ucl_create_err (&parser->err, "no chunk is being parsed in slices");
+		return UCL_PROGRESS_ERROR;
+	}
+
+	parser->suspended = false;
+	parser->sliced = true;
+	parser->slice_bytes = max_bytes;
+	parser->slice_time = max_time;
+
+	parser->parse_depth ++;
+	res = ucl_state_machine (parser);
+	parser->parse_depth --;
+
+	if (!parser->suspended) {
+		ucl_chunk_position (parser->chunks);
+	}
+
+	if (res && !parser->suspended && parser->pending_includes != NULL) {
+		res = ucl_parser_apply_includes (parser);
+	}
+
+	return ucl_parser_slice_finish (parser, res);
+}
+
 bool
 ucl_parser_add_chunk_priority (struct ucl_parser *parser,
 		const unsigned char *data, size_t len, unsigned priority)
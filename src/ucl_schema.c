@@ -143,6 +143,8 @@ ucl_schema_validate_object (const ucl_object_t *schema,
 	bool ret = true, allow_additional = true;
 	int64_t minmax;
 
+	ucl_container_materialize (obj);
+
 	while (ret && (elt = ucl_object_iterate (schema, &iter, true)) != NULL) {
 		if (elt->type == UCL_OBJECT &&
 				strcmp (ucl_object_key (elt), "properties") == 0) {
@@ -355,6 +357,9 @@ ucl_schema_validate_string (const ucl_object_t *schema,
 	regex_t re;
 #endif
 
+	/* Length constraints apply to the unescaped value */
+	ucl_string_materialize (obj);
+
 	while (ret && (elt = ucl_object_iterate (schema, &iter, true)) != NULL) {
 		if (elt->type == UCL_INT &&
 			strcmp (ucl_object_key (elt), "maxLength") == 0) {
@@ -404,6 +409,7 @@ ucl_schema_validate_string (const ucl_object_t *schema,
 
 struct ucl_compare_node {
 	const ucl_object_t *obj;
+	uint64_t hash;
 	TREE_ENTRY(ucl_compare_node) link;
 	struct ucl_compare_node *next;
 };
@@ -417,6 +423,11 @@ ucl_schema_elt_compare (struct ucl_compare_node *n1, struct ucl_compare_node *n2
 {
 	const ucl_object_t *o1 = n1->obj, *o2 = n2->obj;
 
+	/* Order by hash first, so deep comparison is needed for equal hashes only */
+	if (n1->hash != n2->hash) {
+		return n1->hash > n2->hash ? 1 : -1;
+	}
+
 	return ucl_object_compare (o1, o2);
 }
 
@@ -431,6 +442,7 @@ ucl_schema_array_is_unique (const ucl_object_t *obj, struct ucl_schema_error *er
 
 	while ((elt = ucl_object_iterate (obj, &iter, true)) != NULL) {
 		test.obj = elt;
+		test.hash = ucl_object_hash (elt);
 		node = TREE_FIND (&tree, ucl_compare_node, link, &test);
 		if (node != NULL) {
 			ucl_schema_create_error (err, UCL_SCHEMA_CONSTRAINT, elt,
@@ -446,6 +458,7 @@ ucl_schema_array_is_unique (const ucl_object_t *obj, struct ucl_schema_error *er
 			break;
 		}
 		node->obj = elt;
+		node->hash = test.hash;
 		TREE_INSERT (&tree, ucl_compare_node, link, node);
 		LL_PREPEND (nodes, node);
 	}
@@ -470,6 +483,8 @@ ucl_schema_validate_array (const ucl_object_t *schema,
 	int64_t minmax;
 	unsigned int idx = 0;
 
+	ucl_container_materialize (obj);
+
 	while (ret && (elt = ucl_object_iterate (schema, &iter, true)) != NULL) {
 		if (strcmp (ucl_object_key (elt), "items") == 0) {
 			if (elt->type == UCL_ARRAY) {
@@ -640,9 +655,21 @@ ucl_schema_validate_enum (const ucl_object_t *en, const ucl_object_t *obj,
 {
 	ucl_object_iter_t iter = NULL;
 	const ucl_object_t *elt;
+	uint64_t h = 0;
 	bool ret = false;
 
 	while ((elt = ucl_object_iterate (en, &iter, true)) != NULL) {
+		if (elt->flags & UCL_OBJECT_SEALED) {
+			/* Hashes of sealed schemas are cached, so use them as a filter */
+			if (h == 0) {
+				h = ucl_object_hash (obj);
+			}
+
+			if (ucl_object_hash (elt) != h) {
+				continue;
+			}
+		}
+
 		if (ucl_object_compare (elt, obj) == 0) {
 			ret = true;
 			break;
@@ -767,7 +794,7 @@ ucl_schema_resolve_ref (const ucl_object_t *root, const char *ref,
 				}
 			}
 			else {
-				if (!ucl_fetch_file (p, &url_buf, &url_buflen, &url_err,
+				if (!ucl_fetch_file (p, &url_buf, &url_buflen, NULL, &url_err,
 						true)) {
 					ucl_schema_create_error (err,
 							UCL_SCHEMA_INVALID_SCHEMA,
@@ -95,34 +95,24 @@ ucl_parse_csexp (struct ucl_parser *parser)
 			break;
 
 		case read_obrace:
-			st = calloc (1, sizeof (*st));
+			obj = ucl_object_typed_new (UCL_ARRAY);
 
-			if (st == NULL) {
+			if (obj == NULL) {
 				ucl_create_err (&parser->err, "no memory");
 				state = parse_err;
 				continue;
 			}
 
-			st->obj = ucl_object_typed_new (UCL_ARRAY);
-
-			if (st->obj == NULL) {
-				ucl_create_err (&parser->err, "no memory");
+			if (ucl_parser_stack_push (parser, obj, 0) == NULL) {
+				ucl_create_err (&parser->err, "%s",
+						ucl_parser_stack_error (parser));
+				ucl_object_unref (obj);
 				state = parse_err;
-				free (st);
 				continue;
 			}
 
-			if (parser->stack == NULL) {
-				/* We have no stack */
-				parser->stack = st;
-
-				if (parser->top_obj == NULL) {
-					parser->top_obj = st->obj;
-				}
-			}
-			else {
-				/* Prepend new element to the stack */
-				LL_PREPEND (parser->stack, st);
+			if (parser->top_obj == NULL) {
+				parser->top_obj = obj;
 			}
 
 			p ++;
@@ -177,6 +167,9 @@ ucl_parse_csexp (struct ucl_parser *parser)
 			if (!(parser->flags & UCL_PARSER_ZEROCOPY)) {
 				ucl_copy_value_trash (obj);
 			}
+			else {
+				obj->flags |= UCL_OBJECT_BORROWED;
+			}
 
 			ucl_array_append (parser->stack->obj, obj);
 			p += len;
@@ -193,7 +186,7 @@ ucl_parse_csexp (struct ucl_parser *parser)
 			}
 			/* Pop the container */
 			st = parser->stack;
-			parser->stack = st->next;
+			ucl_parser_stack_pop (parser);
 
 			if (parser->stack->obj->type == UCL_ARRAY) {
 				ucl_array_append (parser->stack->obj, st->obj);
@@ -205,7 +198,6 @@ ucl_parse_csexp (struct ucl_parser *parser)
 				continue;
 			}
 
-			free (st);
 			st = NULL;
 			p++;
 			NEXT_STATE;
@@ -0,0 +1,260 @@
+/* Copyright (c) 2016, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Persistent cache of documents fetched by URL, entries are revalidated with
+ * conditional requests and used as is when a server is unreachable
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ucl.h"
+#include "ucl_internal.h"
+
+static char *ucl_url_cache_dir = NULL;
+
+void
+ucl_set_url_cache (const char *dir)
+{
+	free (ucl_url_cache_dir);
+	ucl_url_cache_dir = dir != NULL ? strdup (dir) : NULL;
+}
+
+/*
+ * Each url is stored as two files: `<hash>.body` with the document and
+ * `<hash>.meta` with the url, validators and the hash of the body, the body
+ * is written first so a body without matching meta is never used
+ */
+static bool
+ucl_url_cache_path (const char *url, const char *suffix, char *path,
+		size_t pathlen)
+{
+	int r;
+
+	if (ucl_url_cache_dir == NULL) {
+		return false;
+	}
+
+	r = snprintf (path, pathlen, "%s/%016llx.%s", ucl_url_cache_dir,
+			(unsigned long long)XXH64 (url, strlen (url), 0), suffix);
+
+	return r > 0 && (size_t)r < pathlen;
+}
+
+static bool
+ucl_url_cache_write (const char *path, const void *data, size_t len)
+{
+	char tmp[PATH_MAX];
+	const unsigned char *p = data;
+	ssize_t r;
+	int fd;
+
+	snprintf (tmp, sizeof (tmp), "%s.XXXXXX", path);
+	if ((fd = mkstemp (tmp)) == -1) {
+		return false;
+	}
+
+	while (len > 0) {
+		r = write (fd, p, len);
+
+		if (r == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			close (fd);
+			unlink (tmp);
+
+			return false;
+		}
+		p += r;
+		len -= r;
+	}
+
+	/* Readers see either the old file or the new one */
+	if (close (fd) == -1 || rename (tmp, path) == -1) {
+		unlink (tmp);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+ucl_url_cache_read (const char *path, size_t len, unsigned char **buf)
+{
+	unsigned char *p;
+	struct stat st;
+	size_t remain = len;
+	ssize_t r;
+	int fd;
+
+	if ((fd = open (path, O_RDONLY)) == -1) {
+		return false;
+	}
+	if (fstat (fd, &st) == -1 || (size_t)st.st_size != len ||
+			(*buf = malloc (len + 1)) == NULL) {
+		close (fd);
+		return false;
+	}
+
+	p = *buf;
+	while (remain > 0) {
+		r = read (fd, p, remain);
+
+		if (r == -1 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			close (fd);
+			free (*buf);
+
+			return false;
+		}
+		p += r;
+		remain -= r;
+	}
+
+	close (fd);
+	(*buf)[len] = '\0';
+
+	return true;
+}
+
+bool
+ucl_url_cache_load (const char *url, struct ucl_url_cache_entry *entry)
+{
+	char path[PATH_MAX];
+	struct ucl_parser *parser;
+	ucl_object_t *meta;
+	const ucl_object_t *elt;
+	int64_t len, hash;
+	bool ret = false;
+
+	memset (entry, 0, sizeof (*entry));
+	entry->mtime = -1;
+
+	if (!ucl_url_cache_path (url, "meta", path, sizeof (path))) {
+		return false;
+	}
+
+	parser = ucl_parser_new (UCL_PARSER_NO_TIME|UCL_PARSER_DISABLE_MACRO);
+	if (parser == NULL) {
+		return false;
+	}
+	if (!ucl_parser_add_file (parser, path) ||
+			(meta = ucl_parser_get_object (parser)) == NULL) {
+		ucl_parser_free (parser);
+		return false;
+	}
+	ucl_parser_free (parser);
+
+	/* Hashes of different urls could collide */
+	elt = ucl_object_lookup (meta, "url");
+	if (elt == NULL || ucl_object_type (elt) != UCL_STRING ||
+			strcmp (ucl_object_tostring (elt), url) != 0) {
+		goto out;
+	}
+	if (!ucl_object_toint_safe (ucl_object_lookup (meta, "size"), &len) ||
+			len < 0 ||
+			!ucl_object_toint_safe (ucl_object_lookup (meta, "hash"), &hash)) {
+		goto out;
+	}
+
+	if (!ucl_url_cache_path (url, "body", path, sizeof (path)) ||
+			!ucl_url_cache_read (path, len, &entry->body)) {
+		goto out;
+	}
+	if ((int64_t)XXH64 (entry->body, len, 0) != hash) {
+		/* The body has been replaced by a concurrent update */
+		free (entry->body);
+		entry->body = NULL;
+		goto out;
+	}
+
+	entry->len = len;
+	elt = ucl_object_lookup (meta, "etag");
+	if (elt != NULL && ucl_object_type (elt) == UCL_STRING) {
+		entry->etag = strdup (ucl_object_tostring (elt));
+	}
+	ucl_object_toint_safe (ucl_object_lookup (meta, "mtime"), &entry->mtime);
+	ret = true;
+
+out:
+	ucl_object_unref (meta);
+
+	return ret;
+}
+
+void
+ucl_url_cache_store (const char *url, const unsigned char *body, size_t len,
+		const char *etag, int64_t mtime)
+{
+	char path[PATH_MAX];
+	ucl_object_t *meta;
+	unsigned char *out;
+
+	if (!ucl_url_cache_path (url, "body", path, sizeof (path))) {
+		return;
+	}
+	/* Fails if the directory exists */
+	(void)mkdir (ucl_url_cache_dir, 0700);
+
+	if (!ucl_url_cache_write (path, body, len)) {
+		return;
+	}
+
+	meta = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (meta, ucl_object_fromstring (url), "url", 0, false);
+	ucl_object_insert_key (meta, ucl_object_fromint (len), "size", 0, false);
+	ucl_object_insert_key (meta,
+			ucl_object_fromint ((int64_t)XXH64 (body, len, 0)), "hash", 0, false);
+	if (etag != NULL) {
+		ucl_object_insert_key (meta, ucl_object_fromstring (etag), "etag",
+				0, false);
+	}
+	if (mtime >= 0) {
+		ucl_object_insert_key (meta, ucl_object_fromint (mtime), "mtime",
+				0, false);
+	}
+
+	out = ucl_object_emit (meta, UCL_EMIT_JSON_COMPACT);
+	ucl_object_unref (meta);
+
+	if (out != NULL) {
+		if (ucl_url_cache_path (url, "meta", path, sizeof (path))) {
+			ucl_url_cache_write (path, out, strlen ((const char *)out));
+		}
+		free (out);
+	}
+}
+
+void
+ucl_url_cache_entry_free (struct ucl_url_cache_entry *entry)
+{
+	free (entry->body);
+	free (entry->etag);
+	entry->body = NULL;
+	entry->etag = NULL;
+}
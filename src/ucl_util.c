@@ -37,11 +37,6 @@
 #include <libgen.h> /* For dirname */
 #endif
 
-typedef kvec_t(ucl_object_t *) ucl_array_t;
-
-#define UCL_ARRAY_GET(ar, obj) ucl_array_t *ar = \
-	(ucl_array_t *)((obj) != NULL ? (obj)->value.av : NULL)
-
 #ifdef HAVE_OPENSSL
 #include <openssl/err.h>
 #include <openssl/sha.h>
@@ -151,6 +146,8 @@ typedef void (*ucl_object_dtor) (ucl_object_t *obj);
 static void ucl_object_free_internal (ucl_object_t *obj, bool allow_rec,
 		ucl_object_dtor dtor);
 static void ucl_object_dtor_unref (ucl_object_t *obj);
+static void ucl_object_dtor_sealed (ucl_object_t *obj);
+static uint64_t *ucl_object_hash_slot (const ucl_object_t *obj);
 
 static void
 ucl_object_dtor_free (ucl_object_t *obj)
@@ -191,7 +188,9 @@ ucl_object_dtor_unref_single (ucl_object_t *obj)
 #else
 		if (--obj->ref == 0) {
 #endif
-			ucl_object_free_internal (obj, false, ucl_object_dtor_unref);
+			ucl_object_free_internal (obj, false,
+					(obj->flags & UCL_OBJECT_SEALED) ?
+					ucl_object_dtor_sealed : ucl_object_dtor_unref);
 		}
 	}
 }
@@ -199,6 +198,10 @@ ucl_object_dtor_unref_single (ucl_object_t *obj)
 static void
 ucl_object_dtor_unref (ucl_object_t *obj)
 {
+	if (obj->flags & UCL_OBJECT_PINNED) {
+		/* Owned by the root of a sealed tree */
+		return;
+	}
 	if (obj->ref == 0) {
 		ucl_object_dtor_free (obj);
 	}
@@ -208,6 +211,163 @@ ucl_object_dtor_unref (ucl_object_t *obj)
 	}
 }
 
+/*
+ * Destroys elements of a sealed tree once its root is released, pinned
+ * elements are freed regardless of their refcount
+ */
+static void
+ucl_object_dtor_sealed (ucl_object_t *obj)
+{
+	if (obj->flags & UCL_OBJECT_PINNED) {
+		obj->flags &= ~UCL_OBJECT_PINNED;
+		obj->ref = 0;
+		ucl_object_free_internal (obj, false, ucl_object_dtor_sealed);
+	}
+	else {
+		/* Either the root itself or a foreign tree sealed separately */
+		ucl_object_dtor_unref (obj);
+	}
+}
+
+struct ucl_backing *
+ucl_backing_new (void *data, size_t len, void (*dtor) (void *data, size_t len))
+{
+	struct ucl_backing *backing;
+
+	backing = UCL_ALLOC (sizeof (*backing));
+
+	if (backing != NULL) {
+		backing->data = data;
+		backing->len = len;
+		backing->ref = 1;
+		backing->dtor = dtor;
+	}
+
+	return backing;
+}
+
+struct ucl_backing *
+ucl_backing_ref (struct ucl_backing *backing)
+{
+	if (backing != NULL) {
+#ifdef HAVE_ATOMIC_BUILTINS
+		(void)__sync_add_and_fetch (&backing->ref, 1);
+#else
+		backing->ref ++;
+#endif
+	}
+
+	return backing;
+}
+
+void
+ucl_backing_unref (struct ucl_backing *backing)
+{
+	if (backing != NULL) {
+#ifdef HAVE_ATOMIC_BUILTINS
+		unsigned int rc = __sync_sub_and_fetch (&backing->ref, 1);
+		if (rc == 0) {
+#else
+		if (--backing->ref == 0) {
+#endif
+			if (backing->dtor) {
+				backing->dtor (backing->data, backing->len);
+			}
+			UCL_FREE (sizeof (*backing), backing);
+		}
+	}
+}
+
+static void
+ucl_backing_list_free (struct ucl_backing_list *list)
+{
+	struct ucl_backing_list *cur, *tmp;
+
+	LL_FOREACH_SAFE (list, cur, tmp) {
+		ucl_backing_unref (cur->backing);
+		UCL_FREE (sizeof (*cur), cur);
+	}
+}
+
+static struct ucl_backing_list **
+ucl_object_backings (ucl_object_t *obj, bool create)
+{
+	if (obj->type == UCL_ARRAY) {
+		ucl_array_t *vec = ucl_array_get_raw (obj);
+
+		if (vec == NULL) {
+			if (!create) {
+				return NULL;
+			}
+
+			vec = UCL_ALLOC (sizeof (*vec));
+
+			if (vec == NULL) {
+				return NULL;
+			}
+
+			memset (vec, 0, sizeof (*vec));
+			obj->value.av = vec;
+		}
+
+		return &vec->backings;
+	}
+	else if (obj->type == UCL_OBJECT) {
+		ucl_container_materialize (obj);
+
+		if (obj->value.ov == NULL && create) {
+			obj->value.ov = ucl_hash_create (false);
+		}
+
+		return ucl_hash_backings (obj->value.ov);
+	}
+
+	return NULL;
+}
+
+void
+ucl_object_attach_backing (ucl_object_t *obj, struct ucl_backing *backing)
+{
+	struct ucl_backing_list **plist, *cur;
+
+	if (obj == NULL || backing == NULL ||
+			(plist = ucl_object_backings (obj, true)) == NULL) {
+		return;
+	}
+
+	LL_FOREACH (*plist, cur) {
+		if (cur->backing == backing) {
+			return;
+		}
+	}
+
+	cur = UCL_ALLOC (sizeof (*cur));
+
+	if (cur != NULL) {
+		cur->backing = ucl_backing_ref (backing);
+		LL_PREPEND (*plist, cur);
+	}
+}
+
+void
+ucl_object_share_backings (ucl_object_t *dst, const ucl_object_t *src)
+{
+	struct ucl_backing_list **plist, *cur;
+
+	if (src == NULL || dst == NULL || src == dst ||
+			(src->type != UCL_OBJECT && src->type != UCL_ARRAY)) {
+		return;
+	}
+
+	plist = ucl_object_backings (__DECONST (ucl_object_t *, src), false);
+
+	if (plist != NULL) {
+		LL_FOREACH (*plist, cur) {
+			ucl_object_attach_backing (dst, cur->backing);
+		}
+	}
+}
+
 static void
 ucl_object_free_internal (ucl_object_t *obj, bool allow_rec, ucl_object_dtor dtor)
 {
@@ -215,7 +375,8 @@ ucl_object_free_internal (ucl_object_t *obj, bool allow_rec, ucl_object_dtor dto
 
 	while (obj != NULL) {
 		if (obj->type == UCL_ARRAY) {
-			UCL_ARRAY_GET (vec, obj);
+			/* Deferred arrays have no storage yet */
+			ucl_array_t *vec = obj->value.av;
 			unsigned int i;
 
 			if (vec != NULL) {
@@ -231,13 +392,21 @@ ucl_object_free_internal (ucl_object_t *obj, bool allow_rec, ucl_object_dtor dto
 					}
 				}
 				kv_destroy (*vec);
+				free (vec->packed);
+				free (vec->view);
+				/* Elements may refer to the backing stores */
+				ucl_backing_list_free (vec->backings);
 				UCL_FREE (sizeof (*vec), vec);
 			}
 			obj->value.av = NULL;
 		}
 		else if (obj->type == UCL_OBJECT) {
 			if (obj->value.ov != NULL) {
+				struct ucl_backing_list *backings =
+						*ucl_hash_backings (obj->value.ov);
+
 				ucl_hash_destroy (obj->value.ov, (ucl_hash_free_func)dtor);
+				ucl_backing_list_free (backings);
 			}
 			obj->value.ov = NULL;
 		}
@@ -412,6 +581,27 @@ ucl_copy_key_trash (const ucl_object_t *obj)
 	return obj->trash_stack[UCL_TRASH_KEY];
 }
 
+void
+ucl_object_unescape_deferred (const ucl_object_t *obj)
+{
+	ucl_object_t *deconst = __DECONST (ucl_object_t *, obj);
+	char *dst;
+
+	dst = malloc (obj->len + 1);
+
+	if (dst == NULL) {
+		return;
+	}
+
+	memcpy (dst, obj->value.sv, obj->len);
+	dst[obj->len] = '\0';
+	deconst->len = ucl_unescape_json_string (dst, obj->len);
+	deconst->trash_stack[UCL_TRASH_VALUE] = dst;
+	deconst->value.sv = dst;
+	deconst->flags &= ~UCL_OBJECT_NEED_UNESCAPE;
+	deconst->flags |= UCL_OBJECT_ALLOCATED_VALUE;
+}
+
 char *
 ucl_copy_value_trash (const ucl_object_t *obj)
 {
@@ -420,6 +610,9 @@ ucl_copy_value_trash (const ucl_object_t *obj)
 	if (obj == NULL) {
 		return NULL;
 	}
+
+	ucl_string_materialize (obj);
+
 	if (obj->trash_stack[UCL_TRASH_VALUE] == NULL) {
 		deconst = __DECONST (ucl_object_t *, obj);
 		if (obj->type == UCL_STRING) {
@@ -456,6 +649,28 @@ ucl_copy_value_trash (const ucl_object_t *obj)
 	return obj->trash_stack[UCL_TRASH_VALUE];
 }
 
+/**
+ * Copy the key and the string value of a scalar that may refer to the parser
+ * input, containers hold the input themselves
+ * @param obj object
+ */
+static void
+ucl_object_detach_input (ucl_object_t *obj)
+{
+	if (obj->type == UCL_OBJECT || obj->type == UCL_ARRAY) {
+		return;
+	}
+
+	if (obj->key != NULL) {
+		ucl_copy_key_trash (obj);
+	}
+	if (obj->type == UCL_STRING) {
+		ucl_copy_value_trash (obj);
+	}
+
+	obj->flags &= ~UCL_OBJECT_BORROWED;
+}
+
 ucl_object_t*
 ucl_parser_get_object (struct ucl_parser *parser)
 {
@@ -475,6 +690,8 @@ ucl_parser_free (struct ucl_parser *parser)
 	struct ucl_pubkey *key, *ktmp;
 	struct ucl_variable *var, *vtmp;
 	ucl_object_t *tr, *trtmp;
+	struct ucl_macro_args *margs, *matmp;
+	struct ucl_sig_cache *sc, *sctmp;
 
 	if (parser == NULL) {
 		return;
@@ -488,27 +705,53 @@ ucl_parser_free (struct ucl_parser *parser)
 		ucl_object_unref (parser->includepaths);
 	}
 
+	if (parser->projection != NULL) {
+		ucl_object_unref (parser->projection);
+	}
+
 	LL_FOREACH_SAFE (parser->stack, stack, stmp) {
 		free (stack);
 	}
+	LL_FOREACH_SAFE (parser->stack_free, stack, stmp) {
+		free (stack);
+	}
 	HASH_ITER (hh, parser->macroes, macro, mtmp) {
 		free (macro->name);
 		HASH_DEL (parser->macroes, macro);
 		UCL_FREE (sizeof (struct ucl_macro), macro);
 	}
 	LL_FOREACH_SAFE (parser->chunks, chunk, ctmp) {
+		ucl_backing_unref (chunk->backing);
 		UCL_FREE (sizeof (struct ucl_chunk), chunk);
 	}
 	LL_FOREACH_SAFE (parser->keys, key, ktmp) {
+#ifdef HAVE_OPENSSL
+		EVP_PKEY_free (key->key);
+#endif
 		UCL_FREE (sizeof (struct ucl_pubkey), key);
 	}
+	HASH_CLEAR (hh, parser->vars_hash);
+	HASH_ITER (hh, parser->macro_args, margs, matmp) {
+		HASH_DEL (parser->macro_args, margs);
+		ucl_object_unref (margs->args);
+		free (margs->text);
+		UCL_FREE (sizeof (struct ucl_macro_args), margs);
+	}
+	HASH_ITER (hh, parser->sig_cache, sc, sctmp) {
+		HASH_DEL (parser->sig_cache, sc);
+		free (sc);
+	}
+	ucl_parser_free_pending_includes (parser);
+	ucl_include_track_free (parser->tracked);
 	LL_FOREACH_SAFE (parser->variables, var, vtmp) {
 		free (var->value);
 		free (var->var);
 		UCL_FREE (sizeof (struct ucl_variable), var);
 	}
 	LL_FOREACH_SAFE (parser->trash_objs, tr, trtmp) {
-		ucl_object_free_internal (tr, false, ucl_object_dtor_free);
+		/* Values might be containers, so release them recursively */
+		tr->next = NULL;
+		ucl_object_free_internal (tr, false, ucl_object_dtor_unref);
 	}
 
 	if (parser->err != NULL) {
@@ -523,9 +766,115 @@ ucl_parser_free (struct ucl_parser *parser)
 		ucl_object_unref (parser->comments);
 	}
 
+	free (parser->read_buf);
 	UCL_FREE (sizeof (struct ucl_parser), parser);
 }
 
+bool
+ucl_parser_reset (struct ucl_parser *parser)
+{
+	struct ucl_chunk *chunk, *ctmp;
+	ucl_object_t *tr, *trtmp;
+
+	if (parser == NULL) {
+		return false;
+	}
+
+	if (parser->top_obj != NULL) {
+		ucl_object_unref (parser->top_obj);
+		parser->top_obj = NULL;
+	}
+
+	while (parser->stack != NULL) {
+		ucl_parser_stack_pop (parser);
+	}
+	ucl_parser_free_pending_includes (parser);
+	ucl_include_track_free (parser->tracked);
+	parser->tracked = NULL;
+	parser->cur_track = NULL;
+	LL_FOREACH_SAFE (parser->chunks, chunk, ctmp) {
+		ucl_backing_unref (chunk->backing);
+		UCL_FREE (sizeof (struct ucl_chunk), chunk);
+	}
+	LL_FOREACH_SAFE (parser->trash_objs, tr, trtmp) {
+		tr->next = NULL;
+		ucl_object_free_internal (tr, false, ucl_object_dtor_unref);
+	}
+
+	parser->chunks = NULL;
+	parser->trash_objs = NULL;
+	parser->cur_obj = NULL;
+	parser->proj_next = NULL;
+	parser->skip_value = false;
+	parser->recursion = 0;
+	parser->suspended = false;
+	parser->state = UCL_STATE_INIT;
+	parser->prev_state = UCL_STATE_INIT;
+	ucl_parser_clear_error (parser);
+
+	if (parser->cur_file) {
+		free (parser->cur_file);
+		parser->cur_file = NULL;
+	}
+
+	if (parser->comments) {
+		ucl_object_unref (parser->comments);
+		parser->comments = ucl_object_typed_new (UCL_OBJECT);
+	}
+
+	parser->last_comment = NULL;
+
+	return true;
+}
+
+/* Parsers cached by the current thread, see ucl_parser_pool_get */
+static UCL_THREAD_LOCAL struct ucl_parser *ucl_parser_pool[UCL_PARSER_POOL_SIZE];
+static UCL_THREAD_LOCAL unsigned int ucl_parser_pool_len;
+
+struct ucl_parser *
+ucl_parser_pool_get (int flags)
+{
+	struct ucl_parser *parser;
+	unsigned int i;
+
+	for (i = ucl_parser_pool_len; i > 0; i --) {
+		parser = ucl_parser_pool[i - 1];
+
+		if (parser->flags == flags) {
+			ucl_parser_pool[i - 1] = ucl_parser_pool[-- ucl_parser_pool_len];
+
+			return parser;
+		}
+	}
+
+	return ucl_parser_new (flags);
+}
+
+void
+ucl_parser_pool_put (struct ucl_parser *parser)
+{
+	if (parser == NULL) {
+		return;
+	}
+
+	if (ucl_parser_pool_len == UCL_PARSER_POOL_SIZE) {
+		ucl_parser_free (parser);
+		return;
+	}
+
+	ucl_parser_reset (parser);
+	ucl_parser_reset_config (parser);
+	ucl_parser_pool[ucl_parser_pool_len ++] = parser;
+}
+
+void
+ucl_parser_pool_drain (void)
+{
+	while (ucl_parser_pool_len > 0) {
+		ucl_parser_free (ucl_parser_pool[-- ucl_parser_pool_len]);
+	}
+}
+
 const char *
 ucl_parser_get_error(struct ucl_parser *parser)
 {
@@ -557,6 +906,8 @@ ucl_parser_get_column(struct ucl_parser *parser)
 		return 0;
 	}
 
+	ucl_chunk_position (parser->chunks);
+
 	return parser->chunks->column;
 }
 
@@ -567,6 +918,8 @@ ucl_parser_get_linenum(struct ucl_parser *parser)
 		return 0;
 	}
 
+	ucl_chunk_position (parser->chunks);
+
 	return parser->chunks->line;
 }
 
@@ -600,7 +953,7 @@ ucl_pubkey_add (struct ucl_parser *parser, const unsigned char *key, size_t len)
 		ucl_create_err (&parser->err, "cannot allocate memory for key");
 		return false;
 	}
-	nkey->key = PEM_read_bio_PUBKEY (mem, &nkey->key, NULL, NULL);
+	nkey->key = PEM_read_bio_PUBKEY (mem, NULL, NULL, NULL);
 	BIO_free (mem);
 	if (nkey->key == NULL) {
 		UCL_FREE (sizeof (struct ucl_pubkey), nkey);
@@ -618,6 +971,7 @@ ucl_pubkey_add (struct ucl_parser *parser, const unsigned char *key, size_t len)
 struct ucl_curl_cbdata {
 	unsigned char *buf;
 	size_t buflen;
+	char *etag;
 };
 
 static size_t
@@ -637,6 +991,55 @@ ucl_curl_write_callback (void* contents, size_t size, size_t nmemb, void* ud)
 
 	return realsize;
 }
+
+static size_t
+ucl_curl_header_callback (char *contents, size_t size, size_t nmemb, void *ud)
+{
+	struct ucl_curl_cbdata *cbdata = ud;
+	size_t realsize = size * nmemb;
+	const char *p = contents + sizeof ("etag:") - 1, *end = contents + realsize;
+
+	if (realsize >= sizeof ("HTTP/") - 1 && memcmp (contents, "HTTP/", 5) == 0) {
+		/* Headers of another response follow a redirect */
+		free (cbdata->etag);
+		cbdata->etag = NULL;
+	}
+	else if (realsize >= sizeof ("etag:") - 1 &&
+			strncasecmp (contents, "etag:", 5) == 0) {
+		while (p < end && isspace ((unsigned char)*p)) {
+			p ++;
+		}
+		while (end > p && isspace ((unsigned char)*(end - 1))) {
+			end --;
+		}
+
+		free (cbdata->etag);
+		cbdata->etag = malloc (end - p + 1);
+		if (cbdata->etag != NULL) {
+			memcpy (cbdata->etag, p, end - p);
+			cbdata->etag[end - p] = '\0';
+		}
+	}
+
+	return realsize;
+}
+#endif
+
+#if defined(HAVE_FETCH_H) || defined(CURL_FOUND)
+/*
+ * Return a cached document instead of fetching it
+ */
+static bool
+ucl_fetch_url_cached (struct ucl_url_cache_entry *cached,
+		unsigned char **buf, size_t *buflen)
+{
+	*buf = cached->body;
+	*buflen = cached->len;
+	cached->body = NULL;
+	ucl_url_cache_entry_free (cached);
+
+	return true;
+}
 #endif
 
 /**
@@ -651,19 +1054,32 @@ bool
 ucl_fetch_url (const unsigned char *url, unsigned char **buf, size_t *buflen,
 		UT_string **err, bool must_exist)
 {
-
 #ifdef HAVE_FETCH_H
 	struct url *fetch_url;
 	struct url_stat us;
+	struct ucl_url_cache_entry cached;
+	bool have_cached;
 	FILE *in;
 
+	have_cached = ucl_url_cache_load (url, &cached);
 	fetch_url = fetchParseURL (url);
 	if (fetch_url == NULL) {
 		ucl_create_err (err, "invalid URL %s: %s",
 				url, strerror (errno));
+		if (have_cached) {
+			ucl_url_cache_entry_free (&cached);
+		}
 		return false;
 	}
-	if ((in = fetchXGet (fetch_url, &us, "")) == NULL) {
+	if (have_cached && cached.mtime >= 0) {
+		fetch_url->ims_time = cached.mtime;
+	}
+	if ((in = fetchXGet (fetch_url, &us, have_cached ? "i" : "")) == NULL) {
+		if (have_cached) {
+			/* Either not modified or the server cannot be reached */
+			fetchFreeURL (fetch_url);
+			return ucl_fetch_url_cached (&cached, buf, buflen);
+		}
 		if (!must_exist) {
 			ucl_create_err (err, "cannot fetch URL %s: %s",
 				url, strerror (errno));
@@ -671,6 +1087,9 @@ ucl_fetch_url (const unsigned char *url, unsigned char **buf, size_t *buflen,
 		fetchFreeURL (fetch_url);
 		return false;
 	}
+	if (have_cached) {
+		ucl_url_cache_entry_free (&cached);
+	}
 
 	*buflen = us.size;
 	*buf = malloc (*buflen);
@@ -690,40 +1109,104 @@ ucl_fetch_url (const unsigned char *url, unsigned char **buf, size_t *buflen,
 		return false;
 	}
 
+	fclose (in);
 	fetchFreeURL (fetch_url);
+	ucl_url_cache_store (url, *buf, *buflen, NULL, us.mtime);
+
 	return true;
 #elif defined(CURL_FOUND)
 	CURL *curl;
 	int r;
+	long code = 0, filetime = -1, unmet = 0;
 	struct ucl_curl_cbdata cbdata;
+	struct ucl_url_cache_entry cached;
+	struct curl_slist *headers = NULL;
+	char *hdr;
+	bool have_cached;
 
+	have_cached = ucl_url_cache_load (url, &cached);
 	curl = curl_easy_init ();
 	if (curl == NULL) {
 		ucl_create_err (err, "CURL interface is broken");
+		if (have_cached) {
+			ucl_url_cache_entry_free (&cached);
+		}
 		return false;
 	}
 	if ((r = curl_easy_setopt (curl, CURLOPT_URL, url)) != CURLE_OK) {
 		ucl_create_err (err, "invalid URL %s: %s",
 				url, curl_easy_strerror (r));
 		curl_easy_cleanup (curl);
+		if (have_cached) {
+			ucl_url_cache_entry_free (&cached);
+		}
 		return false;
 	}
 	curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, ucl_curl_write_callback);
+	curl_easy_setopt (curl, CURLOPT_HEADERFUNCTION, ucl_curl_header_callback);
 	cbdata.buf = NULL;
 	cbdata.buflen = 0;
+	cbdata.etag = NULL;
 	curl_easy_setopt (curl, CURLOPT_WRITEDATA, &cbdata);
+	curl_easy_setopt (curl, CURLOPT_HEADERDATA, &cbdata);
+	curl_easy_setopt (curl, CURLOPT_FILETIME, 1L);
+
+	if (have_cached) {
+		/* Revalidate the cached copy */
+		if (cached.etag != NULL) {
+			hdr = malloc (strlen (cached.etag) + sizeof ("If-None-Match: "));
+			if (hdr != NULL) {
+				sprintf (hdr, "If-None-Match: %s", cached.etag);
+				headers = curl_slist_append (headers, hdr);
+				free (hdr);
+				curl_easy_setopt (curl, CURLOPT_HTTPHEADER, headers);
+			}
+		}
+		if (cached.mtime >= 0) {
+			curl_easy_setopt (curl, CURLOPT_TIMECONDITION,
+					(long)CURL_TIMECOND_IFMODSINCE);
+			curl_easy_setopt (curl, CURLOPT_TIMEVALUE, (long)cached.mtime);
+		}
+	}
 
-	if ((r = curl_easy_perform (curl)) != CURLE_OK) {
-		if (!must_exist) {
-			ucl_create_err (err, "error fetching URL %s: %s",
-				url, curl_easy_strerror (r));
+	if ((r = curl_easy_perform (curl)) == CURLE_OK) {
+		curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &code);
+		curl_easy_getinfo (curl, CURLINFO_FILETIME, &filetime);
+		curl_easy_getinfo (curl, CURLINFO_CONDITION_UNMET, &unmet);
+	}
+	curl_easy_cleanup (curl);
+	curl_slist_free_all (headers);
+
+	/*
+	 * Protocols without status codes (e.g. file://) report zero, anything
+	 * but a 2xx status is not the document itself
+	 */
+	if (r != CURLE_OK || unmet || (code != 0 && (code < 200 || code > 299))) {
+		free (cbdata.buf);
+		free (cbdata.etag);
+
+		if (have_cached) {
+			/* Either not modified or the server cannot be reached */
+			return ucl_fetch_url_cached (&cached, buf, buflen);
 		}
-		curl_easy_cleanup (curl);
-		if (cbdata.buf) {
-			free (cbdata.buf);
+		if (!must_exist) {
+			if (r != CURLE_OK) {
+				ucl_create_err (err, "error fetching URL %s: %s",
+					url, curl_easy_strerror (r));
+			}
+			else {
+				ucl_create_err (err, "error fetching URL %s: status %ld",
+					url, code);
+			}
 		}
 		return false;
 	}
+	if (have_cached) {
+		ucl_url_cache_entry_free (&cached);
+	}
+	ucl_url_cache_store (url, cbdata.buf, cbdata.buflen, cbdata.etag,
+			filetime);
+	free (cbdata.etag);
 	*buf = cbdata.buf;
 	*buflen = cbdata.buflen;
 
@@ -734,17 +1217,86 @@ ucl_fetch_url (const unsigned char *url, unsigned char **buf, size_t *buflen,
 #endif
 }
 
+/**
+ * Hint the kernel that a mapped file is going to be read sequentially
+ */
+static void
+ucl_map_readahead (void *map, size_t len)
+{
+#ifdef MADV_SEQUENTIAL
+	(void)madvise (map, len, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+	(void)madvise (map, len, MADV_WILLNEED);
+#endif
+}
+
+/**
+ * Read a descriptor till the end of file, the buffer is grown as needed
+ * @param fd descriptor
+ * @param buf buffer, may be NULL initially
+ * @param bufsize size of the buffer
+ * @param len number of bytes read
+ * @param err error
+ * @return true on success
+ */
+static bool
+ucl_read_fd (int fd, unsigned char **buf, size_t *bufsize, size_t *len,
+		UT_string **err)
+{
+	unsigned char *nbuf;
+	size_t nsize;
+	ssize_t r;
+
+	*len = 0;
+
+	for (;;) {
+		if (*len == *bufsize) {
+			nsize = *bufsize > 0 ? *bufsize * 2 : UCL_READ_BUFFER_SIZE;
+			nbuf = realloc (*buf, nsize);
+
+			if (nbuf == NULL) {
+				ucl_create_err (err, "cannot allocate %zu bytes to read fd %d",
+						nsize, fd);
+				return false;
+			}
+
+			*buf = nbuf;
+			*bufsize = nsize;
+		}
+
+		r = read (fd, *buf + *len, *bufsize - *len);
+
+		if (r == 0) {
+			break;
+		}
+		else if (r == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			ucl_create_err (err, "cannot read fd %d: %s", fd, strerror (errno));
+			return false;
+		}
+
+		*len += r;
+	}
+
+	return true;
+}
+
 /**
  * Fetch a file and save results to the memory buffer
  * @param filename filename to fetch
  * @param len length of filename
  * @param buf target buffer
  * @param buflen target length
+ * @param fst if not NULL, filled with the status of the file that was mapped
  * @return
  */
 bool
 ucl_fetch_file (const unsigned char *filename, unsigned char **buf, size_t *buflen,
-		UT_string **err, bool must_exist)
+		struct stat *fst, UT_string **err, bool must_exist)
 {
 	int fd;
 	struct stat st;
@@ -767,6 +1319,13 @@ ucl_fetch_file (const unsigned char *filename, unsigned char **buf, size_t *bufl
 					filename, strerror (errno));
 			return false;
 		}
+		/* The file could have been replaced since stat */
+		if (fstat (fd, &st) == -1) {
+			close (fd);
+			ucl_create_err (err, "cannot stat file %s: %s",
+					filename, strerror (errno));
+			return false;
+		}
 		if ((*buf = ucl_mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
 			close (fd);
 			ucl_create_err (err, "cannot mmap file %s: %s",
@@ -774,25 +1333,34 @@ ucl_fetch_file (const unsigned char *filename, unsigned char **buf, size_t *bufl
 			return false;
 		}
 		*buflen = st.st_size;
+		ucl_map_readahead (*buf, *buflen);
 		close (fd);
 	}
 
+	if (fst != NULL) {
+		memcpy (fst, &st, sizeof (st));
+	}
+
 	return true;
 }
 
 
 #if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
-static inline bool
-ucl_sig_check (const unsigned char *data, size_t datalen,
+/**
+ * Check a signature of the data hashed with `sign_ctx`, the context is
+ * destroyed
+ */
+static bool
+ucl_sig_verify (EVP_MD_CTX *sign_ctx,
 		const unsigned char *sig, size_t siglen, struct ucl_parser *parser)
 {
 	struct ucl_pubkey *key;
-	char dig[EVP_MAX_MD_SIZE];
+	unsigned char dig[EVP_MAX_MD_SIZE];
 	unsigned int diglen;
 	EVP_PKEY_CTX *key_ctx;
-	EVP_MD_CTX *sign_ctx = NULL;
 
-	sign_ctx = EVP_MD_CTX_create ();
+	EVP_DigestFinal (sign_ctx, dig, &diglen);
+	EVP_MD_CTX_destroy (sign_ctx);
 
 	LL_FOREACH (parser->keys, key) {
 		key_ctx = EVP_PKEY_CTX_new (key->key, NULL);
@@ -809,23 +1377,72 @@ ucl_sig_check (const unsigned char *data, size_t datalen,
 				EVP_PKEY_CTX_free (key_ctx);
 				continue;
 			}
-			EVP_DigestInit (sign_ctx, EVP_sha256 ());
-			EVP_DigestUpdate (sign_ctx, data, datalen);
-			EVP_DigestFinal (sign_ctx, dig, &diglen);
-
 			if (EVP_PKEY_verify (key_ctx, sig, siglen, dig, diglen) == 1) {
-				EVP_MD_CTX_destroy (sign_ctx);
 				EVP_PKEY_CTX_free (key_ctx);
 				return true;
 			}
 
-			EVP_PKEY_CTX_free (key_ctx);
+			EVP_PKEY_CTX_free (key_ctx);
+		}
+	}
+
+	return false;
+}
+
+static inline bool
+ucl_sig_check (const unsigned char *data, size_t datalen,
+		const unsigned char *sig, size_t siglen, struct ucl_parser *parser)
+{
+	EVP_MD_CTX *sign_ctx;
+
+	sign_ctx = EVP_MD_CTX_create ();
+	EVP_DigestInit (sign_ctx, EVP_sha256 ());
+	EVP_DigestUpdate (sign_ctx, data, datalen);
+
+	return ucl_sig_verify (sign_ctx, sig, siglen, parser);
+}
+
+static void
+ucl_file_id_fill (struct ucl_file_id *id, const struct stat *st)
+{
+	id->dev = st->st_dev;
+	id->ino = st->st_ino;
+	id->size = st->st_size;
+	id->ctime = st->st_ctime;
+#if defined(__APPLE__)
+	id->ctime_nsec = st->st_ctimespec.tv_nsec;
+#elif defined(_WIN32)
+	id->ctime_nsec = 0;
+#else
+	id->ctime_nsec = st->st_ctim.tv_nsec;
+#endif
+}
+
+/**
+ * Find whether a file with its signature has been verified already
+ */
+static bool
+ucl_sig_cache_find (struct ucl_parser *parser, const struct stat *st,
+		const struct stat *sig_st, bool add)
+{
+	struct ucl_sig_cache *elt, search;
+
+	memset (&search, 0, sizeof (search));
+	ucl_file_id_fill (&search.id.file, st);
+	ucl_file_id_fill (&search.id.sig, sig_st);
+	HASH_FIND (hh, parser->sig_cache, &search.id, sizeof (search.id), elt);
+
+	if (elt == NULL && add && parser->sig_cache_count < UCL_SIG_CACHE_MAX) {
+		elt = malloc (sizeof (*elt));
+
+		if (elt != NULL) {
+			memcpy (elt, &search, sizeof (*elt));
+			HASH_ADD (hh, parser->sig_cache, id, sizeof (elt->id), elt);
+			parser->sig_cache_count ++;
 		}
 	}
 
-	EVP_MD_CTX_destroy (sign_ctx);
-
-	return false;
+	return elt != NULL;
 }
 #endif
 
@@ -841,8 +1458,132 @@ struct ucl_include_params {
 	enum ucl_parse_type parse_type;
 	const char *prefix;
 	const char *target;
+	unsigned char *data; /* Contents supplied by an include fetcher */
+	size_t datalen;
 };
 
+static void
+ucl_backing_munmap (void *data, size_t len)
+{
+	if (len > 0) {
+		ucl_munmap (data, len);
+	}
+}
+
+static void
+ucl_backing_free (void *data, size_t len)
+{
+	free (data);
+}
+
+/**
+ * Parse a buffer owned by the parser from now on, `dtor` releases it.
+ * Compressed buffers are replaced with the decompressed data. In
+ * zero-copy mode the buffer lives until the last container that refers to it
+ * is freed, otherwise it is released right after parsing: strings and nested
+ * containers must be parsed immediately even in lazy modes
+ */
+static bool
+ucl_parser_add_transient_chunk (struct ucl_parser *parser,
+		unsigned char *data, size_t len, void (*dtor) (void *, size_t),
+		unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
+{
+	int flags = parser->flags & (UCL_PARSER_LAZY_UNESCAPE|UCL_PARSER_ZEROCOPY);
+	unsigned lazy_depth = parser->lazy_depth;
+	struct ucl_backing *backing = NULL;
+	enum ucl_compression_type ctype;
+	unsigned char *dbuf;
+	size_t dlen;
+	bool res;
+
+	ctype = ucl_compression_detect (data, len);
+
+	if (ctype != UCL_COMPRESSION_NONE) {
+		/* Compressed input is not needed once decompressed */
+		res = ucl_decompress (ctype, data, len, parser->max_decompressed,
+				&dbuf, &dlen, &parser->err);
+		dtor (data, len);
+
+		if (!res) {
+			return false;
+		}
+
+		data = dbuf;
+		len = dlen;
+		dtor = ucl_backing_free;
+	}
+
+	if (len > 0 && (parser->flags & UCL_PARSER_ZEROCOPY)) {
+		backing = ucl_backing_new (data, len, dtor);
+	}
+	if (backing == NULL) {
+		parser->flags &= ~(UCL_PARSER_LAZY_UNESCAPE|UCL_PARSER_ZEROCOPY);
+	}
+	/* Deferred containers do not hold the backing store */
+	parser->lazy_depth = 0;
+	res = ucl_parser_add_backed_chunk (parser, data, len, priority, strat,
+			parse_type, backing);
+	parser->flags |= flags;
+	parser->lazy_depth = lazy_depth;
+
+	if (backing != NULL) {
+		ucl_backing_unref (backing);
+	}
+	else {
+		dtor (data, len);
+	}
+
+	return res;
+}
+
+static void
+ucl_backing_keep (void *data, size_t len)
+{
+}
+
+/**
+ * Read a descriptor that cannot be mapped, e.g. a pipe or a socket, and parse
+ * it. Unless the data is owned by the parsed objects, the read buffer is kept
+ * for the next read
+ */
+static bool
+ucl_parser_add_stream (struct ucl_parser *parser, int fd, unsigned priority,
+		enum ucl_duplicate_strategy strat, enum ucl_parse_type parse_type)
+{
+	unsigned char *buf = parser->read_buf;
+	size_t bufsize = parser->read_buf_size, len;
+	bool ret;
+
+	/* Nested reads allocate their own buffers */
+	parser->read_buf = NULL;
+	parser->read_buf_size = 0;
+
+	if (!ucl_read_fd (fd, &buf, &bufsize, &len, &parser->err)) {
+		free (buf);
+
+		return false;
+	}
+
+	if (len > 0 && (parser->flags & UCL_PARSER_ZEROCOPY)) {
+		return ucl_parser_add_transient_chunk (parser, buf, len,
+				ucl_backing_free, priority, strat, parse_type);
+	}
+
+	ret = ucl_parser_add_transient_chunk (parser, buf, len, ucl_backing_keep,
+			priority, strat, parse_type);
+
+	if (parser->read_buf == NULL && bufsize <= UCL_READ_BUFFER_KEEP_MAX) {
+		parser->read_buf = buf;
+		parser->read_buf_size = bufsize;
+	}
+	else {
+		free (buf);
+	}
+
+	return ret;
+}
+
 /**
  * Include an url to configuration
  * @param data
@@ -866,7 +1607,12 @@ ucl_include_url (const unsigned char *data, size_t len,
 
 	snprintf (urlbuf, sizeof (urlbuf), "%.*s", (int)len, data);
 
-	if (!ucl_fetch_url (urlbuf, &buf, &buflen, &parser->err, params->must_exist)) {
+	if (params->data != NULL) {
+		buf = params->data;
+		buflen = params->datalen;
+	}
+	else if (!ucl_fetch_url (urlbuf, &buf, &buflen, &parser->err,
+			params->must_exist)) {
 		return !params->must_exist;
 	}
 
@@ -897,19 +1643,20 @@ ucl_include_url (const unsigned char *data, size_t len,
 	prev_state = parser->state;
 	parser->state = UCL_STATE_INIT;
 
-	res = ucl_parser_add_chunk_full (parser, buf, buflen, params->priority,
-			params->strat, params->parse_type);
+	res = ucl_parser_add_transient_chunk (parser, buf, buflen,
+			ucl_backing_free, params->priority, params->strat,
+			params->parse_type);
 	if (res == true) {
 		/* Remove chunk from the stack */
 		chunk = parser->chunks;
 		if (chunk != NULL) {
 			parser->chunks = chunk->next;
+			ucl_backing_unref (chunk->backing);
 			UCL_FREE (sizeof (struct ucl_chunk), chunk);
 		}
 	}
 
 	parser->state = prev_state;
-	free (buf);
 
 	return res;
 }
@@ -930,10 +1677,17 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 		struct ucl_parser *parser, struct ucl_include_params *params)
 {
 	bool res;
-	struct ucl_chunk *chunk;
+	struct ucl_chunk *chunk, *parent_chunk;
 	unsigned char *buf = NULL;
 	char *old_curfile, *ext;
 	size_t buflen = 0;
+	struct stat fst;
+	void (*dtor) (void *, size_t) = ucl_backing_munmap;
+#if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
+	unsigned char *sigbuf = NULL;
+	size_t siglen = 0;
+	struct stat sig_st;
+#endif
 	char filebuf[PATH_MAX], realbuf[PATH_MAX];
 	int prev_state;
 	struct ucl_variable *cur_var, *tmp_var, *old_curdir = NULL,
@@ -941,13 +1695,23 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 	ucl_object_t *nest_obj = NULL, *old_obj = NULL, *new_obj = NULL;
 	ucl_hash_t *container = NULL;
 	struct ucl_stack *st = NULL;
+	struct ucl_include_track *track = NULL;
 
 	snprintf (filebuf, sizeof (filebuf), "%.*s", (int)len, data);
-	if (ucl_realpath (filebuf, realbuf) == NULL) {
+	if (params->data != NULL) {
+		ucl_strlcpy (realbuf, filebuf, sizeof (realbuf));
+		buf = params->data;
+		buflen = params->datalen;
+		dtor = ucl_backing_free;
+	}
+	else if (ucl_realpath (filebuf, realbuf) == NULL) {
 		if (params->soft_fail) {
 			return false;
 		}
 		if (!params->must_exist) {
+			if (parser->track_includes) {
+				ucl_include_track_pattern (parser, filebuf);
+			}
 			return true;
 		}
 		ucl_create_err (&parser->err, "cannot open file %s: %s",
@@ -958,6 +1722,7 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 
 	if (parser->cur_file && strcmp (realbuf, parser->cur_file) == 0) {
 		/* We are likely including the file itself */
+		dtor (buf, buflen);
 		if (params->soft_fail) {
 			return false;
 		}
@@ -967,7 +1732,8 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 		return false;
 	}
 
-	if (!ucl_fetch_file (realbuf, &buf, &buflen, &parser->err, params->must_exist)) {
+	if (params->data == NULL && !ucl_fetch_file (realbuf, &buf, &buflen, &fst,
+			&parser->err, params->must_exist)) {
 		if (params->soft_fail) {
 			return false;
 		}
@@ -976,25 +1742,34 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 
 	if (params->check_signature) {
 #if (defined(HAVE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10000000L)
-		unsigned char *sigbuf = NULL;
-		size_t siglen = 0;
-		/* We need to check signature first */
 		snprintf (filebuf, sizeof (filebuf), "%s.sig", realbuf);
-		if (!ucl_fetch_file (filebuf, &sigbuf, &siglen, &parser->err, true)) {
+		if (!ucl_fetch_file (filebuf, &sigbuf, &siglen, &sig_st,
+				&parser->err, true)) {
+			dtor (buf, buflen);
 			return false;
 		}
-		if (!ucl_sig_check (buf, buflen, sigbuf, siglen, parser)) {
-			ucl_create_err (&parser->err, "cannot verify file %s: %s",
-							filebuf,
-							ERR_error_string (ERR_get_error (), NULL));
-			if (siglen > 0) {
-				ucl_munmap (sigbuf, siglen);
+		/*
+		 * Nothing from the file may be parsed before the signature is checked,
+		 * unless both files are unchanged since they were verified. Hashing is
+		 * not overlapped with parsing: macros and nested includes run while
+		 * the file is parsed and may depend on each other's effects, so they
+		 * cannot be deferred until the end of a detached parse
+		 */
+		if (params->data != NULL ||
+				!ucl_sig_cache_find (parser, &fst, &sig_st, false)) {
+			if (!ucl_sig_check (buf, buflen, sigbuf, siglen, parser)) {
+				ucl_create_err (&parser->err, "cannot verify file %s: %s",
+						realbuf,
+						ERR_error_string (ERR_get_error (), NULL));
+				ucl_backing_munmap (sigbuf, siglen);
+				dtor (buf, buflen);
+				return false;
+			}
+			if (params->data == NULL) {
+				ucl_sig_cache_find (parser, &fst, &sig_st, true);
 			}
-			return false;
-		}
-		if (siglen > 0) {
-			ucl_munmap (sigbuf, siglen);
 		}
+		ucl_backing_munmap (sigbuf, siglen);
 #endif
 	}
 
@@ -1005,11 +1780,11 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 	DL_FOREACH_SAFE (parser->variables, cur_var, tmp_var) {
 		if (strcmp (cur_var->var, "CURDIR") == 0) {
 			old_curdir = cur_var;
-			DL_DELETE (parser->variables, cur_var);
+			ucl_parser_variable_remove (parser, cur_var);
 		}
 		else if (strcmp (cur_var->var, "FILENAME") == 0) {
 			old_filename = cur_var;
-			DL_DELETE (parser->variables, cur_var);
+			ucl_parser_variable_remove (parser, cur_var);
 		}
 	}
 
@@ -1033,6 +1808,12 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 
 		old_obj = __DECONST (ucl_object_t *, ucl_hash_search (container,
 				params->prefix, strlen (params->prefix)));
+		/* Included data may be merged into a deferred container */
+		ucl_container_materialize (old_obj);
+
+		if (old_obj != NULL && parser->track_includes) {
+			ucl_include_track_dup (parser, parser->stack->obj, old_obj);
+		}
 
 		if (strcasecmp (params->target, "array") == 0 && old_obj == NULL) {
 			/* Create an array with key: prefix */
@@ -1059,9 +1840,7 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 
 			if (nest_obj == NULL) {
 				ucl_create_err (&parser->err, "cannot allocate memory for an object");
-				if (buflen > 0) {
-					ucl_munmap (buf, buflen);
-				}
+				dtor (buf, buflen);
 
 				return false;
 			}
@@ -1083,9 +1862,7 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 				nest_obj = ucl_object_new_full (UCL_OBJECT, params->priority);
 				if (nest_obj == NULL) {
 					ucl_create_err (&parser->err, "cannot allocate memory for an object");
-					if (buflen > 0) {
-						ucl_munmap (buf, buflen);
-					}
+					dtor (buf, buflen);
 
 					return false;
 				}
@@ -1099,9 +1876,7 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 				new_obj = ucl_object_typed_new (UCL_ARRAY);
 				if (new_obj == NULL) {
 					ucl_create_err (&parser->err, "cannot allocate memory for an object");
-					if (buflen > 0) {
-						ucl_munmap (buf, buflen);
-					}
+					dtor (buf, buflen);
 
 					return false;
 				}
@@ -1114,9 +1889,7 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 				nest_obj = ucl_object_new_full (UCL_OBJECT, params->priority);
 				if (nest_obj == NULL) {
 					ucl_create_err (&parser->err, "cannot allocate memory for an object");
-					if (buflen > 0) {
-						ucl_munmap (buf, buflen);
-					}
+					dtor (buf, buflen);
 
 					return false;
 				}
@@ -1138,9 +1911,7 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 				ucl_create_err (&parser->err,
 						"Conflicting type for key: %s",
 						params->prefix);
-				if (buflen > 0) {
-					ucl_munmap (buf, buflen);
-				}
+				dtor (buf, buflen);
 
 				return false;
 			}
@@ -1150,25 +1921,37 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 		parser->stack->obj->value.ov = container;
 
 		if (nest_obj != NULL) {
-			st = UCL_ALLOC (sizeof (struct ucl_stack));
+			st = ucl_parser_stack_push (parser, nest_obj, parser->stack->level);
 			if (st == NULL) {
-				ucl_create_err (&parser->err, "cannot allocate memory for an object");
+				ucl_create_err (&parser->err, "%s", ucl_parser_stack_error (parser));
 				ucl_object_unref (nest_obj);
-				if (buflen > 0) {
-					ucl_munmap (buf, buflen);
-				}
+				dtor (buf, buflen);
 
 				return false;
 			}
-			st->obj = nest_obj;
-			st->level = parser->stack->level;
-			LL_PREPEND (parser->stack, st);
 			parser->cur_obj = nest_obj;
 		}
 	}
 
-	res = ucl_parser_add_chunk_full (parser, buf, buflen, params->priority,
-			params->strat, params->parse_type);
+	if (parser->track_includes && params->data == NULL) {
+		track = ucl_include_track_start (parser, realbuf, params->priority,
+				params->strat, params->parse_type);
+		if (track != NULL) {
+			/* Signed files are verified with their parents only */
+			track->merged |= params->check_signature;
+		}
+	}
+
+	parent_chunk = parser->chunks;
+	res = ucl_parser_add_transient_chunk (parser, buf, buflen,
+			dtor, params->priority, params->strat,
+			params->parse_type);
+
+	if (track != NULL) {
+		ucl_include_track_finish (parser, track);
+	}
+
+
 	if (!res && !params->must_exist) {
 		/* Free error */
 		utstring_free (parser->err);
@@ -1178,14 +1961,14 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 
 	/* Stop nesting the include, take 1 level off the stack */
 	if (params->prefix != NULL && nest_obj != NULL) {
-		parser->stack = st->next;
-		UCL_FREE (sizeof (struct ucl_stack), st);
+		ucl_parser_stack_pop (parser);
 	}
 
-	/* Remove chunk from the stack */
+	/* Remove chunk from the stack, it is not added if decompression fails */
 	chunk = parser->chunks;
-	if (chunk != NULL) {
+	if (chunk != NULL && chunk != parent_chunk) {
 		parser->chunks = chunk->next;
+		ucl_backing_unref (chunk->backing);
 		UCL_FREE (sizeof (struct ucl_chunk), chunk);
 		parser->recursion --;
 	}
@@ -1198,32 +1981,46 @@ ucl_include_file_single (const unsigned char *data, size_t len,
 	parser->cur_file = old_curfile;
 	DL_FOREACH_SAFE (parser->variables, cur_var, tmp_var) {
 		if (strcmp (cur_var->var, "CURDIR") == 0 && old_curdir) {
-			DL_DELETE (parser->variables, cur_var);
+			ucl_parser_variable_remove (parser, cur_var);
 			free (cur_var->var);
 			free (cur_var->value);
 			UCL_FREE (sizeof (struct ucl_variable), cur_var);
 		}
 		else if (strcmp (cur_var->var, "FILENAME") == 0 && old_filename) {
-			DL_DELETE (parser->variables, cur_var);
+			ucl_parser_variable_remove (parser, cur_var);
 			free (cur_var->var);
 			free (cur_var->value);
 			UCL_FREE (sizeof (struct ucl_variable), cur_var);
 		}
 	}
 	if (old_filename) {
-		DL_APPEND (parser->variables, old_filename);
+		ucl_parser_variable_add (parser, old_filename);
 	}
 	if (old_curdir) {
-		DL_APPEND (parser->variables, old_curdir);
+		ucl_parser_variable_add (parser, old_curdir);
 	}
 
 	parser->state = prev_state;
 
-	if (buflen > 0) {
-		ucl_munmap (buf, buflen);
+	return res;
+}
+
+/**
+ * Check whether a filename contains glob symbols
+ */
+static bool
+ucl_is_glob (const unsigned char *data, size_t len)
+{
+	const unsigned char *p = data, *end = data + len;
+
+	while (p != end) {
+		if (*p == '*' || *p == '?') {
+			return true;
+		}
+		p ++;
 	}
 
-	return res;
+	return false;
 }
 
 /**
@@ -1238,7 +2035,6 @@ static bool
 ucl_include_file (const unsigned char *data, size_t len,
 		struct ucl_parser *parser, struct ucl_include_params *params)
 {
-	const unsigned char *p = data, *end = data + len;
 	bool need_glob = false;
 	int cnt = 0;
 	char glob_pattern[PATH_MAX];
@@ -1250,18 +2046,15 @@ ucl_include_file (const unsigned char *data, size_t len,
 	}
 	else {
 		/* Check for special symbols in a filename */
-		while (p != end) {
-			if (*p == '*' || *p == '?') {
-				need_glob = true;
-				break;
-			}
-			p ++;
-		}
+		need_glob = ucl_is_glob (data, len);
 		if (need_glob) {
 			glob_t globbuf;
 			memset (&globbuf, 0, sizeof (globbuf));
 			ucl_strlcpy (glob_pattern, (const char *)data,
 				(len + 1 < sizeof (glob_pattern) ? len + 1 : sizeof (glob_pattern)));
+			if (parser->track_includes) {
+				ucl_include_track_pattern (parser, glob_pattern);
+			}
 			if (glob (glob_pattern, 0, NULL, &globbuf) != 0) {
 				return (!params->must_exist || false);
 			}
@@ -1297,6 +2090,248 @@ ucl_include_file (const unsigned char *data, size_t len,
 	return true;
 }
 
+/*
+ * Include waiting for its contents to be supplied by an include fetcher
+ */
+struct ucl_pending_include {
+	unsigned id;
+	bool is_url;
+	bool ready;
+	char *name;
+	ucl_object_t *container; /* Container where the include directive is */
+	const ucl_object_t *proj;
+	unsigned char *data; /* NULL if the include cannot be fetched */
+	size_t len;
+	struct ucl_include_params params;
+	char *prefix;
+	char *target;
+	struct ucl_pending_include *prev, *next;
+};
+
+static void
+ucl_pending_include_free (struct ucl_pending_include *inc)
+{
+	ucl_object_unref (inc->container);
+	free (inc->name);
+	free (inc->data);
+	free (inc->prefix);
+	free (inc->target);
+	free (inc);
+}
+
+void
+ucl_parser_free_pending_includes (struct ucl_parser *parser)
+{
+	struct ucl_pending_include *inc, *tmp;
+
+	DL_FOREACH_SAFE (parser->pending_includes, inc, tmp) {
+		ucl_pending_include_free (inc);
+	}
+
+	parser->pending_includes = NULL;
+}
+
+/**
+ * Parse the contents of a deferred include into the container where the
+ * include directive has been found
+ */
+static bool
+ucl_parser_apply_include (struct ucl_parser *parser,
+		struct ucl_pending_include *inc)
+{
+	struct ucl_stack *st;
+	bool res;
+
+	if (inc->data == NULL) {
+		if (inc->params.must_exist) {
+			ucl_create_err (&parser->err, "cannot fetch include %s", inc->name);
+			return false;
+		}
+
+		return true;
+	}
+
+	st = ucl_parser_stack_push (parser, inc->container,
+			parser->stack != NULL ? parser->stack->level : 0);
+	if (st == NULL) {
+		ucl_create_err (&parser->err, "%s", ucl_parser_stack_error (parser));
+		return false;
+	}
+	st->proj = inc->proj;
+
+	/* Released by the include */
+	inc->params.data = inc->data;
+	inc->params.datalen = inc->len;
+	inc->data = NULL;
+
+	if (inc->is_url) {
+		res = ucl_include_url ((const unsigned char *)inc->name,
+				strlen (inc->name), parser, &inc->params);
+	}
+	else {
+		res = ucl_include_file_single ((const unsigned char *)inc->name,
+				strlen (inc->name), parser, &inc->params);
+	}
+
+	ucl_parser_stack_pop (parser);
+
+	return res;
+}
+
+/**
+ * Ask an include fetcher for the contents of an include, the contents are
+ * parsed into the current container once supplied
+ */
+static bool
+ucl_include_defer (const unsigned char *data, size_t len,
+		struct ucl_parser *parser, struct ucl_include_params *params,
+		bool is_url)
+{
+	struct ucl_pending_include *inc;
+	bool res;
+
+	inc = calloc (1, sizeof (*inc));
+	if (inc == NULL) {
+		ucl_create_err (&parser->err, "cannot allocate memory for an include");
+		return false;
+	}
+
+	inc->id = parser->include_seq ++;
+	inc->is_url = is_url;
+	inc->name = malloc (len + 1);
+	if (inc->name != NULL) {
+		memcpy (inc->name, data, len);
+		inc->name[len] = '\0';
+	}
+	if (parser->stack != NULL) {
+		inc->container = ucl_object_ref (parser->stack->obj);
+		inc->proj = parser->stack->proj;
+	}
+	else {
+		inc->container = ucl_object_ref (parser->top_obj);
+	}
+
+	/* Arguments of the macro are released once it is handled */
+	memcpy (&inc->params, params, sizeof (*params));
+	if (params->prefix != NULL) {
+		inc->prefix = strdup (params->prefix);
+		inc->params.prefix = inc->prefix;
+	}
+	inc->target = strdup (params->target);
+	inc->params.target = inc->target;
+
+	if (inc->name == NULL || inc->container == NULL || inc->target == NULL ||
+			(params->prefix != NULL && inc->prefix == NULL)) {
+		ucl_pending_include_free (inc);
+		ucl_create_err (&parser->err, "cannot allocate memory for an include");
+		return false;
+	}
+
+	DL_APPEND (parser->pending_includes, inc);
+	parser->include_fetcher (inc->id, inc->name, is_url,
+			parser->include_fetcher_ud);
+
+	if (inc->ready && inc == parser->pending_includes) {
+		/*
+		 * Supplied by the fetcher itself and nothing is pending before it,
+		 * so parse it here as a blocking include would be
+		 */
+		DL_DELETE (parser->pending_includes, inc);
+		res = ucl_parser_apply_include (parser, inc);
+		ucl_pending_include_free (inc);
+
+		return res;
+	}
+
+	return true;
+}
+
+bool
+ucl_parser_apply_includes (struct ucl_parser *parser)
+{
+	struct ucl_pending_include *inc;
+	bool res = true;
+
+	if (parser->parse_depth > 0 || parser->suspended) {
+		/* Applied once the current chunk is parsed */
+		return true;
+	}
+
+	parser->parse_depth ++;
+
+	/* Includes are applied in order, so the result does not depend on timing */
+	while (res && (inc = parser->pending_includes) != NULL && inc->ready) {
+		DL_DELETE (parser->pending_includes, inc);
+		res = ucl_parser_apply_include (parser, inc);
+		ucl_pending_include_free (inc);
+	}
+
+	parser->parse_depth --;
+
+	return res;
+}
+
+void
+ucl_parser_set_include_fetcher (struct ucl_parser *parser,
+		ucl_include_fetcher fetcher, void *ud)
+{
+	if (parser != NULL) {
+		parser->include_fetcher = fetcher;
+		parser->include_fetcher_ud = ud;
+	}
+}
+
+bool
+ucl_parser_include_data (struct ucl_parser *parser, unsigned id,
+		const unsigned char *data, size_t len)
+{
+	struct ucl_pending_include *inc;
+
+	if (parser == NULL) {
+		return false;
+	}
+
+	DL_FOREACH (parser->pending_includes, inc) {
+		if (inc->id == id && !inc->ready) {
+			break;
+		}
+	}
+
+	if (inc == NULL) {
+		ucl_create_err (&parser->err, "include %u is not pending", id);
+		return false;
+	}
+
+	if (data != NULL) {
+		/* Terminated as numbers are parsed with strtod */
+		inc->data = malloc (len + 1);
+		if (inc->data == NULL) {
+			ucl_create_err (&parser->err, "cannot allocate memory for an include");
+			return false;
+		}
+		memcpy (inc->data, data, len);
+		inc->data[len] = '\0';
+		inc->len = len;
+	}
+
+	inc->ready = true;
+
+	return ucl_parser_apply_includes (parser);
+}
+
+unsigned
+ucl_parser_pending_includes (struct ucl_parser *parser)
+{
+	struct ucl_pending_include *inc;
+	unsigned cnt = 0;
+
+	if (parser != NULL) {
+		DL_COUNT (parser->pending_includes, inc, cnt);
+	}
+
+	return cnt;
+}
+
 /**
  * Common function to handle .*include* macros
  * @param data
@@ -1331,6 +2366,8 @@ ucl_include_common (const unsigned char *data, size_t len,
 	params.parse_type = UCL_PARSE_UCL;
 	params.strat = UCL_DUPLICATE_APPEND;
 	params.must_exist = !default_try;
+	params.data = NULL;
+	params.datalen = 0;
 
 	/* Process arguments */
 	if (args != NULL && args->type == UCL_OBJECT) {
@@ -1391,10 +2428,17 @@ ucl_include_common (const unsigned char *data, size_t len,
 
 	if (parser->includepaths == NULL) {
 		if (allow_url && ucl_strnstr (data, "://", len) != NULL) {
+			if (parser->include_fetcher != NULL && !params.check_signature) {
+				return ucl_include_defer (data, len, parser, &params, true);
+			}
 			/* Globbing is not used for URL's */
 			return ucl_include_url (data, len, parser, &params);
 		}
 		else if (data != NULL) {
+			if (parser->include_fetcher != NULL && !params.check_signature &&
+					!(params.allow_glob && ucl_is_glob (data, len))) {
+				return ucl_include_defer (data, len, parser, &params, false);
+			}
 			/* Try to load a file */
 			return ucl_include_file (data, len, parser, &params);
 		}
@@ -1639,7 +2683,7 @@ ucl_load_handler (const unsigned char *data, size_t len,
 			return false;
 		}
 
-		if (!ucl_fetch_file (load_file, &buf, &buflen, &parser->err,
+		if (!ucl_fetch_file (load_file, &buf, &buflen, NULL, &parser->err,
 				!try_load)) {
 			free (load_file);
 
@@ -1775,13 +2819,16 @@ ucl_parser_set_filevars (struct ucl_parser *parser, const char *filename, bool n
 }
 
 bool
-ucl_parser_add_file_priority (struct ucl_parser *parser, const char *filename,
-		unsigned priority)
+ucl_parser_add_file_full (struct ucl_parser *parser, const char *filename,
+		unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
 {
 	unsigned char *buf;
 	size_t len;
 	bool ret;
 	char realbuf[PATH_MAX];
+	struct stat st;
+	int fd;
 
 	if (ucl_realpath (filename, realbuf) == NULL) {
 		ucl_create_err (&parser->err, "cannot open file %s: %s",
@@ -1790,7 +2837,27 @@ ucl_parser_add_file_priority (struct ucl_parser *parser, const char *filename,
 		return false;
 	}
 
-	if (!ucl_fetch_file (realbuf, &buf, &len, &parser->err, true)) {
+	if (stat (realbuf, &st) != -1 && !S_ISDIR (st.st_mode) &&
+			(!S_ISREG (st.st_mode) || st.st_size == 0)) {
+		/* Pipes, devices and files with unknown size such as procfs ones */
+		if ((fd = open (realbuf, O_RDONLY)) == -1) {
+			ucl_create_err (&parser->err, "cannot open file %s: %s",
+					realbuf, strerror (errno));
+			return false;
+		}
+
+		if (parser->cur_file) {
+			free (parser->cur_file);
+		}
+		parser->cur_file = strdup (realbuf);
+		ucl_parser_set_filevars (parser, realbuf, false);
+		ret = ucl_parser_add_stream (parser, fd, priority, strat, parse_type);
+		close (fd);
+
+		return ret;
+	}
+
+	if (!ucl_fetch_file (realbuf, &buf, &len, NULL, &parser->err, true)) {
 		return false;
 	}
 
@@ -1799,15 +2866,20 @@ ucl_parser_add_file_priority (struct ucl_parser *parser, const char *filename,
 	}
 	parser->cur_file = strdup (realbuf);
 	ucl_parser_set_filevars (parser, realbuf, false);
-	ret = ucl_parser_add_chunk_priority (parser, buf, len, priority);
-
-	if (len > 0) {
-		ucl_munmap (buf, len);
-	}
+	ret = ucl_parser_add_transient_chunk (parser, buf, len,
+			ucl_backing_munmap, priority, strat, parse_type);
 
 	return ret;
 }
 
+bool
+ucl_parser_add_file_priority (struct ucl_parser *parser, const char *filename,
+		unsigned priority)
+{
+	return ucl_parser_add_file_full (parser, filename, priority,
+			UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
+}
+
 bool
 ucl_parser_add_file (struct ucl_parser *parser, const char *filename)
 {
@@ -1833,23 +2905,28 @@ ucl_parser_add_fd_priority (struct ucl_parser *parser, int fd,
 			fd, strerror (errno));
 		return false;
 	}
-	if ((buf = ucl_mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
-		ucl_create_err (&parser->err, "cannot mmap fd %d: %s",
-			fd, strerror (errno));
-		return false;
-	}
 
 	if (parser->cur_file) {
 		free (parser->cur_file);
 	}
 	parser->cur_file = NULL;
-	len = st.st_size;
-	ret = ucl_parser_add_chunk_priority (parser, buf, len, priority);
 
-	if (len > 0) {
-		ucl_munmap (buf, len);
+	if (!S_ISREG (st.st_mode) || st.st_size == 0) {
+		return ucl_parser_add_stream (parser, fd, priority,
+				UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
+	}
+
+	if ((buf = ucl_mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		ucl_create_err (&parser->err, "cannot mmap fd %d: %s",
+			fd, strerror (errno));
+		return false;
 	}
 
+	len = st.st_size;
+	ucl_map_readahead (buf, len);
+	ret = ucl_parser_add_transient_chunk (parser, buf, len,
+			ucl_backing_munmap, priority, UCL_DUPLICATE_APPEND, UCL_PARSE_UCL);
+
 	return ret;
 }
 
@@ -2097,7 +3174,12 @@ ucl_object_insert_key_common (ucl_object_t *top, ucl_object_t *elt,
 		return false;
 	}
 
-	if (top == NULL) {
+	if (top == NULL || (top->flags & UCL_OBJECT_SEALED)) {
+		return false;
+	}
+
+	if (elt->flags & UCL_OBJECT_SEALED) {
+		/* Key and links of elt are rewritten below, sealed trees are shared */
 		return false;
 	}
 
@@ -2112,6 +3194,8 @@ ucl_object_insert_key_common (ucl_object_t *top, ucl_object_t *elt,
 		}
 	}
 
+	ucl_container_materialize (top);
+
 	if (top->value.ov == NULL) {
 		top->value.ov = ucl_hash_create (false);
 	}
@@ -2152,6 +3236,10 @@ ucl_object_insert_key_common (ucl_object_t *top, ucl_object_t *elt,
 			ret = false;
 		}
 	}
+	else if (!replace && (found->flags & UCL_OBJECT_SEALED)) {
+		/* Cannot append to or merge with a sealed element */
+		ret = false;
+	}
 	else {
 		if (replace) {
 			ucl_hash_replace (top->value.ov, found, elt);
@@ -2197,7 +3285,7 @@ ucl_object_delete_keyl (ucl_object_t *top, const char *key, size_t keylen)
 {
 	ucl_object_t *found;
 
-	if (top == NULL || key == NULL) {
+	if (top == NULL || key == NULL || (top->flags & UCL_OBJECT_SEALED)) {
 		return false;
 	}
 
@@ -2225,8 +3313,8 @@ ucl_object_pop_keyl (ucl_object_t *top, const char *key, size_t keylen)
 {
 	const ucl_object_t *found;
 
-	if (top == NULL || key == NULL) {
-		return false;
+	if (top == NULL || key == NULL || (top->flags & UCL_OBJECT_SEALED)) {
+		return NULL;
 	}
 	found = ucl_object_lookup_len (top, key, keylen);
 
@@ -2272,10 +3360,14 @@ ucl_object_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
 	ucl_object_t *cur = NULL, *cp = NULL, *found = NULL;
 	ucl_object_iter_t iter = NULL;
 
-	if (top == NULL || top->type != UCL_OBJECT || elt == NULL || elt->type != UCL_OBJECT) {
+	if (top == NULL || top->type != UCL_OBJECT || elt == NULL ||
+			elt->type != UCL_OBJECT || (top->flags & UCL_OBJECT_SEALED)) {
 		return false;
 	}
 
+	ucl_container_materialize (top);
+	ucl_container_materialize (elt);
+
 	/* Mix two hashes */
 	while ((cur = (ucl_object_t*)ucl_hash_iterate (elt->value.ov, &iter))) {
 		if (copy) {
@@ -2297,6 +3389,9 @@ ucl_object_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
 		}
 	}
 
+	/* Merged elements may have their keys in the buffers of elt */
+	ucl_object_share_backings (top, elt);
+
 	return true;
 }
 
@@ -2310,6 +3405,7 @@ ucl_object_lookup_len (const ucl_object_t *obj, const char *key, size_t klen)
 		return NULL;
 	}
 
+	ucl_container_materialize (obj);
 	srch.key = key;
 	srch.keylen = klen;
 	ret = ucl_hash_search_obj (obj->value.ov, &srch);
@@ -2373,14 +3469,21 @@ ucl_object_iterate (const ucl_object_t *obj, ucl_object_iter_t *iter, bool expan
 	if (expand_values) {
 		switch (obj->type) {
 		case UCL_OBJECT:
+			ucl_container_materialize (obj);
 			return (const ucl_object_t*)ucl_hash_iterate (obj->value.ov, iter);
 			break;
 		case UCL_ARRAY: {
 			unsigned int idx;
-			UCL_ARRAY_GET (vec, obj);
+			UCL_ARRAY_GET_RAW (vec, obj);
 			idx = (unsigned int)(uintptr_t)(*iter);
 
-			if (vec != NULL) {
+			if (vec != NULL && vec->packed != NULL) {
+				/* Packed arrays are not unpacked by readers */
+				if ((elt = ucl_array_elt_view (obj, idx)) != NULL) {
+					*iter = (void *)(uintptr_t)(idx + 1);
+				}
+			}
+			else if (vec != NULL) {
 				while (idx < kv_size (*vec)) {
 					if ((elt = kv_A (*vec, idx)) != NULL) {
 						idx ++;
@@ -2576,6 +3679,14 @@ ucl_object_typed_new (ucl_type_t type)
 
 ucl_object_t *
 ucl_object_new_full (ucl_type_t type, unsigned priority)
+{
+	/* Preallocate some space for arrays */
+	return ucl_object_new_reserved (type, priority,
+			type == UCL_ARRAY ? 8 : 0);
+}
+
+ucl_object_t *
+ucl_object_new_reserved (ucl_type_t type, unsigned priority, size_t reserved)
 {
 	ucl_object_t *new;
 
@@ -2593,10 +3704,14 @@ ucl_object_new_full (ucl_type_t type, unsigned priority)
 				new->value.av = UCL_ALLOC (sizeof (ucl_array_t));
 				if (new->value.av) {
 					memset (new->value.av, 0, sizeof (ucl_array_t));
-					UCL_ARRAY_GET (vec, new);
+				}
+			}
+
+			if (reserved > 0 && (type == UCL_ARRAY || type == UCL_OBJECT)) {
+				if (!ucl_object_reserve (new, reserved)) {
+					ucl_object_unref (new);
 
-					/* Preallocate some space for arrays */
-					kv_resize (ucl_object_t *, *vec, 8);
+					return NULL;
 				}
 			}
 		}
@@ -2609,6 +3724,33 @@ ucl_object_new_full (ucl_type_t type, unsigned priority)
 	return new;
 }
 
+bool
+ucl_object_reserve (ucl_object_t *obj, size_t reserved)
+{
+	if (obj == NULL || (obj->flags & UCL_OBJECT_SEALED)) {
+		return false;
+	}
+
+	if (obj->type == UCL_ARRAY) {
+		return ucl_array_reserve (obj, reserved);
+	}
+	else if (obj->type != UCL_OBJECT) {
+		return false;
+	}
+
+	ucl_container_materialize (obj);
+
+	if (obj->value.ov == NULL) {
+		obj->value.ov = ucl_hash_create (false);
+
+		if (obj->value.ov == NULL) {
+			return false;
+		}
+	}
+
+	return ucl_hash_reserve (obj->value.ov, reserved);
+}
+
 ucl_object_t*
 ucl_object_new_userdata (ucl_userdata_dtor dtor,
 		ucl_userdata_emitter emitter,
@@ -2701,7 +3843,8 @@ ucl_array_append (ucl_object_t *top, ucl_object_t *elt)
 {
 	UCL_ARRAY_GET (vec, top);
 
-	if (elt == NULL || top == NULL) {
+	if (elt == NULL || top == NULL || (top->flags & UCL_OBJECT_SEALED) ||
+			UCL_ARRAY_UNPACK_FAILED (vec, top)) {
 		return false;
 	}
 
@@ -2712,7 +3855,7 @@ ucl_array_append (ucl_object_t *top, ucl_object_t *elt)
 			return false;
 		}
 
-		kv_init (*vec);
+		memset (vec, 0, sizeof (*vec));
 		top->value.av = (void *)vec;
 	}
 
@@ -2723,18 +3866,61 @@ ucl_array_append (ucl_object_t *top, ucl_object_t *elt)
 	return true;
 }
 
+bool
+ucl_array_reserve (ucl_object_t *top, size_t reserved)
+{
+	UCL_ARRAY_GET (vec, top);
+	ucl_object_t **na;
+
+	if (top == NULL || top->type != UCL_ARRAY ||
+			(top->flags & UCL_OBJECT_SEALED) ||
+			UCL_ARRAY_UNPACK_FAILED (vec, top)) {
+		return false;
+	}
+
+	if (vec == NULL) {
+		vec = UCL_ALLOC (sizeof (*vec));
+
+		if (vec == NULL) {
+			return false;
+		}
+
+		memset (vec, 0, sizeof (*vec));
+		top->value.av = (void *)vec;
+	}
+
+	if (reserved > vec->m) {
+		na = realloc (vec->a, reserved * sizeof (*na));
+
+		if (na == NULL) {
+			return false;
+		}
+
+		vec->a = na;
+		vec->m = reserved;
+	}
+
+	return true;
+}
+
 bool
 ucl_array_prepend (ucl_object_t *top, ucl_object_t *elt)
 {
 	UCL_ARRAY_GET (vec, top);
 
-	if (elt == NULL || top == NULL) {
+	if (elt == NULL || top == NULL || (top->flags & UCL_OBJECT_SEALED) ||
+			UCL_ARRAY_UNPACK_FAILED (vec, top)) {
 		return false;
 	}
 
 	if (vec == NULL) {
 		vec = UCL_ALLOC (sizeof (*vec));
-		kv_init (*vec);
+
+		if (vec == NULL) {
+			return false;
+		}
+
+		memset (vec, 0, sizeof (*vec));
 		top->value.av = (void *)vec;
 		kv_push (ucl_object_t *, *vec, elt);
 	}
@@ -2755,7 +3941,8 @@ ucl_array_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
 	ucl_object_t *cp = NULL;
 	ucl_object_t **obj;
 
-	if (elt == NULL || top == NULL || top->type != UCL_ARRAY || elt->type != UCL_ARRAY) {
+	if (elt == NULL || top == NULL || top->type != UCL_ARRAY ||
+			elt->type != UCL_ARRAY || (top->flags & UCL_OBJECT_SEALED)) {
 		return false;
 	}
 
@@ -2769,6 +3956,12 @@ ucl_array_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
 	UCL_ARRAY_GET (v1, top);
 	UCL_ARRAY_GET (v2, cp);
 
+	if (UCL_ARRAY_UNPACK_FAILED (v1, top) || UCL_ARRAY_UNPACK_FAILED (v2, cp)) {
+		ucl_object_unref (cp);
+
+		return false;
+	}
+
 	if (v1 && v2) {
 		kv_concat (ucl_object_t *, *v1, *v2);
 
@@ -2787,14 +3980,30 @@ ucl_array_merge (ucl_object_t *top, ucl_object_t *elt, bool copy)
 ucl_object_t *
 ucl_array_delete (ucl_object_t *top, ucl_object_t *elt)
 {
-	UCL_ARRAY_GET (vec, top);
+	UCL_ARRAY_GET_RAW (vec, top);
 	ucl_object_t *ret = NULL;
+	size_t idx = (size_t)-1;
 	unsigned i;
 
-	if (vec == NULL) {
+	if (vec != NULL && top->type == UCL_ARRAY && vec->packed != NULL) {
+		/* Element could be read from a packed array only */
+		idx = ucl_array_view_index (vec, elt);
+
+		if (idx == (size_t)-1) {
+			return NULL;
+		}
+	}
+
+	vec = ucl_array_get_vec (top);
+
+	if (vec == NULL || (top->flags & UCL_OBJECT_SEALED)) {
 		return NULL;
 	}
 
+	if (idx != (size_t)-1) {
+		elt = kv_A (*vec, idx);
+	}
+
 	for (i = 0; i < vec->n; i ++) {
 		if (kv_A (*vec, i) == elt) {
 			kv_del (ucl_object_t *, *vec, i);
@@ -2810,26 +4019,26 @@ ucl_array_delete (ucl_object_t *top, ucl_object_t *elt)
 const ucl_object_t *
 ucl_array_head (const ucl_object_t *top)
 {
-	UCL_ARRAY_GET (vec, top);
-
-	if (vec == NULL || top == NULL || top->type != UCL_ARRAY ||
-			top->value.av == NULL) {
+	if (top == NULL || top->type != UCL_ARRAY) {
 		return NULL;
 	}
 
-	return (vec->n > 0 ? vec->a[0] : NULL);
+	return ucl_array_elt_view (top, 0);
 }
 
 const ucl_object_t *
 ucl_array_tail (const ucl_object_t *top)
 {
-	UCL_ARRAY_GET (vec, top);
+	UCL_ARRAY_GET_RAW (vec, top);
+	size_t n;
 
-	if (top == NULL || top->type != UCL_ARRAY || top->value.av == NULL) {
+	if (top == NULL || top->type != UCL_ARRAY || vec == NULL) {
 		return NULL;
 	}
 
-	return (vec->n > 0 ? vec->a[vec->n - 1] : NULL);
+	n = vec->packed != NULL ? vec->npacked : vec->n;
+
+	return (n > 0 ? ucl_array_elt_view (top, n - 1) : NULL);
 }
 
 ucl_object_t *
@@ -2838,7 +4047,7 @@ ucl_array_pop_last (ucl_object_t *top)
 	UCL_ARRAY_GET (vec, top);
 	ucl_object_t **obj, *ret = NULL;
 
-	if (vec != NULL && vec->n > 0) {
+	if (vec != NULL && vec->n > 0 && !(top->flags & UCL_OBJECT_SEALED)) {
 		obj = &kv_A (*vec, vec->n - 1);
 		ret = *obj;
 		kv_del (ucl_object_t *, *vec, vec->n - 1);
@@ -2854,7 +4063,7 @@ ucl_array_pop_first (ucl_object_t *top)
 	UCL_ARRAY_GET (vec, top);
 	ucl_object_t **obj, *ret = NULL;
 
-	if (vec != NULL && vec->n > 0) {
+	if (vec != NULL && vec->n > 0 && !(top->flags & UCL_OBJECT_SEALED)) {
 		obj = &kv_A (*vec, 0);
 		ret = *obj;
 		kv_del (ucl_object_t *, *vec, 0);
@@ -2867,25 +4076,27 @@ ucl_array_pop_first (ucl_object_t *top)
 const ucl_object_t *
 ucl_array_find_index (const ucl_object_t *top, unsigned int index)
 {
-	UCL_ARRAY_GET (vec, top);
-
-	if (vec != NULL && vec->n > 0 && index < vec->n) {
-		return kv_A (*vec, index);
+	if (top == NULL || top->type != UCL_ARRAY) {
+		return NULL;
 	}
 
-	return NULL;
+	return ucl_array_elt_view (top, index);
 }
 
 unsigned int
 ucl_array_index_of (ucl_object_t *top, ucl_object_t *elt)
 {
-	UCL_ARRAY_GET (vec, top);
+	UCL_ARRAY_GET_RAW (vec, top);
 	unsigned i;
 
-	if (vec == NULL) {
+	if (vec == NULL || top->type != UCL_ARRAY) {
 		return (unsigned int)(-1);
 	}
 
+	if (vec->packed != NULL) {
+		return (unsigned int)ucl_array_view_index (vec, elt);
+	}
+
 	for (i = 0; i < vec->n; i ++) {
 		if (kv_A (*vec, i) == elt) {
 			return i;
@@ -2902,7 +4113,8 @@ ucl_array_replace_index (ucl_object_t *top, ucl_object_t *elt,
 	UCL_ARRAY_GET (vec, top);
 	ucl_object_t *ret = NULL;
 
-	if (vec != NULL && vec->n > 0 && index < vec->n) {
+	if (vec != NULL && vec->n > 0 && index < vec->n &&
+			!(top->flags & UCL_OBJECT_SEALED)) {
 		ret = kv_A (*vec, index);
 		kv_A (*vec, index) = elt;
 	}
@@ -3063,6 +4275,7 @@ ucl_object_tolstring_safe (const ucl_object_t *obj, const char **target, size_t
 	}
 	switch (obj->type) {
 	case UCL_STRING:
+		ucl_string_materialize (obj);
 		*target = obj->value.sv;
 		if (tlen != NULL) {
 			*tlen = obj->len;
@@ -3106,7 +4319,11 @@ ucl_object_ref (const ucl_object_t *obj)
 	ucl_object_t *res = NULL;
 
 	if (obj != NULL) {
-		if (obj->flags & UCL_OBJECT_EPHEMERAL) {
+		if (obj->flags & UCL_OBJECT_PINNED) {
+			/* Lifetime is bound to the root of the sealed tree */
+			res = __DECONST (ucl_object_t *, obj);
+		}
+		else if (obj->flags & UCL_OBJECT_EPHEMERAL) {
 			/*
 			 * Use deep copy for ephemeral objects, note that its refcount
 			 * is NOT increased, since ephemeral objects does not need refcount
@@ -3116,6 +4333,11 @@ ucl_object_ref (const ucl_object_t *obj)
 		}
 		else {
 			res = __DECONST (ucl_object_t *, obj);
+
+			if (res->flags & UCL_OBJECT_BORROWED) {
+				/* The reference may outlive the containers holding the input */
+				ucl_object_detach_input (res);
+			}
 #ifdef HAVE_ATOMIC_BUILTINS
 			(void)__sync_add_and_fetch (&res->ref, 1);
 #else
@@ -3126,7 +4348,7 @@ ucl_object_ref (const ucl_object_t *obj)
 	return res;
 }
 
-static ucl_object_t *
+ucl_object_t *
 ucl_object_copy_internal (const ucl_object_t *other, bool allow_array)
 {
 
@@ -3134,14 +4356,14 @@ ucl_object_copy_internal (const ucl_object_t *other, bool allow_array)
 	ucl_object_iter_t it = NULL;
 	const ucl_object_t *cur;
 
+	ucl_container_materialize (other);
 	new = malloc (sizeof (*new));
 
 	if (new != NULL) {
 		memcpy (new, other, sizeof (*new));
-		if (other->flags & UCL_OBJECT_EPHEMERAL) {
-			/* Copied object is always non ephemeral */
-			new->flags &= ~UCL_OBJECT_EPHEMERAL;
-		}
+		/* Copied object is always non ephemeral and mutable */
+		new->flags &= ~(UCL_OBJECT_EPHEMERAL|UCL_OBJECT_SEALED|
+				UCL_OBJECT_PINNED);
 		new->ref = 1;
 		/* Unlink from others */
 		new->next = NULL;
@@ -3166,21 +4388,47 @@ ucl_object_copy_internal (const ucl_object_t *other, bool allow_array)
 		if (other->type == UCL_ARRAY || other->type == UCL_OBJECT) {
 			/* reset old value */
 			memset (&new->value, 0, sizeof (new->value));
+			new->len = 0;
 
-			while ((cur = ucl_object_iterate (other, &it, true)) != NULL) {
-				if (other->type == UCL_ARRAY) {
-					ucl_array_append (new, ucl_object_copy_internal (cur, false));
+			if (other->type == UCL_ARRAY && other->value.av != NULL &&
+					((ucl_array_t *)other->value.av)->packed != NULL) {
+				/* Packed values are copied as is */
+				new->value.av = ucl_array_packed_copy (other->value.av);
+
+				if (new->value.av != NULL) {
+					new->len = other->len;
 				}
-				else {
-					ucl_object_t *cp = ucl_object_copy_internal (cur, true);
-					if (cp != NULL) {
-						ucl_object_insert_key (new, cp, cp->key, cp->keylen,
-								false);
+			}
+			else {
+				while ((cur = ucl_object_iterate (other, &it, true)) != NULL) {
+					if (other->type == UCL_ARRAY) {
+						ucl_array_append (new,
+								ucl_object_copy_internal (cur, false));
+					}
+					else {
+						ucl_object_t *cp = ucl_object_copy_internal (cur, true);
+						if (cp != NULL) {
+							ucl_object_insert_key (new, cp, cp->key, cp->keylen,
+									false);
+						}
 					}
 				}
+
+				/*
+				 * Parser counts members of implicit arrays in the length of
+				 * an object, so keep it as is rather than recount keys
+				 */
+				if (other->type == UCL_OBJECT) {
+					new->len = other->len;
+				}
 			}
+
+			/* Copied keys and strings may still refer to the same buffers */
+			ucl_object_share_backings (new, other);
 		}
-		else if (allow_array && other->next != NULL) {
+
+		/* Containers may be members of implicit arrays as well */
+		if (allow_array && other->next != NULL) {
 			LL_FOREACH (other->next, cur) {
 				ucl_object_t *cp = ucl_object_copy_internal (cur, false);
 				if (cp != NULL) {
@@ -3196,22 +4444,240 @@ ucl_object_copy_internal (const ucl_object_t *other, bool allow_array)
 ucl_object_t *
 ucl_object_copy (const ucl_object_t *other)
 {
-	return ucl_object_copy_internal (other, true);
+	ucl_object_t *res, *cur;
+
+	res = ucl_object_copy_internal (other, true);
+
+	/* Copied containers share the input of the original ones */
+	LL_FOREACH (res, cur) {
+		if (cur->flags & UCL_OBJECT_BORROWED) {
+			ucl_object_detach_input (cur);
+		}
+	}
+
+	return res;
 }
 
 void
 ucl_object_unref (ucl_object_t *obj)
 {
-	if (obj != NULL) {
+	if (obj != NULL && !(obj->flags & UCL_OBJECT_PINNED)) {
 #ifdef HAVE_ATOMIC_BUILTINS
 		unsigned int rc = __sync_sub_and_fetch (&obj->ref, 1);
 		if (rc == 0) {
 #else
 		if (--obj->ref == 0) {
 #endif
-			ucl_object_free_internal (obj, true, ucl_object_dtor_unref);
+			ucl_object_free_internal (obj, true,
+					(obj->flags & UCL_OBJECT_SEALED) ?
+					ucl_object_dtor_sealed : ucl_object_dtor_unref);
+		}
+	}
+}
+
+static void
+ucl_object_seal_internal (ucl_object_t *obj, unsigned int flags)
+{
+	ucl_object_t *cur, *sub;
+	ucl_object_iter_t it = NULL;
+	uint64_t *cached;
+
+	LL_FOREACH (obj, cur) {
+		if (cur->flags & UCL_OBJECT_SEALED) {
+			/* Already a part of another sealed tree */
+			continue;
+		}
+
+		cur->flags |= flags;
+
+		if (cur->type == UCL_STRING) {
+			/* Sealed trees must not be modified even on read */
+			ucl_string_materialize (cur);
+		}
+		else if (cur->type == UCL_OBJECT || cur->type == UCL_ARRAY) {
+			UCL_ARRAY_GET_RAW (vec, cur);
+			size_t i;
+
+			if (cur->type == UCL_ARRAY && vec != NULL && vec->packed != NULL) {
+				/* Packed values stay packed, only their views are sealed */
+				for (i = 0; vec->view != NULL && i < vec->npacked; i ++) {
+					vec->view[i].flags |= UCL_OBJECT_SEALED;
+				}
+			}
+			else {
+				it = NULL;
+
+				while ((sub = __DECONST (ucl_object_t *,
+						ucl_object_iterate (cur, &it, true))) != NULL) {
+					ucl_object_seal_internal (sub,
+							UCL_OBJECT_SEALED|UCL_OBJECT_PINNED);
+				}
+			}
+
+			/*
+			 * Children are sealed and hashed already, readers of a sealed
+			 * tree only load the cached value and never store it
+			 */
+			cached = ucl_object_hash_slot (cur);
+
+			if (cached != NULL) {
+				*cached = ucl_object_hash (cur);
+			}
+		}
+	}
+}
+
+void
+ucl_object_seal (ucl_object_t *obj)
+{
+	if (obj != NULL && !(obj->flags & UCL_OBJECT_SEALED)) {
+		ucl_object_seal_internal (obj, UCL_OBJECT_SEALED);
+	}
+}
+
+bool
+ucl_object_is_sealed (const ucl_object_t *obj)
+{
+	if (obj == NULL) {
+		return false;
+	}
+
+	return (obj->flags & UCL_OBJECT_SEALED) != 0;
+}
+
+static void
+ucl_object_hash_single (const ucl_object_t *obj, XXH64_state_t *st,
+		ucl_object_hash_func child_hash, void *ud)
+{
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+	uint64_t h, acc = 0;
+	double dv;
+	unsigned i;
+
+	ucl_container_materialize (obj);
+	XXH64_update (st, &obj->type, sizeof (obj->type));
+
+	switch (obj->type) {
+	case UCL_STRING:
+		ucl_string_materialize (obj);
+		XXH64_update (st, obj->value.sv, obj->len);
+		break;
+	case UCL_INT:
+	case UCL_BOOLEAN:
+		XXH64_update (st, &obj->value.iv, sizeof (obj->value.iv));
+		break;
+	case UCL_FLOAT:
+	case UCL_TIME:
+		/* Make both zeroes equal */
+		dv = obj->value.dv == 0 ? 0.0 : obj->value.dv;
+		XXH64_update (st, &dv, sizeof (dv));
+		break;
+	case UCL_USERDATA:
+		XXH64_update (st, &obj->value.ud, sizeof (obj->value.ud));
+		break;
+	case UCL_ARRAY: {
+		UCL_ARRAY_GET_RAW (vec, obj);
+
+		if (vec != NULL && vec->packed != NULL) {
+			ucl_object_t tmp;
+
+			/* Hash packed values exactly as the corresponding scalars */
+			for (i = 0; i < vec->npacked; i ++) {
+				ucl_array_packed_elt (vec, i, &tmp);
+				h = ucl_object_hash_full (&tmp, child_hash, ud);
+				XXH64_update (st, &h, sizeof (h));
+			}
+		}
+		else if (vec != NULL) {
+			for (i = 0; i < vec->n; i ++) {
+				cur = kv_A (*vec, i);
+
+				if (cur != NULL) {
+					h = child_hash (cur, ud);
+					XXH64_update (st, &h, sizeof (h));
+				}
+			}
+		}
+		break;
+	}
+	case UCL_OBJECT:
+		/* Must not depend on the order of keys */
+		while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
+			h = child_hash (cur, ud);
+			acc += XXH64 (cur->key, cur->keylen, h);
+		}
+
+		/*
+		 * Length is not hashed: the parser counts implicit array members
+		 * in it while ucl_object_insert_key does not
+		 */
+		XXH64_update (st, &acc, sizeof (acc));
+		break;
+	default:
+		break;
+	}
+}
+
+uint64_t
+ucl_object_hash_full (const ucl_object_t *obj,
+		ucl_object_hash_func child_hash, void *ud)
+{
+	const ucl_object_t *cur;
+	XXH64_state_t st;
+
+	XXH64_reset (&st, 0);
+
+	LL_FOREACH (obj, cur) {
+		ucl_object_hash_single (cur, &st, child_hash, ud);
+	}
+
+	return XXH64_digest (&st);
+}
+
+static uint64_t
+ucl_object_hash_child (const ucl_object_t *obj, void *ud)
+{
+	return ucl_object_hash (obj);
+}
+
+/*
+ * Returns the storage for a cached hash of a container or NULL
+ */
+static uint64_t *
+ucl_object_hash_slot (const ucl_object_t *obj)
+{
+	if (obj->type == UCL_ARRAY && obj->value.av != NULL) {
+		UCL_ARRAY_GET_RAW (vec, obj);
+
+		return &vec->digest;
+	}
+	else if (obj->type == UCL_OBJECT && obj->value.ov != NULL) {
+		return ucl_hash_digest (obj->value.ov);
+	}
+
+	return NULL;
+}
+
+uint64_t
+ucl_object_hash (const ucl_object_t *obj)
+{
+	uint64_t *cached;
+
+	if (obj == NULL) {
+		return 0;
+	}
+
+	if (obj->flags & UCL_OBJECT_SEALED) {
+		/* Hashes of sealed containers are stored by ucl_object_seal */
+		cached = ucl_object_hash_slot (obj);
+
+		if (cached != NULL && *cached != 0) {
+			return *cached;
 		}
 	}
+
+	return ucl_object_hash_full (obj, ucl_object_hash_child, NULL);
 }
 
 int
@@ -3225,33 +4691,52 @@ ucl_object_compare (const ucl_object_t *o1, const ucl_object_t *o2)
 		return (o1->type) - (o2->type);
 	}
 
+	if (o1 == o2) {
+		return 0;
+	}
+
+	ucl_container_materialize (o1);
+	ucl_container_materialize (o2);
+
 	switch (o1->type) {
 	case UCL_STRING:
+		ucl_string_materialize (o1);
+		ucl_string_materialize (o2);
+
 		if (o1->len == o2->len && o1->len > 0) {
-			ret = strcmp (ucl_object_tostring(o1), ucl_object_tostring(o2));
+			ret = memcmp (o1->value.sv, o2->value.sv, o1->len);
 		}
-		else {
-			ret = o1->len - o2->len;
+		else if (o1->len != o2->len) {
+			ret = o1->len > o2->len ? 1 : -1;
 		}
 		break;
-	case UCL_FLOAT:
 	case UCL_INT:
+		if (o1->value.iv != o2->value.iv) {
+			ret = o1->value.iv > o2->value.iv ? 1 : -1;
+		}
+		break;
+	case UCL_FLOAT:
 	case UCL_TIME:
-		ret = ucl_object_todouble (o1) - ucl_object_todouble (o2);
+		if (o1->value.dv != o2->value.dv) {
+			ret = o1->value.dv > o2->value.dv ? 1 : -1;
+		}
 		break;
 	case UCL_BOOLEAN:
 		ret = ucl_object_toboolean (o1) - ucl_object_toboolean (o2);
 		break;
 	case UCL_ARRAY:
 		if (o1->len == o2->len && o1->len > 0) {
-			UCL_ARRAY_GET (vec1, o1);
-			UCL_ARRAY_GET (vec2, o2);
-			unsigned i;
+			UCL_ARRAY_GET_RAW (vec1, o1);
+			UCL_ARRAY_GET_RAW (vec2, o2);
+			ucl_object_t tmp1, tmp2;
+			size_t i, n1;
 
-			/* Compare all elements in both arrays */
-			for (i = 0; i < vec1->n; i ++) {
-				it1 = kv_A (*vec1, i);
-				it2 = kv_A (*vec2, i);
+			/* Compare all elements in both arrays, packed ones are not unpacked */
+			n1 = vec1->packed != NULL ? vec1->npacked : vec1->n;
+
+			for (i = 0; i < n1; i ++) {
+				it1 = ucl_array_elt_at (vec1, i, &tmp1);
+				it2 = ucl_array_elt_at (vec2, i, &tmp2);
 
 				if (it1 == NULL && it2 != NULL) {
 					return -1;
@@ -3267,14 +4752,14 @@ ucl_object_compare (const ucl_object_t *o1, const ucl_object_t *o2)
 				}
 			}
 		}
-		else {
-			ret = o1->len - o2->len;
+		else if (o1->len != o2->len) {
+			ret = o1->len > o2->len ? 1 : -1;
 		}
 		break;
 	case UCL_OBJECT:
 		if (o1->len == o2->len && o1->len > 0) {
 			while ((it1 = ucl_object_iterate (o1, &iter, true)) != NULL) {
-				it2 = ucl_object_lookup (o2, ucl_object_key (it1));
+				it2 = ucl_object_lookup_len (o2, it1->key, it1->keylen);
 				if (it2 == NULL) {
 					ret = 1;
 					break;
@@ -3285,8 +4770,8 @@ ucl_object_compare (const ucl_object_t *o1, const ucl_object_t *o2)
 				}
 			}
 		}
-		else {
-			ret = o1->len - o2->len;
+		else if (o1->len != o2->len) {
+			ret = o1->len > o2->len ? 1 : -1;
 		}
 		break;
 	default:
@@ -3310,7 +4795,8 @@ ucl_object_array_sort (ucl_object_t *ar,
 {
 	UCL_ARRAY_GET (vec, ar);
 
-	if (cmp == NULL || ar == NULL || ar->type != UCL_ARRAY) {
+	if (cmp == NULL || vec == NULL || ar->type != UCL_ARRAY ||
+			(ar->flags & UCL_OBJECT_SEALED)) {
 		return;
 	}
 
@@ -3327,19 +4813,15 @@ ucl_object_get_priority (const ucl_object_t *obj)
 		return 0;
 	}
 
-	return (obj->flags >> ((sizeof (obj->flags) * NBBY) - PRIOBITS));
+	return obj->priority;
 }
 
 void
 ucl_object_set_priority (ucl_object_t *obj,
 		unsigned int priority)
 {
-	if (obj != NULL) {
-		priority &= (0x1 << PRIOBITS) - 1;
-		priority <<= ((sizeof (obj->flags) * NBBY) - PRIOBITS);
-		priority |= obj->flags & ((1 << ((sizeof (obj->flags) * NBBY) -
-				PRIOBITS)) - 1);
-		obj->flags = priority;
+	if (obj != NULL && !(obj->flags & UCL_OBJECT_SEALED)) {
+		obj->priority = priority & ((0x1 << PRIOBITS) - 1);
 	}
 }
 
@@ -0,0 +1,865 @@
+/* Copyright (c) 2016, Vsevolod Stakhov
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *       * Redistributions of source code must retain the above copyright
+ *         notice, this list of conditions and the following disclaimer.
+ *       * Redistributions in binary form must reproduce the above copyright
+ *         notice, this list of conditions and the following disclaimer in the
+ *         documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Watcher of a configuration and the files it includes. While parsing, each
+ * included file is recorded with the path of its container and the keys it
+ * has added there, so a changed file can be parsed alone and spliced into a
+ * new top object that shares the rest of values with the previous one
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ucl.h"
+#include "ucl_internal.h"
+
+#ifndef _WIN32
+#include <fnmatch.h>
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+struct ucl_watch_dir {
+	int wd;
+	char *path;
+	struct ucl_watch_dir *next;
+};
+
+struct ucl_watcher {
+	char *filename;
+	ucl_watcher_parser_cb cb;
+	void *ud;
+	ucl_object_t *top;
+	struct ucl_include_track *files; /* The top file goes first */
+	ucl_object_t *changed; /* Set of changed paths */
+	unsigned int gen;
+	char *err;
+	int fd;
+	struct ucl_watch_dir *dirs;
+};
+
+/**
+ * Get keys from the top object to the current container, the path is not
+ * defined for containers in arrays
+ */
+static ucl_object_t *
+ucl_include_track_cpath (struct ucl_parser *parser)
+{
+	struct ucl_stack *st;
+	const ucl_object_t *prev = NULL;
+	ucl_object_t *cpath;
+
+	cpath = ucl_object_typed_new (UCL_ARRAY);
+
+	for (st = parser->stack; st != NULL; st = st->next) {
+		if (st->obj == parser->top_obj) {
+			return cpath;
+		}
+		if (st->obj == prev) {
+			continue;
+		}
+		if (st->obj->key == NULL || st->obj->type != UCL_OBJECT) {
+			break;
+		}
+
+		ucl_array_prepend (cpath, ucl_object_fromlstring (st->obj->key,
+				st->obj->keylen));
+		prev = st->obj;
+	}
+
+	ucl_object_unref (cpath);
+
+	return NULL;
+}
+
+static struct ucl_include_track *
+ucl_include_track_new (struct ucl_parser *parser, const char *path)
+{
+	struct ucl_include_track *tr;
+
+	tr = UCL_ALLOC (sizeof (*tr));
+	if (tr == NULL) {
+		return NULL;
+	}
+
+	memset (tr, 0, sizeof (*tr));
+	tr->path = strdup (path);
+	tr->parent = parser->cur_track;
+	DL_APPEND (parser->tracked, tr);
+
+	return tr;
+}
+
+struct ucl_include_track *
+ucl_include_track_start (struct ucl_parser *parser, const char *path,
+		unsigned priority, enum ucl_duplicate_strategy strat,
+		enum ucl_parse_type parse_type)
+{
+	struct ucl_include_track *tr;
+
+	tr = ucl_include_track_new (parser, path);
+	if (tr == NULL) {
+		return NULL;
+	}
+
+	tr->priority = priority;
+	tr->strat = strat;
+	tr->parse_type = parse_type;
+	tr->keys = ucl_object_typed_new (UCL_OBJECT);
+
+	if (parser->stack != NULL && parser->stack->obj->type == UCL_OBJECT) {
+		tr->container = parser->stack->obj;
+		tr->start = tr->container->len;
+		tr->cpath = ucl_include_track_cpath (parser);
+	}
+
+	tr->merged = tr->cpath == NULL;
+	parser->cur_track = tr;
+
+	return tr;
+}
+
+void
+ucl_include_track_finish (struct ucl_parser *parser,
+		struct ucl_include_track *tr)
+{
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+	size_t i = 0;
+
+	if (tr->container != NULL) {
+		/* Keys are iterated in the insertion order */
+		while ((cur = ucl_object_iterate (tr->container, &it, true)) != NULL) {
+			if (i ++ >= tr->start) {
+				ucl_object_insert_key (tr->keys, ucl_object_new (),
+						cur->key, cur->keylen, true);
+			}
+		}
+	}
+
+	tr->done = true;
+	parser->cur_track = tr->parent;
+}
+
+void
+ucl_include_track_pattern (struct ucl_parser *parser, const char *pattern)
+{
+	struct ucl_include_track *tr;
+	char dir[PATH_MAX], realdir[PATH_MAX], *slash;
+	const char *base = pattern;
+
+	ucl_strlcpy (dir, ".", sizeof (dir));
+	slash = strrchr (pattern, '/');
+	if (slash != NULL) {
+		ucl_strlcpy (dir, slash == pattern ? "/" : pattern,
+				slash == pattern ? sizeof (dir) :
+				MIN ((size_t)(slash - pattern) + 1, sizeof (dir)));
+		base = slash + 1;
+	}
+
+	tr = ucl_include_track_new (parser, pattern);
+	if (tr == NULL) {
+		return;
+	}
+
+#ifndef _WIN32
+	/* Match against absolute paths reported for changed files */
+	if (realpath (dir, realdir) != NULL) {
+		free (tr->path);
+		tr->path = malloc (strlen (realdir) + strlen (base) + 2);
+		if (tr->path != NULL) {
+			sprintf (tr->path, "%s%s%s", realdir,
+					strcmp (realdir, "/") == 0 ? "" : "/", base);
+		}
+	}
+#endif
+
+	tr->pattern = true;
+	tr->merged = true;
+	tr->done = true;
+}
+
+void
+ucl_include_track_dup (struct ucl_parser *parser,
+		const ucl_object_t *container, const ucl_object_t *existing)
+{
+	struct ucl_include_track *tr;
+	size_t pos;
+
+	if (!ucl_hash_position (container->value.ov, existing, &pos)) {
+		return;
+	}
+
+	/* Files being parsed that have not added the key themselves */
+	for (tr = parser->cur_track; tr != NULL; tr = tr->parent) {
+		if (tr->container == container && pos < tr->start) {
+			tr->merged = true;
+		}
+	}
+
+	/* Files that have added the key before */
+	DL_FOREACH (parser->tracked, tr) {
+		if (tr->done && tr->container == container &&
+				ucl_object_lookup_len (tr->keys, existing->key,
+						existing->keylen) != NULL) {
+			tr->merged = true;
+		}
+	}
+}
+
+void
+ucl_include_track_free (struct ucl_include_track *list)
+{
+	struct ucl_include_track *tr, *tmp;
+
+	DL_FOREACH_SAFE (list, tr, tmp) {
+		free (tr->path);
+		ucl_object_unref (tr->cpath);
+		ucl_object_unref (tr->keys);
+		UCL_FREE (sizeof (*tr), tr);
+	}
+}
+
+struct ucl_watcher*
+ucl_watcher_new (const char *filename, ucl_watcher_parser_cb cb, void *ud)
+{
+	struct ucl_watcher *w;
+
+	if (filename == NULL) {
+		return NULL;
+	}
+
+	w = UCL_ALLOC (sizeof (*w));
+	if (w == NULL) {
+		return NULL;
+	}
+
+	memset (w, 0, sizeof (*w));
+	w->filename = strdup (filename);
+	w->cb = cb;
+	w->ud = ud;
+	w->changed = ucl_object_typed_new (UCL_OBJECT);
+#ifdef HAVE_SYS_INOTIFY_H
+	w->fd = inotify_init1 (IN_NONBLOCK|IN_CLOEXEC);
+#else
+	w->fd = -1;
+#endif
+
+	return w;
+}
+
+int
+ucl_watcher_get_fd (struct ucl_watcher *w)
+{
+	return w != NULL ? w->fd : -1;
+}
+
+void
+ucl_watcher_notify (struct ucl_watcher *w, const char *path)
+{
+	if (w == NULL || path == NULL) {
+		return;
+	}
+
+	if (ucl_object_lookup (w->changed, path) == NULL) {
+		ucl_object_insert_key (w->changed, ucl_object_new (), path, 0, true);
+	}
+}
+
+ucl_object_t*
+ucl_watcher_get_object (struct ucl_watcher *w)
+{
+	if (w == NULL || w->top == NULL) {
+		return NULL;
+	}
+
+	return ucl_object_ref (w->top);
+}
+
+const char*
+ucl_watcher_get_error (struct ucl_watcher *w)
+{
+	return w != NULL ? w->err : NULL;
+}
+
+void
+ucl_watcher_free (struct ucl_watcher *w)
+{
+	struct ucl_watch_dir *dir, *tmp;
+
+	if (w == NULL) {
+		return;
+	}
+
+	LL_FOREACH_SAFE (w->dirs, dir, tmp) {
+		free (dir->path);
+		free (dir);
+	}
+	if (w->fd != -1) {
+		close (w->fd);
+	}
+
+	ucl_include_track_free (w->files);
+	ucl_object_unref (w->top);
+	ucl_object_unref (w->changed);
+	free (w->filename);
+	free (w->err);
+	UCL_FREE (sizeof (*w), w);
+}
+
+static void
+ucl_watcher_set_error (struct ucl_watcher *w, struct ucl_parser *parser,
+		const char *path)
+{
+	const char *err = parser != NULL ? ucl_parser_get_error (parser) : NULL;
+
+	if (err == NULL) {
+		err = parser != NULL ? "unknown error" : "cannot create parser";
+	}
+
+	free (w->err);
+	w->err = malloc (strlen (path) + strlen (err) + sizeof ("cannot parse : "));
+	if (w->err != NULL) {
+		sprintf (w->err, "cannot parse %s: %s", path, err);
+	}
+}
+
+/**
+ * Watch the directory of a file, so that replacing it is noticed as well
+ */
+static void
+ucl_watcher_watch (struct ucl_watcher *w, const char *path)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	struct ucl_watch_dir *dir;
+	char dirbuf[PATH_MAX], *slash;
+	int wd;
+
+	ucl_strlcpy (dirbuf, path, sizeof (dirbuf));
+	slash = strrchr (dirbuf, '/');
+	if (slash == NULL) {
+		return;
+	}
+	*(slash == dirbuf ? slash + 1 : slash) = '\0';
+
+	if (strpbrk (dirbuf, "*?[") != NULL) {
+		/* Only the last component of a pattern can be watched */
+		return;
+	}
+
+	LL_FOREACH (w->dirs, dir) {
+		if (strcmp (dir->path, dirbuf) == 0) {
+			return;
+		}
+	}
+
+	wd = inotify_add_watch (w->fd, dirbuf, IN_CLOSE_WRITE|IN_MOVED_TO|
+			IN_MOVED_FROM|IN_DELETE);
+	if (wd == -1) {
+		return;
+	}
+
+	dir = malloc (sizeof (*dir));
+	if (dir != NULL) {
+		dir->wd = wd;
+		dir->path = strdup (dirbuf);
+		LL_PREPEND (w->dirs, dir);
+	}
+#endif
+}
+
+/**
+ * Queue files changed in watched directories
+ */
+static void
+ucl_watcher_read_events (struct ucl_watcher *w)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	union {
+		struct inotify_event ev;
+		char buf[4096];
+	} u;
+	const struct inotify_event *ev;
+	struct ucl_watch_dir *dir;
+	char path[PATH_MAX];
+	ssize_t r;
+	size_t off;
+
+	if (w->fd == -1) {
+		return;
+	}
+
+	while ((r = read (w->fd, u.buf, sizeof (u.buf))) > 0) {
+		for (off = 0; off < (size_t)r;
+				off += sizeof (struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)(u.buf + off);
+
+			if (ev->len == 0) {
+				continue;
+			}
+
+			LL_FOREACH (w->dirs, dir) {
+				if (dir->wd == ev->wd) {
+					snprintf (path, sizeof (path), "%s%s%s", dir->path,
+							strcmp (dir->path, "/") == 0 ? "" : "/", ev->name);
+					ucl_watcher_notify (w, path);
+					break;
+				}
+			}
+		}
+	}
+#endif
+}
+
+static bool
+ucl_watcher_match (const char *pattern, const char *path)
+{
+#ifndef _WIN32
+	return fnmatch (pattern, path, FNM_PATHNAME) == 0;
+#else
+	return strcmp (pattern, path) == 0;
+#endif
+}
+
+static bool
+ucl_watcher_within (const struct ucl_include_track *tr,
+		const struct ucl_include_track *unit)
+{
+	for (; tr != NULL; tr = tr->parent) {
+		if (tr == unit) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Find a file to reparse for a changed path among files that have not been
+ * parsed during the current update
+ */
+static struct ucl_include_track *
+ucl_watcher_unit (struct ucl_watcher *w, const char *path)
+{
+	struct ucl_include_track *tr;
+	struct stat st;
+	bool exists = stat (path, &st) == 0;
+
+	DL_FOREACH (w->files, tr) {
+		if (!tr->pattern && tr->gen != w->gen && strcmp (tr->path, path) == 0) {
+			/* Removed files are dropped by reparsing their parents */
+			return exists || tr->parent == NULL ? tr : tr->parent;
+		}
+	}
+
+	if (!exists) {
+		return NULL;
+	}
+
+	DL_FOREACH (w->files, tr) {
+		if (tr->pattern && tr->gen != w->gen &&
+				ucl_watcher_match (tr->path, path)) {
+			/* A new file appeared for a pattern */
+			return tr->parent;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Adopt files recorded by a parser as descendants of `unit`, their containers
+ * are relative to the container of `unit`
+ */
+static void
+ucl_watcher_adopt (struct ucl_watcher *w, struct ucl_parser *parser,
+		struct ucl_include_track *unit)
+{
+	struct ucl_include_track *tr, *tmp;
+	const ucl_object_t *cur;
+	ucl_object_t *cpath;
+	ucl_object_iter_t it;
+
+	DL_FOREACH_SAFE (parser->tracked, tr, tmp) {
+		DL_DELETE (parser->tracked, tr);
+
+		tr->container = NULL;
+		tr->gen = w->gen;
+		if (tr->parent == NULL) {
+			tr->parent = unit;
+		}
+
+		if (unit != NULL && unit->cpath != NULL && tr->cpath != NULL &&
+				unit->cpath->len > 0) {
+			cpath = ucl_object_copy (unit->cpath);
+			it = NULL;
+			while ((cur = ucl_object_iterate (tr->cpath, &it, true)) != NULL) {
+				ucl_array_append (cpath, ucl_object_ref (cur));
+			}
+			ucl_object_unref (tr->cpath);
+			tr->cpath = cpath;
+		}
+
+		DL_APPEND (w->files, tr);
+		ucl_watcher_watch (w, tr->path);
+	}
+}
+
+/**
+ * Parse the whole configuration
+ */
+static bool
+ucl_watcher_load (struct ucl_watcher *w)
+{
+	struct ucl_parser *parser;
+	struct ucl_include_track *root;
+	char realbuf[PATH_MAX];
+
+	parser = w->cb != NULL ? w->cb (w->ud) : ucl_parser_new (0);
+	if (parser == NULL) {
+		ucl_watcher_set_error (w, NULL, w->filename);
+		return false;
+	}
+
+	parser->track_includes = true;
+
+	if (!ucl_parser_add_file (parser, w->filename)) {
+		ucl_watcher_set_error (w, parser, w->filename);
+		ucl_parser_free (parser);
+		return false;
+	}
+
+	ucl_include_track_free (w->files);
+	w->files = NULL;
+
+	root = ucl_include_track_new (parser, w->filename);
+	DL_DELETE (parser->tracked, root);
+#ifndef _WIN32
+	if (realpath (w->filename, realbuf) != NULL) {
+		free (root->path);
+		root->path = strdup (realbuf);
+	}
+#endif
+	root->gen = w->gen;
+	root->done = true;
+	root->parent = NULL;
+	DL_APPEND (w->files, root);
+	ucl_watcher_watch (w, root->path);
+
+	ucl_watcher_adopt (w, parser, root);
+
+	ucl_object_unref (w->top);
+	w->top = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+
+	return true;
+}
+
+static bool
+ucl_watcher_insert (ucl_object_t *top, const ucl_object_t *elt)
+{
+	if (ucl_object_lookup_len (top, elt->key, elt->keylen) != NULL) {
+		/* Keys of a reparsed file conflict with other keys */
+		return false;
+	}
+
+	return ucl_object_insert_key (top, ucl_object_ref (elt), elt->key,
+			elt->keylen, false);
+}
+
+static bool
+ucl_watcher_insert_all (ucl_object_t *top, const ucl_object_t *src)
+{
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+	bool ok = true;
+
+	while ((cur = ucl_object_iterate (src, &it, true)) != NULL) {
+		ok = ok && ucl_watcher_insert (top, cur);
+	}
+
+	return ok;
+}
+
+/**
+ * Copy containers from `obj` down the path `cpath`, replacing `keys` of the
+ * last one with the keys of `nobj`, all other values are shared
+ * @return new object or NULL if it cannot be spliced
+ */
+static ucl_object_t *
+ucl_watcher_splice (const ucl_object_t *obj, const ucl_object_t *cpath,
+		unsigned int depth, const ucl_object_t *keys, const ucl_object_t *nobj)
+{
+	const ucl_object_t *cur, *key = NULL;
+	ucl_object_t *res, *child = NULL;
+	ucl_object_iter_t it = NULL;
+	bool placed = false, ok = true;
+
+	if (obj == NULL || obj->type != UCL_OBJECT || obj->next != NULL) {
+		/* Implicit arrays have no single container */
+		return NULL;
+	}
+
+	if (depth < cpath->len) {
+		key = ucl_array_find_index (cpath, depth);
+		child = ucl_watcher_splice (ucl_object_lookup_len (obj,
+				ucl_object_tostring (key), key->len), cpath, depth + 1,
+				keys, nobj);
+		if (child == NULL) {
+			return NULL;
+		}
+	}
+
+	res = ucl_object_new_full (UCL_OBJECT, ucl_object_get_priority (obj));
+	ucl_object_reserve (res, obj->len);
+	ucl_object_share_backings (res, obj);
+
+	while ((cur = ucl_object_iterate (obj, &it, true)) != NULL) {
+		if (!ok) {
+			/* Hash iterators are released at the end only */
+			continue;
+		}
+		if (child != NULL && cur->keylen == key->len &&
+				memcmp (cur->key, ucl_object_tostring (key), key->len) == 0) {
+			ok = ucl_object_insert_key (res, child, cur->key, cur->keylen,
+					true);
+			child = NULL;
+		}
+		else if (child == NULL && key == NULL &&
+				ucl_object_lookup_len (keys, cur->key, cur->keylen) != NULL) {
+			if (!placed) {
+				/* New keys take the place of the old ones */
+				ok = ucl_watcher_insert_all (res, nobj);
+				placed = true;
+			}
+		}
+		else {
+			ok = ucl_watcher_insert (res, cur);
+		}
+	}
+
+	if (ok && key == NULL) {
+		if (!placed) {
+			ok = ucl_watcher_insert_all (res, nobj);
+		}
+		ucl_object_share_backings (res, nobj);
+	}
+
+	if (child != NULL) {
+		ucl_object_unref (child);
+	}
+	if (!ok) {
+		ucl_object_unref (res);
+		return NULL;
+	}
+
+	return res;
+}
+
+/**
+ * Parse an included file alone and replace its keys
+ */
+static bool
+ucl_watcher_reparse (struct ucl_watcher *w, struct ucl_include_track *unit)
+{
+	struct ucl_parser *parser;
+	struct ucl_include_track *tr, *tmp, *dead = NULL;
+	ucl_object_t *nobj, *ntop, *keys;
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+
+	if (unit->merged || unit->cpath == NULL) {
+		return false;
+	}
+
+	parser = w->cb != NULL ? w->cb (w->ud) : ucl_parser_new (0);
+	if (parser == NULL) {
+		return false;
+	}
+
+	parser->track_includes = true;
+
+	if (!ucl_parser_add_file_full (parser, unit->path, unit->priority,
+			unit->strat, unit->parse_type)) {
+		ucl_watcher_set_error (w, parser, unit->path);
+		ucl_parser_free (parser);
+		return false;
+	}
+
+	nobj = ucl_parser_get_object (parser);
+	if (nobj == NULL) {
+		/* Empty file */
+		nobj = ucl_object_typed_new (UCL_OBJECT);
+	}
+
+	ntop = NULL;
+	if (nobj->type == UCL_OBJECT) {
+		ntop = ucl_watcher_splice (w->top, unit->cpath, 0, unit->keys, nobj);
+	}
+
+	if (ntop == NULL) {
+		ucl_object_unref (nobj);
+		ucl_parser_free (parser);
+		return false;
+	}
+
+	keys = ucl_object_typed_new (UCL_OBJECT);
+	while ((cur = ucl_object_iterate (nobj, &it, true)) != NULL) {
+		ucl_object_insert_key (keys, ucl_object_new (), cur->key, cur->keylen,
+				true);
+	}
+
+	/* Files that included this one own its keys as well */
+	for (tr = unit->parent; tr != NULL; tr = tr->parent) {
+		if (tr->cpath != NULL && ucl_object_compare (tr->cpath,
+				unit->cpath) == 0) {
+			it = NULL;
+			while ((cur = ucl_object_iterate (unit->keys, &it, true)) != NULL) {
+				ucl_object_delete_keyl (tr->keys, cur->key, cur->keylen);
+			}
+			it = NULL;
+			while ((cur = ucl_object_iterate (keys, &it, true)) != NULL) {
+				ucl_object_insert_key (tr->keys, ucl_object_new (), cur->key,
+						cur->keylen, true);
+			}
+		}
+	}
+
+	/*
+	 * Files included by this one are recorded anew, parents precede their
+	 * children in the list so they are still valid when children are checked
+	 */
+	DL_FOREACH_SAFE (w->files, tr, tmp) {
+		if (tr != unit && ucl_watcher_within (tr, unit)) {
+			DL_DELETE (w->files, tr);
+			DL_APPEND (dead, tr);
+		}
+	}
+	ucl_include_track_free (dead);
+
+	ucl_object_unref (unit->keys);
+	unit->keys = keys;
+	unit->gen = w->gen;
+	ucl_watcher_adopt (w, parser, unit);
+
+	ucl_object_unref (w->top);
+	w->top = ntop;
+	ucl_object_unref (nobj);
+	ucl_parser_free (parser);
+
+	return true;
+}
+
+bool
+ucl_watcher_update (struct ucl_watcher *w, ucl_object_t **changes)
+{
+	struct ucl_include_track *unit;
+	ucl_object_t *old, *files, *pending, *paths, *diff;
+	const ucl_object_t *cur, *op;
+	ucl_object_iter_t it = NULL;
+	bool ret = true;
+
+	if (changes != NULL) {
+		*changes = NULL;
+	}
+	if (w == NULL) {
+		return false;
+	}
+
+	ucl_watcher_read_events (w);
+	w->gen ++;
+	files = ucl_object_typed_new (UCL_ARRAY);
+	pending = ucl_object_typed_new (UCL_OBJECT);
+	old = w->top != NULL ? ucl_object_ref (w->top) : NULL;
+
+	if (w->top == NULL) {
+		ret = ucl_watcher_load (w);
+		ucl_array_append (files, ucl_object_fromstring (w->files != NULL ?
+				w->files->path : w->filename));
+	}
+	else {
+		while ((cur = ucl_object_iterate (w->changed, &it, true)) != NULL) {
+			if (ret) {
+				ucl_array_append (files, ucl_object_fromlstring (cur->key,
+						cur->keylen));
+
+				/* A file may be included several times */
+				while (ret && (unit = ucl_watcher_unit (w,
+						ucl_object_key (cur))) != NULL) {
+					while (unit->parent != NULL &&
+							!ucl_watcher_reparse (w, unit)) {
+						unit = unit->parent;
+					}
+					if (unit->parent == NULL) {
+						ret = ucl_watcher_load (w);
+					}
+				}
+			}
+			if (!ret) {
+				/* The failed file and the rest are retried by the next update */
+				ucl_object_insert_key (pending, ucl_object_new (), cur->key,
+						cur->keylen, true);
+			}
+		}
+	}
+
+	ucl_object_unref (w->changed);
+	w->changed = pending;
+
+	if (ret) {
+		free (w->err);
+		w->err = NULL;
+	}
+
+	if (ret && changes != NULL && files->len > 0) {
+		paths = ucl_object_typed_new (UCL_ARRAY);
+
+		if (old != NULL) {
+			diff = ucl_object_diff (old, w->top);
+			it = NULL;
+			while ((op = ucl_object_iterate (diff, &it, true)) != NULL) {
+				cur = ucl_object_lookup (op, "path");
+				if (cur != NULL) {
+					ucl_array_append (paths, ucl_object_ref (cur));
+				}
+			}
+			ucl_object_unref (diff);
+		}
+		else {
+			ucl_array_append (paths, ucl_object_fromstring (""));
+		}
+
+		*changes = ucl_object_typed_new (UCL_OBJECT);
+		ucl_object_insert_key (*changes, files, "files", 0, false);
+		ucl_object_insert_key (*changes, paths, "paths", 0, false);
+		files = NULL;
+	}
+
+	ucl_object_unref (files);
+	ucl_object_unref (old);
+
+	return ret;
+}
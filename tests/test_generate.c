@@ -24,6 +24,11 @@
 #include <stdio.h>
 #include <errno.h>
 #include <assert.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <utime.h>
+#include <poll.h>
 #include "ucl.h"
 
 static void
@@ -38,17 +43,805 @@ ud_emit (void *ptr)
 	return "test userdata emit";
 }
 
+static bool
+macro_args_collect (const unsigned char *data, size_t len,
+		const ucl_object_t *arguments, void *ud)
+{
+	ucl_object_t **seen = ud;
+
+	while (*seen != NULL) {
+		seen ++;
+	}
+	*seen = ucl_object_ref (arguments);
+
+	return true;
+}
+
+static void
+include_collect (unsigned id, const char *name, bool is_url, void *ud)
+{
+	ucl_object_t *names = ud;
+
+	assert (!is_url && id == names->len);
+	ucl_array_append (names, ucl_object_fromstring (name));
+}
+
+static void
+include_wait (unsigned id, const char *name, bool is_url, void *ud)
+{
+}
+
+static void
+include_supply (unsigned id, const char *name, bool is_url, void *ud)
+{
+	assert (ucl_parser_include_data (ud, id, (const unsigned char *)"a = 1;", 6));
+}
+
+/*
+ * Emit an object compressed to a file and parse it back with the specified
+ * limit of decompressed size, *res is NULL if the limit has been exceeded.
+ * Returns false if the format is not supported by this build.
+ */
+static bool
+compressed_parse (enum ucl_compression_type type, const ucl_object_t *obj,
+		size_t max_size, ucl_object_t **res)
+{
+	struct ucl_emitter_functions *fn, *cfn;
+	struct ucl_parser *parser;
+	FILE *tmp;
+
+	tmp = tmpfile ();
+	assert (tmp != NULL);
+	fn = ucl_object_emit_file_funcs (tmp);
+	cfn = ucl_object_emit_compressed_funcs (fn, type, 0);
+
+	if (cfn == NULL) {
+		ucl_object_emit_funcs_free (fn);
+		fclose (tmp);
+		return false;
+	}
+
+	assert (ucl_object_emit_full (obj, UCL_EMIT_JSON_COMPACT, cfn, NULL));
+	ucl_object_emit_funcs_free (cfn);
+	ucl_object_emit_funcs_free (fn);
+	assert (fflush (tmp) == 0);
+
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_set_max_decompressed_size (parser, max_size));
+
+	if (ucl_parser_add_fd (parser, fileno (tmp))) {
+		*res = ucl_parser_get_object (parser);
+	}
+	else {
+		assert (strstr (ucl_parser_get_error (parser), "exceeds") != NULL);
+		*res = NULL;
+	}
+
+	ucl_parser_free (parser);
+	fclose (tmp);
+
+	return true;
+}
+
+/*
+ * Write a file named `name` in `dir` and return its path in `path`
+ */
+static void
+write_file (const char *dir, const char *name, const char *content,
+		char *path, size_t pathlen)
+{
+	FILE *f;
+
+	snprintf (path, pathlen, "%s/%s", dir, name);
+	f = fopen (path, "w");
+	assert (f != NULL);
+	assert (fputs (content, f) >= 0);
+	assert (fclose (f) == 0);
+}
+
+/*
+ * Remove a temporary directory with all files in it
+ */
+static void
+remove_dir (const char *dir)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	DIR *d;
+
+	d = opendir (dir);
+	assert (d != NULL);
+	while ((de = readdir (d)) != NULL) {
+		if (strcmp (de->d_name, ".") != 0 && strcmp (de->d_name, "..") != 0) {
+			snprintf (path, sizeof (path), "%s/%s", dir, de->d_name);
+			unlink (path);
+		}
+	}
+	closedir (d);
+	rmdir (dir);
+}
+
+/*
+ * Include a URL and return the value of `a` from it or -1 if the include
+ * has failed
+ */
+static int64_t
+url_include_parse (const char *url)
+{
+	struct ucl_parser *parser;
+	ucl_object_t *top;
+	char buf[PATH_MAX + 64];
+	int64_t res = -1;
+
+	snprintf (buf, sizeof (buf), ".include(url=true) \"%s\"", url);
+	parser = ucl_parser_new (0);
+
+	if (ucl_parser_add_string (parser, buf, 0)) {
+		top = ucl_parser_get_object (parser);
+		res = ucl_object_toint (ucl_object_lookup (top, "a"));
+		ucl_object_unref (top);
+	}
+
+	ucl_parser_free (parser);
+
+	return res;
+}
+
+/*
+ * Fetch a file:// URL through the URL cache: an unchanged document is
+ * served from the cache, a newer one is fetched again and a missing one
+ * falls back to the cached copy. Skipped when URL includes are not built in.
+ */
+static void
+url_cache_test (void)
+{
+	char dir[] = "/tmp/ucl-url-XXXXXX", cache[PATH_MAX], doc[PATH_MAX],
+		url[PATH_MAX + 16];
+	struct utimbuf times;
+
+	assert (mkdtemp (dir) != NULL);
+	snprintf (cache, sizeof (cache), "%s/cache", dir);
+	write_file (dir, "doc.conf", "a = 1;", doc, sizeof (doc));
+	snprintf (url, sizeof (url), "file://%s", doc);
+	times.actime = times.modtime = 1000000000;
+	assert (utime (doc, &times) == 0);
+	ucl_set_url_cache (cache);
+
+	if (url_include_parse (url) == 1) {
+		/* Same mtime, so the cached copy is still valid */
+		write_file (dir, "doc.conf", "a = 2;", doc, sizeof (doc));
+		assert (utime (doc, &times) == 0);
+		assert (url_include_parse (url) == 1);
+		/* Modified document is fetched again */
+		times.actime = times.modtime += 100;
+		assert (utime (doc, &times) == 0);
+		assert (url_include_parse (url) == 2);
+		/* Unreachable document is served from the cache */
+		unlink (doc);
+		assert (url_include_parse (url) == 2);
+		ucl_set_url_cache (NULL);
+		assert (url_include_parse (url) == -1);
+		remove_dir (cache);
+	}
+
+	ucl_set_url_cache (NULL);
+	unlink (doc);
+	remove_dir (dir);
+}
+
+/*
+ * Parse an include followed by a key it also defines, either blocking, with
+ * contents supplied by the fetcher itself or supplied after the chunk
+ */
+static char *
+include_order_parse (const char *path, ucl_include_fetcher fetcher)
+{
+	struct ucl_parser *parser;
+	ucl_object_t *top;
+	char buf[PATH_MAX + 32];
+	char *res;
+
+	snprintf (buf, sizeof (buf), ".include \"%s\"\na = 2;\n", path);
+	parser = ucl_parser_new (0);
+	if (fetcher != NULL) {
+		ucl_parser_set_include_fetcher (parser, fetcher, parser);
+	}
+	assert (ucl_parser_add_string (parser, buf, 0));
+	if (ucl_parser_pending_includes (parser) > 0) {
+		assert (ucl_parser_include_data (parser, 0,
+				(const unsigned char *)"a = 1;", 6));
+	}
+
+	top = ucl_parser_get_object (parser);
+	res = (char *)ucl_object_emit (top, UCL_EMIT_JSON_COMPACT);
+	ucl_object_unref (top);
+	ucl_parser_free (parser);
+
+	return res;
+}
+
+/*
+ * Contents supplied from the fetcher are parsed at the directive like a
+ * blocking include, later contents go after the rest of the chunk
+ */
+static void
+include_order_test (void)
+{
+	char dir[] = "/tmp/ucl-inc-XXXXXX", path[PATH_MAX];
+	char *res;
+
+	assert (mkdtemp (dir) != NULL);
+	write_file (dir, "x.conf", "a = 1;", path, sizeof (path));
+
+	res = include_order_parse (path, NULL);
+	assert (strcmp (res, "{\"a\":[1,2]}") == 0);
+	free (res);
+	res = include_order_parse (path, include_supply);
+	assert (strcmp (res, "{\"a\":[1,2]}") == 0);
+	free (res);
+	res = include_order_parse (path, include_wait);
+	assert (strcmp (res, "{\"a\":[2,1]}") == 0);
+	free (res);
+
+	unlink (path);
+	remove_dir (dir);
+}
+
+/*
+ * Get the object of a watcher as compact JSON
+ */
+static char *
+watcher_emit (struct ucl_watcher *w)
+{
+	ucl_object_t *top;
+	char *res;
+
+	top = ucl_watcher_get_object (w);
+	assert (top != NULL);
+	res = (char *)ucl_object_emit (top, UCL_EMIT_JSON_COMPACT);
+	ucl_object_unref (top);
+
+	return res;
+}
+
+static void
+watcher_check (struct ucl_watcher *w, const char *expected)
+{
+	char *res;
+
+	res = watcher_emit (w);
+	assert (strcmp (res, expected) == 0);
+	free (res);
+}
+
+/*
+ * A file that fails to parse is retried along with other changed files
+ */
+static void
+watcher_retry_test (void)
+{
+	char dir[] = "/tmp/ucl-watch-XXXXXX", top[PATH_MAX], inc[PATH_MAX],
+		buf[PATH_MAX + 32];
+	struct ucl_watcher *w;
+
+	assert (mkdtemp (dir) != NULL);
+	write_file (dir, "inc.conf", "b = 1;", inc, sizeof (inc));
+	snprintf (buf, sizeof (buf), "t = 1;\n.include \"%s\"\n", inc);
+	write_file (dir, "top.conf", buf, top, sizeof (top));
+
+	w = ucl_watcher_new (top, NULL, NULL);
+	assert (w != NULL);
+	assert (ucl_watcher_update (w, NULL));
+	watcher_check (w, "{\"t\":1,\"b\":1}");
+
+	write_file (dir, "inc.conf", "b = \"x", inc, sizeof (inc));
+	snprintf (buf, sizeof (buf), "t = 5;\n.include \"%s\"\n", inc);
+	write_file (dir, "top.conf", buf, top, sizeof (top));
+	ucl_watcher_notify (w, inc);
+	ucl_watcher_notify (w, top);
+	assert (!ucl_watcher_update (w, NULL));
+	assert (ucl_watcher_get_error (w) != NULL);
+	watcher_check (w, "{\"t\":1,\"b\":1}");
+
+	write_file (dir, "inc.conf", "b = 2;", inc, sizeof (inc));
+	ucl_watcher_notify (w, inc);
+	assert (ucl_watcher_update (w, NULL));
+	assert (ucl_watcher_get_error (w) == NULL);
+	watcher_check (w, "{\"t\":5,\"b\":2}");
+
+	ucl_watcher_free (w);
+	unlink (inc);
+	unlink (top);
+	remove_dir (dir);
+}
+
+/*
+ * Watcher reparses a changed include and replaces only its keys
+ */
+static void
+watcher_splice_test (void)
+{
+	char dir[] = "/tmp/ucl-watch-XXXXXX", top[PATH_MAX], inc[PATH_MAX],
+		buf[PATH_MAX + 64];
+	struct ucl_watcher *w;
+	ucl_object_t *changes, *prev, *cur;
+	unsigned char *emitted;
+
+	assert (mkdtemp (dir) != NULL);
+	write_file (dir, "inc.conf", "b = 1; c = 2;\n", inc, sizeof (inc));
+	snprintf (buf, sizeof (buf), "a = 1;\ns { .include \"%s\" }\nz = 2;\n",
+			inc);
+	write_file (dir, "top.conf", buf, top, sizeof (top));
+
+	w = ucl_watcher_new (top, NULL, NULL);
+	assert (w != NULL);
+	assert (ucl_watcher_update (w, &changes));
+	assert (changes != NULL);
+	ucl_object_unref (changes);
+	prev = ucl_watcher_get_object (w);
+
+	write_file (dir, "inc.conf", "b = 3; d = 4;\n", inc, sizeof (inc));
+	ucl_watcher_notify (w, inc);
+	assert (ucl_watcher_update (w, &changes));
+	watcher_check (w, "{\"a\":1,\"s\":{\"b\":3,\"d\":4},\"z\":2}");
+	/* Values outside of the include are shared with the old object */
+	cur = ucl_watcher_get_object (w);
+	assert (ucl_object_lookup (cur, "z") == ucl_object_lookup (prev, "z"));
+	emitted = ucl_object_emit (ucl_object_lookup (changes, "paths"),
+			UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, "[\"/s/b\",\"/s/c\",\"/s/d\"]") == 0);
+	free (emitted);
+	ucl_object_unref (changes);
+
+	/* Nothing has changed */
+	assert (ucl_watcher_update (w, &changes));
+	assert (changes == NULL);
+
+	ucl_object_unref (prev);
+	ucl_object_unref (cur);
+	ucl_watcher_free (w);
+	unlink (inc);
+	unlink (top);
+	remove_dir (dir);
+}
+
+/*
+ * Removed optional files, new files matching a pattern and keys that clash
+ * with other keys are handled by reparsing the including file
+ */
+static void
+watcher_files_test (void)
+{
+	char dir[] = "/tmp/ucl-watch-XXXXXX", top[PATH_MAX], opt[PATH_MAX],
+		g1[PATH_MAX], g2[PATH_MAX], inc[PATH_MAX], buf[PATH_MAX * 3 + 128];
+	struct ucl_watcher *w;
+	ucl_object_t *changes;
+	const ucl_object_t *files;
+
+	assert (mkdtemp (dir) != NULL);
+	write_file (dir, "opt.conf", "o = 1;", opt, sizeof (opt));
+	write_file (dir, "g1.part", "g1 = 1;", g1, sizeof (g1));
+	write_file (dir, "inc.conf", "b = 1;", inc, sizeof (inc));
+	snprintf (buf, sizeof (buf), "a = 1;\n.include(try=true) \"%s\"\n"
+			"g { .include(glob=true) \"%s/*.part\" }\n.include \"%s\"\n",
+			opt, dir, inc);
+	write_file (dir, "top.conf", buf, top, sizeof (top));
+
+	w = ucl_watcher_new (top, NULL, NULL);
+	assert (w != NULL);
+	assert (ucl_watcher_update (w, NULL));
+	watcher_check (w, "{\"a\":1,\"o\":1,\"g\":{\"g1\":1},\"b\":1}");
+
+	/* Removal */
+	unlink (opt);
+	ucl_watcher_notify (w, opt);
+	assert (ucl_watcher_update (w, &changes));
+	watcher_check (w, "{\"a\":1,\"g\":{\"g1\":1},\"b\":1}");
+	files = ucl_object_lookup (changes, "files");
+	assert (files != NULL && files->len == 1);
+	assert (strcmp (ucl_object_tostring (ucl_array_find_index (files, 0)),
+			opt) == 0);
+	ucl_object_unref (changes);
+
+	/* Glob match */
+	write_file (dir, "g2.part", "g2 = 2;", g2, sizeof (g2));
+	ucl_watcher_notify (w, g2);
+	assert (ucl_watcher_update (w, NULL));
+	watcher_check (w, "{\"a\":1,\"g\":{\"g1\":1,\"g2\":2},\"b\":1}");
+
+	/* Key clash, the whole file is parsed as usual */
+	write_file (dir, "inc.conf", "a = 2;", inc, sizeof (inc));
+	ucl_watcher_notify (w, inc);
+	assert (ucl_watcher_update (w, NULL));
+	watcher_check (w, "{\"a\":[1,2],\"g\":{\"g1\":1,\"g2\":2}}");
+
+	ucl_watcher_free (w);
+	unlink (g1);
+	unlink (g2);
+	unlink (inc);
+	unlink (top);
+	remove_dir (dir);
+}
+
+/*
+ * Files written in a watched directory are noticed without notifications
+ */
+static void
+watcher_inotify_test (void)
+{
+	char dir[] = "/tmp/ucl-watch-XXXXXX", top[PATH_MAX];
+	struct ucl_watcher *w;
+	struct pollfd pfd;
+
+	assert (mkdtemp (dir) != NULL);
+	write_file (dir, "top.conf", "a = 1;", top, sizeof (top));
+
+	w = ucl_watcher_new (top, NULL, NULL);
+	assert (w != NULL);
+	assert (ucl_watcher_update (w, NULL));
+
+	pfd.fd = ucl_watcher_get_fd (w);
+	if (pfd.fd != -1) {
+		pfd.events = POLLIN;
+		write_file (dir, "top.conf", "a = 2;", top, sizeof (top));
+		assert (poll (&pfd, 1, 5000) == 1);
+		assert (ucl_watcher_update (w, NULL));
+		watcher_check (w, "{\"a\":2}");
+	}
+
+	ucl_watcher_free (w);
+	unlink (top);
+	remove_dir (dir);
+}
+
+/*
+ * Parse a document in slices of a few bytes and compare it with a single pass
+ */
+static void
+sliced_parse_test (void)
+{
+	static const char doc[] = "a = 1; b { c = [1, 2, 3]; d = \"x\" }\n"
+			"e = true; f { g { h = 1.5 } }\ni = \"last\"\n";
+	struct ucl_parser *parser;
+	enum ucl_parser_progress pr;
+	ucl_object_t *sliced, *whole;
+	unsigned char *emitted, *expected;
+	int slices = 1;
+
+	parser = ucl_parser_new (0);
+	pr = ucl_parser_add_chunk_sliced (parser, (const unsigned char *)doc,
+			sizeof (doc) - 1, 4, 0);
+	assert (pr == UCL_PROGRESS_AGAIN);
+	/* Other chunks cannot be added while one is parsed in slices */
+	assert (!ucl_parser_add_string (parser, "j = 1", 0));
+	ucl_parser_clear_error (parser);
+	while ((pr = ucl_parser_resume (parser, 4, 0)) == UCL_PROGRESS_AGAIN) {
+		slices ++;
+	}
+	assert (pr == UCL_PROGRESS_DONE && slices > 3);
+	assert (ucl_parser_resume (parser, 0, 0) == UCL_PROGRESS_ERROR);
+	sliced = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, doc, 0));
+	whole = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+
+	emitted = ucl_object_emit (sliced, UCL_EMIT_JSON_COMPACT);
+	expected = ucl_object_emit (whole, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, (char *)expected) == 0);
+	free (emitted);
+	free (expected);
+	ucl_object_unref (sliced);
+	ucl_object_unref (whole);
+}
+
+/*
+ * Batch parsing keeps results and errors in input order
+ */
+static void
+batch_parse_test (void)
+{
+	static const char *docs[] = {
+		"a = 1; B = 2;",
+		"{\"c\": [1, 2]}",
+		"d = [1, 2}",
+		"A = \"x\";",
+		"e = 3; e = 4;",
+	};
+	static const char *results[] = {
+		"{\"a\":1,\"B\":2}",
+		"{\"c\":[1,2]}",
+		NULL,
+		"{\"a\":\"x\"}",
+		"{\"e\":[3,4]}",
+	};
+	struct ucl_batch_item items[6];
+	ucl_object_t *obj;
+	unsigned char *packed, *emitted;
+	size_t packed_len;
+	int i;
+
+	obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (obj, ucl_object_fromint (5), "m", 0, false);
+	packed = ucl_object_emit_len (obj, UCL_EMIT_MSGPACK, &packed_len);
+	ucl_object_unref (obj);
+
+	memset (items, 0, sizeof (items));
+	for (i = 0; i < 5; i ++) {
+		items[i].data = (const unsigned char *)docs[i];
+		items[i].len = strlen (docs[i]);
+		items[i].parse_type = UCL_PARSE_UCL;
+	}
+	items[3].flags = UCL_PARSER_KEY_LOWERCASE;
+	items[5].data = packed;
+	items[5].len = packed_len;
+	items[5].parse_type = UCL_PARSE_MSGPACK;
+
+	/* Returns the number of failed items */
+	assert (ucl_parse_batch (items, 6, 4) == 1);
+	for (i = 0; i < 5; i ++) {
+		if (results[i] == NULL) {
+			assert (items[i].obj == NULL && items[i].err != NULL);
+			free (items[i].err);
+			continue;
+		}
+		assert (items[i].err == NULL);
+		emitted = ucl_object_emit (items[i].obj, UCL_EMIT_JSON_COMPACT);
+		assert (strcmp ((char *)emitted, results[i]) == 0);
+		free (emitted);
+		ucl_object_unref (items[i].obj);
+	}
+	assert (ucl_object_toint (ucl_object_lookup (items[5].obj, "m")) == 5);
+	ucl_object_unref (items[5].obj);
+	free (packed);
+}
+
+/*
+ * Parse chunks with priorities using parser flags and compare the result
+ */
+static void
+priority_parse_check (int flags, const char *first, unsigned prio,
+		const char *second, const char *expected)
+{
+	struct ucl_parser *parser;
+	ucl_object_t *top;
+	unsigned char *emitted;
+
+	parser = ucl_parser_new (flags);
+	assert (ucl_parser_add_chunk_priority (parser,
+			(const unsigned char *)first, strlen (first), prio));
+	assert (ucl_parser_add_chunk_priority (parser,
+			(const unsigned char *)second, strlen (second), 0));
+	top = ucl_parser_get_object (parser);
+	emitted = ucl_object_emit (top, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, expected) == 0);
+	free (emitted);
+	ucl_object_unref (top);
+	ucl_parser_free (parser);
+}
+
+/*
+ * Values that refer to the input keep the priority of their chunk
+ */
+static void
+borrowed_priority_test (void)
+{
+	static const int flags[] = {
+		0,
+		UCL_PARSER_ZEROCOPY,
+		UCL_PARSER_LAZY_UNESCAPE,
+		UCL_PARSER_ZEROCOPY|UCL_PARSER_LAZY_UNESCAPE,
+	};
+	unsigned i;
+
+	for (i = 0; i < sizeof (flags) / sizeof (flags[0]); i ++) {
+		priority_parse_check (flags[i], "a = 1;", 1, "a = str;", "{\"a\":1}");
+		priority_parse_check (flags[i], "a = x;", 0, "a = \"y\\tz\";",
+				"{\"a\":[\"x\",\"y\\tz\"]}");
+		priority_parse_check (flags[i], "a = x; a = \"y\";", 0, "b = z;",
+				"{\"a\":[\"x\",\"y\"],\"b\":\"z\"}");
+		priority_parse_check (flags[i], "a = x;", 0, "a = y;",
+				"{\"a\":[\"x\",\"y\"]}");
+		priority_parse_check (flags[i], "a = x;", 0, ".priority 2\na = y;",
+				"{\"a\":\"y\"}");
+	}
+}
+
+/*
+ * Copies, diffs and patches keep implicit arrays including containers
+ */
+static void
+diff_patch_roundtrip_test (void)
+{
+	static const char *docs[] = {
+		"a = 1; a = 2; b = 3;",
+		"s { p = {key = value}; p = {k2 = v} }; z = 1;",
+		"p { a = 1 } p { b = 2 } q [1, 2] q [3]",
+		"x { y { z = 1; z = { w = 2 } } }",
+	};
+	struct ucl_parser *parser;
+	ucl_object_t *from, *to, *cp, *ops;
+	unsigned char *emitted;
+	unsigned i;
+
+	for (i = 0; i < sizeof (docs) / sizeof (docs[0]); i ++) {
+		parser = ucl_parser_new (0);
+		assert (ucl_parser_add_string (parser, docs[i], 0));
+		from = ucl_parser_get_object (parser);
+		ucl_parser_free (parser);
+		cp = ucl_object_copy (from);
+		assert (ucl_object_compare (from, cp) == 0);
+		assert (ucl_object_hash (from) == ucl_object_hash (cp));
+		ops = ucl_object_diff (from, cp);
+		assert (ops != NULL && ops->len == 0);
+		ucl_object_unref (ops);
+		ucl_object_unref (cp);
+		ucl_object_unref (from);
+	}
+
+	/* Patching a sibling keeps the second member of `s.p` */
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, docs[1], 0));
+	from = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser,
+			"[{op = replace; path = \"/z\"; value = 2}]", 0));
+	ops = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (ucl_object_patch (&from, ops));
+	ucl_object_unref (ops);
+	emitted = ucl_object_emit (from, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, "{\"s\":{\"p\":[{\"key\":\"value\"},"
+			"{\"k2\":\"v\"}]},\"z\":2}") == 0);
+	free (emitted);
+
+	/* Diff towards an implicit array of objects and apply it back */
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser,
+			"s { p = {key = value}; p = {k3 = w} }; z = 3;", 0));
+	to = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	ops = ucl_object_diff (from, to);
+	assert (ops != NULL && ops->len > 0);
+	assert (ucl_object_patch (&from, ops));
+	ucl_object_unref (ops);
+	assert (ucl_object_compare (from, to) == 0);
+	ops = ucl_object_diff (from, to);
+	assert (ops != NULL && ops->len == 0);
+	ucl_object_unref (ops);
+
+	/* Sealed trees are diffed by their cached hashes */
+	cp = ucl_object_copy (from);
+	ucl_object_seal (cp);
+	ucl_object_seal (to);
+	ops = ucl_object_diff (cp, to);
+	assert (ops != NULL && ops->len == 0);
+	ucl_object_unref (ops);
+	assert (ucl_object_replace_key (from, ucl_object_fromint (4), "z", 0,
+			false));
+	ucl_object_unref (cp);
+	cp = ucl_object_copy (from);
+	ucl_object_seal (cp);
+	ops = ucl_object_diff (to, cp);
+	assert (ops != NULL && ops->len == 1);
+	emitted = ucl_object_emit (ops, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted,
+			"[{\"op\":\"replace\",\"path\":\"/z\",\"value\":4}]") == 0);
+	free (emitted);
+	ucl_object_unref (ops);
+	ucl_object_unref (cp);
+	ucl_object_unref (to);
+	ucl_object_unref (from);
+}
+
+/*
+ * Hashes depend on the content only, not on how the object was built
+ */
+static void
+hash_content_test (void)
+{
+	struct ucl_parser *parser;
+	ucl_object_t *parsed, *built, *cp;
+
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, "a = 1; a = 2; b { c = 3 }", 0));
+	parsed = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+
+	built = ucl_object_typed_new (UCL_OBJECT);
+	cp = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (cp, ucl_object_fromint (3), "c", 0, false);
+	ucl_object_insert_key (built, cp, "b", 0, false);
+	ucl_object_insert_key (built, ucl_object_fromint (1), "a", 0, false);
+	ucl_object_insert_key (built, ucl_object_fromint (2), "a", 0, false);
+	assert (ucl_object_hash (parsed) == ucl_object_hash (built));
+
+	cp = ucl_object_copy (built);
+	assert (ucl_object_hash (cp) == ucl_object_hash (built));
+	ucl_object_seal (cp);
+	assert (ucl_object_hash (cp) == ucl_object_hash (parsed));
+	ucl_object_unref (cp);
+
+	ucl_object_replace_key (built, ucl_object_fromint (4), "b", 0, false);
+	assert (ucl_object_hash (parsed) != ucl_object_hash (built));
+
+	ucl_object_unref (built);
+	ucl_object_unref (parsed);
+}
+
+/*
+ * Reading packed arrays as objects must not unpack them
+ */
+static void
+packed_read_test (void)
+{
+	static const int64_t values[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+	ucl_object_t *top, *ar, *cp, *cp2;
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+	unsigned char *emitted;
+	int64_t sum = 0;
+
+	ar = ucl_array_new_packed_int (values, 10);
+	top = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (top, ar, "a", 0, false);
+
+	while ((cur = ucl_object_iterate (ar, &it, true)) != NULL) {
+		sum += ucl_object_toint (cur);
+	}
+	assert (sum == 55);
+	it = ucl_object_iterate_new (ar);
+	sum = 0;
+	while ((cur = ucl_object_iterate_safe (it, true)) != NULL) {
+		sum += ucl_object_toint (cur);
+	}
+	ucl_object_iterate_free (it);
+	assert (sum == 55);
+	assert (ucl_object_toint (ucl_array_head (ar)) == 1);
+	assert (ucl_object_toint (ucl_array_tail (ar)) == 10);
+	assert (ucl_array_find_index (ar, 10) == NULL);
+	cur = ucl_array_find_index (ar, 4);
+	assert (ucl_array_index_of (ar, (ucl_object_t *)cur) == 4);
+	assert (ucl_object_toint (ucl_object_lookup_path (top, "a.4")) == 5);
+	/* References to elements are independent copies */
+	cp = ucl_object_ref (cur);
+	assert (cp != cur && ucl_object_toint (cp) == 5);
+	assert (ucl_array_is_packed (ar));
+
+	/* Sealed arrays stay packed and cannot be unpacked by modifications */
+	ucl_object_seal (top);
+	assert (ucl_array_is_packed (ar));
+	assert (ucl_object_is_sealed (ucl_array_find_index (ar, 2)));
+	assert (ucl_object_toint (ucl_array_find_index (ar, 2)) == 3);
+	assert (ucl_array_delete (ar, (ucl_object_t *)cur) == NULL);
+	cp2 = ucl_object_fromint (11);
+	assert (!ucl_array_append (ar, cp2));
+	ucl_object_unref (cp2);
+	assert (ucl_array_is_packed (ar));
+	emitted = ucl_object_emit (top, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, "{\"a\":[1,2,3,4,5,6,7,8,9,10]}") == 0);
+	free (emitted);
+	ucl_object_unref (top);
+	assert (ucl_object_toint (cp) == 5);
+	ucl_object_unref (cp);
+}
+
 int
 main (int argc, char **argv)
 {
-	ucl_object_t *obj, *cur, *ar, *ar1, *ref, *test_obj;
+	ucl_object_t *obj, *cur, *ar, *ar1, *ref, *test_obj, *macro_args[4];
 	ucl_object_iter_t it;
 	const ucl_object_t *found, *it_obj, *test;
-	FILE *out;
+	FILE *out, *tmp;
+	struct ucl_emitter_functions *fn, *gz;
 	unsigned char *emitted;
 	const char *fname_out = NULL;
 	struct ucl_parser *parser;
-	int ret = 0;
+	int ret = 0, i, fds[2];
+	size_t len;
 
 	switch (argc) {
 	case 2:
@@ -245,6 +1038,552 @@ main (int argc, char **argv)
 	assert (ucl_object_type (it_obj) == UCL_BOOLEAN);
 	ucl_object_iterate_free (it);
 
+	/* Test sealed trees */
+	parser = ucl_parser_new (0);
+	ucl_parser_add_string (parser, "key0 = 1; key4 = [1, 2]; key5 = {key6 = 3};", 0);
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	ucl_object_seal (test_obj);
+	assert (ucl_object_is_sealed (test_obj));
+	found = ucl_object_lookup (test_obj, "key4");
+	assert (found != NULL && ucl_object_is_sealed (found));
+	/* Refcount of sealed elements is pinned */
+	assert (ucl_object_ref (found) == found);
+	ucl_object_unref ((ucl_object_t *)found);
+	cur = ucl_object_fromint (1);
+	assert (!ucl_object_insert_key (test_obj, cur, "key10", 0, false));
+	assert (!ucl_object_delete_key (test_obj, "key0"));
+	assert (ucl_array_pop_first (ucl_object_ref (found)) == NULL);
+	ucl_object_unref (cur);
+	/* Sealed elements keep their keys */
+	cur = ucl_object_typed_new (UCL_OBJECT);
+	assert (!ucl_object_insert_key (cur, ucl_object_ref (found), "other", 0,
+			false));
+	assert (strcmp (ucl_object_key (found), "key4") == 0);
+	ucl_object_unref (cur);
+	/* Copies are mutable */
+	cur = ucl_object_copy (test_obj);
+	assert (!ucl_object_is_sealed (cur));
+	assert (ucl_object_delete_key (cur, "key0"));
+
+	/* Test diff and patch */
+	ar = ucl_object_diff (test_obj, cur);
+	assert (ar != NULL && ucl_object_type (ar) == UCL_ARRAY && ar->len == 1);
+	assert (ucl_object_patch (&test_obj, ar));
+	assert (!ucl_object_is_sealed (test_obj));
+	assert (ucl_object_compare (test_obj, cur) == 0);
+	ucl_object_unref (ar);
+	ar = ucl_object_diff (test_obj, cur);
+	assert (ar != NULL && ar->len == 0);
+	ucl_object_unref (ar);
+
+	/* Test content hashes */
+	assert (ucl_object_hash (test_obj) == ucl_object_hash (cur));
+	ucl_object_seal (cur);
+	assert (ucl_object_hash (test_obj) == ucl_object_hash (cur));
+	assert (ucl_object_hash (cur) == ucl_object_hash (cur));
+	assert (ucl_object_hash (ucl_object_lookup (cur, "key4")) !=
+			ucl_object_hash (ucl_object_lookup (cur, "key5")));
+	ucl_object_unref (cur);
+	ucl_object_unref (test_obj);
+	/* Merge patch copies sealed subtrees of a mutable target */
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser, "a { b = 1; c = 2 } d = 1;"
+			"p { a { b = null; e = 3 } }", 0));
+	ar = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	ar1 = ucl_object_ref (ucl_object_lookup (ar, "a"));
+	ucl_object_seal (ar1);
+	cur = ucl_object_pop_key (ar, "p");
+	assert (ucl_object_merge_patch (&ar, cur));
+	ucl_object_unref (cur);
+	emitted = ucl_object_emit (ar, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted,
+			"{\"d\":1,\"a\":{\"c\":2,\"e\":3}}") == 0);
+	free (emitted);
+	emitted = ucl_object_emit (ar1, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, "{\"b\":1,\"c\":2}") == 0);
+	free (emitted);
+	ucl_object_unref (ar1);
+	ucl_object_unref (ar);
+	/* Test reservation */
+	test_obj = ucl_object_new_reserved (UCL_ARRAY, 0, 100);
+	assert (test_obj != NULL);
+	for (i = 0; i < 100; i ++) {
+		assert (ucl_array_append (test_obj, ucl_object_fromint (i)));
+	}
+	assert (ucl_array_reserve (test_obj, 10));
+	assert (test_obj->len == 100);
+	assert (ucl_object_toint (ucl_array_find_index (test_obj, 99)) == 99);
+	ucl_object_unref (test_obj);
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	assert (ucl_object_reserve (test_obj, 100));
+	for (i = 0; i < 100; i ++) {
+		char kbuf[16];
+
+		snprintf (kbuf, sizeof (kbuf), "key%d", i);
+		assert (ucl_object_insert_key (test_obj, ucl_object_fromint (i),
+				kbuf, 0, true));
+	}
+	assert (ucl_object_toint (ucl_object_lookup (test_obj, "key42")) == 42);
+	ucl_object_unref (test_obj);
+
+	/* Test packed arrays */
+	parser = ucl_parser_new (UCL_PARSER_PACK_ARRAYS);
+	ucl_parser_add_string (parser, "a = [1, 2, 3, 4, 5, 6, 7, 8, 9, -10];"
+			"b = [0.5, 1.5, 2.5, 3.5, 4.5, 5.5, 6.5, 7.5];"
+			"c = [1, 2, 3, 4, 5, 6, 7, 8.5];", 0);
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	found = ucl_object_lookup (test_obj, "a");
+	assert (ucl_array_is_packed (found));
+	assert (ucl_array_packed_int (found, NULL) != NULL);
+	{
+		int64_t isum, imin, imax;
+		double dsum, dmin, dmax;
+		ucl_object_t *elt;
+		size_t nelts;
+
+		assert (ucl_array_packed_int (found, &nelts)[9] == -10 && nelts == 10);
+		assert (ucl_array_int_stats (found, &isum, &imin, &imax));
+		assert (isum == 35 && imin == -10 && imax == 9);
+		assert (ucl_array_double_stats (ucl_object_lookup (test_obj, "b"),
+				&dsum, &dmin, &dmax));
+		assert (dsum == 32.0 && dmin == 0.5 && dmax == 7.5);
+		assert (!ucl_array_is_packed (ucl_object_lookup (test_obj, "c")));
+		emitted = ucl_object_emit (found, UCL_EMIT_JSON_COMPACT);
+		assert (strcmp ((char *)emitted, "[1,2,3,4,5,6,7,8,9,-10]") == 0);
+		free (emitted);
+		/* Packed and normal arrays are equal */
+		cur = ucl_object_copy (found);
+		assert (ucl_array_is_packed (cur));
+		ar = ucl_array_new_packed_int (ucl_array_packed_int (found, NULL), 10);
+		assert (ucl_object_hash (ar) == ucl_object_hash (found));
+		/* Access to elements keeps an array packed */
+		assert (ucl_object_toint (ucl_array_find_index (found, 9)) == -10);
+		assert (ucl_array_is_packed (found));
+		/* Modifications unpack it */
+		elt = ucl_array_delete ((ucl_object_t *)found,
+				(ucl_object_t *)ucl_array_find_index (found, 9));
+		assert (ucl_object_toint (elt) == -10);
+		assert (!ucl_array_is_packed (found));
+		assert (ucl_array_append ((ucl_object_t *)found, elt));
+		assert (ucl_object_hash (ar) == ucl_object_hash (found));
+		assert (ucl_object_compare (cur, found) == 0);
+		assert (ucl_array_int_stats (found, &isum, NULL, NULL) && isum == 35);
+		assert (ucl_array_pack ((ucl_object_t *)found));
+		/* Comparison reads packed values directly */
+		assert (ucl_object_compare (cur, found) == 0);
+		assert (ucl_object_compare (ar, found) == 0);
+		assert (ucl_array_is_packed (found) && ucl_array_is_packed (ar));
+		ucl_object_unref (ar);
+		ucl_object_unref (cur);
+	}
+	ucl_object_unref (test_obj);
+
+	/* Test layered merge */
+	{
+		static const char *layer_src[] = {
+			"a = 1; b { x = 1; y = 2; }; c = [1]; d = 1;",
+			"a = 2; b { y = 3; z = 4; }; c = [2]; d = 2;",
+			"a = 3; e = 5;",
+		};
+		static const unsigned layer_prio[] = {0, 0, 5};
+		static const enum ucl_duplicate_strategy layer_strat[] = {
+			UCL_DUPLICATE_APPEND, UCL_DUPLICATE_MERGE, UCL_DUPLICATE_APPEND
+		};
+		struct ucl_merge_layer layers[3];
+		unsigned char *emitted1;
+
+		/* The result must be the same as for a single parser */
+		parser = ucl_parser_new (0);
+		for (i = 0; i < 3; i ++) {
+			assert (ucl_parser_add_chunk_full (parser,
+					(const unsigned char *)layer_src[i], strlen (layer_src[i]),
+					layer_prio[i], layer_strat[i], UCL_PARSE_UCL));
+		}
+		test_obj = ucl_parser_get_object (parser);
+		ucl_parser_free (parser);
+
+		for (i = 0; i < 3; i ++) {
+			parser = ucl_parser_new (0);
+			ucl_parser_add_string (parser, layer_src[i], 0);
+			layers[i].obj = ucl_parser_get_object (parser);
+			layers[i].priority = layer_prio[i];
+			layers[i].strategy = layer_strat[i];
+			ucl_parser_free (parser);
+		}
+
+		cur = ucl_object_merge_layers (layers, 3);
+		assert (cur != NULL);
+		emitted = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+		emitted1 = ucl_object_emit (cur, UCL_EMIT_JSON_COMPACT);
+		assert (strcmp ((char *)emitted, (char *)emitted1) == 0);
+		free (emitted);
+		free (emitted1);
+		ucl_object_unref (cur);
+
+		layers[2].strategy = UCL_DUPLICATE_ERROR;
+		assert (ucl_object_merge_layers (layers, 3) == NULL);
+
+		for (i = 0; i < 3; i ++) {
+			ucl_object_unref ((ucl_object_t *)layers[i].obj);
+		}
+		ucl_object_unref (test_obj);
+	}
+
+	test_obj = ucl_object_fromdouble (0.5);
+	cur = ucl_object_fromdouble (0.75);
+	assert (ucl_object_compare (test_obj, cur) < 0);
+	assert (ucl_object_hash (test_obj) != ucl_object_hash (cur));
+	ucl_object_unref (cur);
+	ucl_object_unref (test_obj);
+
+	/* Deferred unescaping */
+	parser = ucl_parser_new (UCL_PARSER_LAZY_UNESCAPE);
+	assert (ucl_parser_add_string (parser, "a = \"x\\ny\"; b = plain;", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	cur = (ucl_object_t *)ucl_object_lookup (test_obj, "a");
+	assert (cur->flags & UCL_OBJECT_NEED_UNESCAPE);
+	assert (strcmp (ucl_object_tolstring (cur, &len), "x\ny") == 0);
+	assert (len == 3 && !(cur->flags & UCL_OBJECT_NEED_UNESCAPE));
+	cur = (ucl_object_t *)ucl_object_lookup (test_obj, "b");
+	assert (strcmp (ucl_object_tostring (cur), "plain") == 0);
+	emitted = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, "{\"a\":\"x\\ny\",\"b\":\"plain\"}") == 0);
+	free (emitted);
+	ucl_object_unref (test_obj);
+
+	/* Deferred containers */
+	parser = ucl_parser_new (0);
+	ucl_parser_set_lazy_depth (parser, 1);
+	assert (ucl_parser_add_string (parser,
+			"a { b { c = 1; } d = [1, \"]\", {e = 2}]; } f = 2;", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (ucl_object_lookup (test_obj, "a")->flags & UCL_OBJECT_DEFERRED);
+	assert (ucl_object_toint (ucl_object_lookup_path (test_obj, "a.b.c")) == 1);
+	assert (ucl_object_toint (ucl_object_lookup_path (test_obj, "a.d.2.e")) == 2);
+	emitted = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, "{\"a\":{\"b\":{\"c\":1},"
+			"\"d\":[1,\"]\",{\"e\":2}]},\"f\":2}") == 0);
+	free (emitted);
+	ucl_object_unref (test_obj);
+
+	parser = ucl_parser_new (0);
+	ucl_parser_set_lazy_depth (parser, 1);
+	assert (ucl_parser_add_string (parser, "a { b = ; }", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (!ucl_object_materialize (test_obj, true));
+	ucl_object_unref (test_obj);
+
+	/* Containers whose end is ambiguous are parsed right away */
+	parser = ucl_parser_new (0);
+	ucl_parser_set_lazy_depth (parser, 1);
+	assert (!ucl_parser_add_string (parser,
+			"top { a { b = 'x}y'; c = 1 } d = 2 }", 0));
+	ucl_parser_free (parser);
+
+	parser = ucl_parser_new (0);
+	ucl_parser_set_lazy_depth (parser, 1);
+	assert (ucl_parser_add_string (parser,
+			"top { a { b = x{y; c = x\"; } } d = 2", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (ucl_object_materialize (test_obj, true));
+	emitted = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted,
+			"{\"top\":{\"a\":{\"b\":\"x{y\",\"c\":\"x\\\"\"}},\"d\":2}") == 0);
+	free (emitted);
+	ucl_object_unref (test_obj);
+
+	/* Variables */
+	parser = ucl_parser_new (0);
+	ucl_parser_register_variable (parser, "A", "1");
+	ucl_parser_register_variable (parser, "AB", "2");
+	assert (ucl_parser_add_string (parser,
+			"x = $ABC; y = \"${AB}$$\"; z = \"$$A\"; w = \"${A\"", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "x")),
+			"1BC") == 0);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "y")),
+			"2$") == 0);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "z")),
+			"$$A") == 0);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "w")),
+			"${A") == 0);
+	ucl_object_unref (test_obj);
+
+	/* Pooled parsers do not keep the configuration of their previous user */
+	parser = ucl_parser_pool_get (0);
+	ucl_parser_register_variable (parser, "A", "1");
+	ucl_parser_register_macro (parser, "include", macro_args_collect, NULL);
+	ucl_parser_set_lazy_depth (parser, 1);
+	ucl_parser_pool_put (parser);
+	assert (ucl_parser_pool_get (0) == parser);
+	assert (ucl_parser_add_string (parser, "x = $A; y { z = 1 }", 0));
+	test_obj = ucl_parser_get_object (parser);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "x")),
+			"$A") == 0);
+	assert (!(ucl_object_lookup (test_obj, "y")->flags & UCL_OBJECT_DEFERRED));
+	ucl_object_unref (test_obj);
+	ucl_parser_reset (parser);
+	assert (!ucl_parser_add_string (parser, ".include \"/nonexistent\"", 0));
+	ucl_parser_pool_put (parser);
+	ucl_parser_pool_drain ();
+
+	/* Macro arguments */
+	memset (macro_args, 0, sizeof (macro_args));
+	parser = ucl_parser_new (0);
+	ucl_parser_register_macro (parser, "m", macro_args_collect, macro_args);
+	assert (ucl_parser_add_string (parser,
+			".m(a = 1, b = \"x\\ty\", c = true, d = 10s, e = hello world) x;"
+			".m(a = 1, b = \"x\\ty\", c = true, d = 10s, e = hello world) x;"
+			".m(a { b = [1, 2] }) x;", 0));
+	ucl_parser_free (parser);
+	assert (macro_args[0] == macro_args[1]);
+	assert (ucl_object_type (ucl_object_lookup (macro_args[0], "a")) == UCL_INT);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (macro_args[0], "b")),
+			"x\ty") == 0);
+	assert (ucl_object_toboolean (ucl_object_lookup (macro_args[0], "c")));
+	assert (ucl_object_type (ucl_object_lookup (macro_args[0], "d")) == UCL_TIME);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (macro_args[0], "e")),
+			"hello world") == 0);
+	assert (ucl_object_lookup_path (macro_args[2], "a.b.1") != NULL);
+	for (i = 0; i < 3; i ++) {
+		ucl_object_unref (macro_args[i]);
+	}
+
+	/* Comments and heredocs */
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_string (parser,
+			"/* a /* nested */ \"*/\" **/ a = 1; # c\n"
+			"                    \t\n  b = <<EOD\nEOD1\nEOD\n", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (ucl_object_toint (ucl_object_lookup (test_obj, "a")) == 1);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "b")),
+			"EOD1") == 0);
+	ucl_object_unref (test_obj);
+
+	/* Error position */
+	parser = ucl_parser_new (0);
+	assert (!ucl_parser_add_string (parser, "a = 1;\nb = \"x\";\n  c = ]", 0));
+	assert (ucl_parser_get_linenum (parser) == 3);
+	assert (ucl_parser_get_column (parser) == 6);
+	ucl_parser_free (parser);
+
+	/* Position is available after the input is released */
+	tmp = tmpfile ();
+	assert (tmp != NULL);
+	fputs ("a = 1;\nb = \"x\";\n  c = 2", tmp);
+	fflush (tmp);
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_fd (parser, fileno (tmp)));
+	fclose (tmp);
+	assert (ucl_parser_get_linenum (parser) == 3);
+	assert (ucl_parser_get_column (parser) == 7);
+	ucl_parser_free (parser);
+
+	/* Nesting limit */
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_set_max_depth (parser, 3));
+	assert (ucl_parser_add_string (parser, "a { b [ 1 ] }", 0));
+	ucl_parser_free (parser);
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_set_max_depth (parser, 3));
+	assert (!ucl_parser_add_string (parser, "a { b { c [ 1 ] } }", 0));
+	assert (ucl_parser_get_error_code (parser) == UCL_ENESTED);
+	ucl_parser_free (parser);
+
+	/* Zero-copy file */
+	tmp = tmpfile ();
+	assert (tmp != NULL);
+	fputs ("a = \"mapped\"; b { c = [\"x\", \"y\"] }", tmp);
+	fflush (tmp);
+	parser = ucl_parser_new (UCL_PARSER_ZEROCOPY);
+	assert (ucl_parser_add_fd (parser, fileno (tmp)));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	fclose (tmp);
+	cur = ucl_object_ref (ucl_object_lookup (test_obj, "b"));
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "a")),
+			"mapped") == 0);
+	/* Scalars that outlive the tree own their strings */
+	ar = ucl_object_ref (ucl_object_lookup (test_obj, "a"));
+	ar1 = ucl_object_copy (ucl_array_head (ucl_object_lookup_path (test_obj,
+			"b.c")));
+	ucl_object_unref (test_obj);
+	test_obj = ucl_object_copy (cur);
+	ucl_object_unref (cur);
+	assert (strcmp (ucl_object_tostring (ucl_array_tail (
+			ucl_object_lookup (test_obj, "c"))), "y") == 0);
+	ucl_object_unref (test_obj);
+	assert (strcmp (ucl_object_tostring (ar), "mapped") == 0);
+	assert (strcmp (ucl_object_key (ar), "a") == 0);
+	assert (strcmp (ucl_object_tostring (ar1), "x") == 0);
+	ucl_object_unref (ar);
+	ucl_object_unref (ar1);
+
+	/* Pipes are read instead of mapped */
+	parser = ucl_parser_new (0);
+	for (i = 0; i < 2; i ++) {
+		assert (pipe (fds) == 0);
+		assert (write (fds[1], i == 0 ? "a = 1\n" : "b = 2\n", 6) == 6);
+		close (fds[1]);
+		assert (ucl_parser_add_fd (parser, fds[0]));
+		close (fds[0]);
+	}
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	assert (ucl_object_toint (ucl_object_lookup (test_obj, "a")) == 1);
+	assert (ucl_object_toint (ucl_object_lookup (test_obj, "b")) == 2);
+	ucl_object_unref (test_obj);
+
+	/* Compressed input, either decompressed or rejected explicitly */
+	assert (pipe (fds) == 0);
+	assert (write (fds[1], "\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03\xcb\x4e"
+			"\xad\x54\xb0\x55\x50\x4a\xce\xcf\x2d\x28\x4a\x2d\x2e\x4e\x4d\x51"
+			"\xb2\xe6\x02\x00\xba\x3b\x56\x94\x14\x00\x00\x00", 40) == 40);
+	close (fds[1]);
+	parser = ucl_parser_new (UCL_PARSER_ZEROCOPY);
+	if (ucl_parser_add_fd (parser, fds[0])) {
+		test_obj = ucl_parser_get_object (parser);
+		assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "key")),
+				"compressed") == 0);
+		ucl_object_unref (test_obj);
+	}
+	else {
+		assert (strstr (ucl_parser_get_error (parser), "not supported") != NULL);
+	}
+	ucl_parser_free (parser);
+	close (fds[0]);
+
+	/* Compressed output, parsed back if the format is supported */
+	assert (pipe (fds) == 0);
+	fn = ucl_object_emit_fd_funcs (fds[1]);
+	gz = ucl_object_emit_compressed_funcs (fn, UCL_COMPRESSION_GZIP, 0);
+	if (gz != NULL) {
+		test_obj = ucl_object_typed_new (UCL_OBJECT);
+		ucl_object_insert_key (test_obj, ucl_object_fromstring ("compressed"),
+				"key", 0, false);
+		assert (ucl_object_emit_full (test_obj, UCL_EMIT_JSON, gz, NULL));
+		ucl_object_emit_funcs_free (gz);
+		ucl_object_unref (test_obj);
+		close (fds[1]);
+		parser = ucl_parser_new (0);
+		assert (ucl_parser_add_fd (parser, fds[0]));
+		test_obj = ucl_parser_get_object (parser);
+		assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "key")),
+				"compressed") == 0);
+		ucl_object_unref (test_obj);
+		ucl_parser_free (parser);
+	}
+	else {
+		close (fds[1]);
+	}
+	ucl_object_emit_funcs_free (fn);
+	close (fds[0]);
+
+	/* Highly compressed data is limited when decompressed */
+	emitted = malloc (1024 * 1024);
+	assert (emitted != NULL);
+	memset (emitted, 'a', 1024 * 1024);
+	test_obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (test_obj, ucl_object_fromlstring ((char *)emitted,
+			1024 * 1024), "big", 0, false);
+	free (emitted);
+	for (i = UCL_COMPRESSION_GZIP; i <= UCL_COMPRESSION_ZSTD; i ++) {
+		if (!compressed_parse (i, test_obj, 0, &cur)) {
+			continue;
+		}
+		assert (cur != NULL);
+		assert (ucl_object_compare (cur, test_obj) == 0);
+		ucl_object_unref (cur);
+		assert (compressed_parse (i, test_obj, 64 * 1024, &cur));
+		assert (cur == NULL);
+	}
+	ucl_object_unref (test_obj);
+
+	/* Parser reset */
+	parser = ucl_parser_new (0);
+	ucl_parser_register_variable (parser, "V", "reused");
+	assert (!ucl_parser_add_string (parser, "a = ]", 0));
+	assert (ucl_parser_reset (parser));
+	assert (ucl_parser_get_error (parser) == NULL);
+	assert (ucl_parser_add_string (parser, "a = $V", 0));
+	test_obj = ucl_parser_get_object (parser);
+	assert (strcmp (ucl_object_tostring (ucl_object_lookup (test_obj, "a")),
+			"reused") == 0);
+	ucl_object_unref (test_obj);
+	ucl_parser_free (parser);
+
+	/* Projection */
+	parser = ucl_parser_new (0);
+	assert (ucl_parser_add_projection (parser, "a.c.d"));
+	assert (ucl_parser_add_projection (parser, "f.id"));
+	assert (ucl_parser_add_projection (parser, "h"));
+	assert (!ucl_parser_add_projection (parser, "a..b"));
+	assert (ucl_parser_add_string (parser, "a { b = 1; c { d = 2; e = 3 } }\n"
+			"f = [{id = 1, x = 2}, {id = 2, y = [1, 2]}]; g = \"s\";\n"
+			"h { i = 1 } z = <<EOD\n{\nEOD\nk \"l\" { m = 1 }", 0));
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	emitted = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted, "{\"a\":{\"c\":{\"d\":2}},"
+			"\"f\":[{\"id\":1},{\"id\":2}],\"h\":{\"i\":1}}") == 0);
+	free (emitted);
+	ucl_object_unref (test_obj);
+
+	/* Asynchronous includes are parsed in order once supplied */
+	parser = ucl_parser_new (0);
+	ar = ucl_object_typed_new (UCL_ARRAY);
+	ucl_parser_set_include_fetcher (parser, include_collect, ar);
+	assert (ucl_parser_add_string (parser, "a = 1;\n.include \"x.conf\"\n"
+			"s { .include(prefix=true,key=\"p\") \"y.conf\" }\n"
+			".try_include \"z.conf\"\n", 0));
+	assert (ucl_parser_pending_includes (parser) == 3);
+	assert (ucl_parser_include_data (parser, 1,
+			(const unsigned char *)"c = 3;\n.include \"w.conf\"\n", 25));
+	assert (ucl_parser_include_data (parser, 2, NULL, 0));
+	assert (ucl_parser_pending_includes (parser) == 3);
+	assert (ucl_parser_include_data (parser, 0,
+			(const unsigned char *)"b = 2", 5));
+	assert (ucl_parser_pending_includes (parser) == 1);
+	assert (!ucl_parser_include_data (parser, 0,
+			(const unsigned char *)"b = 2", 5));
+	assert (ucl_parser_include_data (parser, 3,
+			(const unsigned char *)"d = 4", 5));
+	assert (ucl_parser_pending_includes (parser) == 0);
+	assert (strcmp (ucl_object_tostring (ucl_array_find_index (ar, 3)),
+			"w.conf") == 0);
+	test_obj = ucl_parser_get_object (parser);
+	ucl_parser_free (parser);
+	emitted = ucl_object_emit (test_obj, UCL_EMIT_JSON_COMPACT);
+	assert (strcmp ((char *)emitted,
+			"{\"a\":1,\"s\":{\"p\":{\"c\":3,\"d\":4}},\"b\":2}") == 0);
+	free (emitted);
+	ucl_object_unref (test_obj);
+	ucl_object_unref (ar);
+
+	include_order_test ();
+
+	sliced_parse_test ();
+
+	watcher_splice_test ();
+	watcher_files_test ();
+	watcher_retry_test ();
+	watcher_inotify_test ();
+	url_cache_test ();
+	batch_parse_test ();
+	borrowed_priority_test ();
+	diff_patch_roundtrip_test ();
+	hash_content_test ();
+	packed_read_test ();
+
 	emitted = ucl_object_emit (obj, UCL_EMIT_CONFIG);
 
 	fprintf (out, "%s\n", emitted);
@@ -26,6 +26,8 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -56,6 +58,159 @@ get_ticks (void)
 	return res;
 }
 
+static int
+bench_variables (void)
+{
+	const int nvars = 512, nkeys = 50000;
+	struct ucl_parser *parser;
+	ucl_object_t *obj;
+	char name[32], value[32], *buf, *p;
+	size_t buflen;
+	double start, end;
+	int i, ret = 0;
+
+	parser = ucl_parser_new (0);
+
+	for (i = 0; i < nvars; i ++) {
+		snprintf (name, sizeof (name), "VARIABLE_%d", i);
+		snprintf (value, sizeof (value), "value-%d", i);
+		ucl_parser_register_variable (parser, name, value);
+	}
+
+	buflen = nkeys * 96;
+	buf = malloc (buflen);
+	p = buf;
+
+	for (i = 0; i < nkeys; i ++) {
+		p += snprintf (p, buflen - (p - buf),
+				"key%d = \"${VARIABLE_%d}/$VARIABLE_%d/$$x/${UNKNOWN}\";\n",
+				i, i % nvars, (i * 7) % nvars);
+	}
+
+	start = get_ticks ();
+	ucl_parser_add_chunk (parser, (unsigned char *)buf, p - buf);
+	obj = ucl_parser_get_object (parser);
+	end = get_ticks ();
+
+	printf ("ucl: expanded %d variables in %.4f seconds\n", nkeys * 2,
+			end - start);
+
+	if (obj == NULL || strcmp (ucl_object_tostring (
+			ucl_object_lookup (obj, "key9")),
+			"value-9/value-63/$x/${UNKNOWN}") != 0) {
+		printf ("Variables expansion failed\n");
+		ret = 1;
+	}
+
+	ucl_object_unref (obj);
+	ucl_parser_free (parser);
+	free (buf);
+
+	return ret;
+}
+
+static int
+bench_comments (void)
+{
+	const int nsections = 20000;
+	struct ucl_parser *parser;
+	ucl_object_t *obj;
+	char *buf, *p;
+	size_t buflen;
+	double start, end;
+	int i, ret = 0;
+
+	buflen = nsections * 320;
+	buf = malloc (buflen);
+	p = buf;
+
+	for (i = 0; i < nsections; i ++) {
+		p += snprintf (p, buflen - (p - buf),
+				"# Section %d of the generated configuration file\n"
+				"section%d {\n"
+				"        /* Nested /* multiline */ comment\n"
+				"           describing the options below */\n"
+				"        enabled = true;      # trailing comment\n"
+				"\n"
+				"        text = <<EOD\n"
+				"A heredoc that spans a couple of lines\n"
+				"and is terminated by a marker\n"
+				"EOD\n"
+				"}\n\n",
+				i, i);
+	}
+
+	parser = ucl_parser_new (0);
+	start = get_ticks ();
+	ucl_parser_add_chunk (parser, (unsigned char *)buf, p - buf);
+	obj = ucl_parser_get_object (parser);
+	end = get_ticks ();
+
+	printf ("ucl: parsed commented input in %.4f seconds\n", end - start);
+
+	if (obj == NULL || obj->len != (unsigned)nsections ||
+			ucl_object_lookup_path (obj, "section7.text") == NULL) {
+		printf ("Comments skipping failed: %s\n",
+				ucl_parser_get_error (parser));
+		ret = 1;
+	}
+
+	ucl_object_unref (obj);
+	ucl_parser_free (parser);
+	free (buf);
+
+	return ret;
+}
+
+static int
+bench_small_documents (void)
+{
+	const int ndocs = 50000;
+	const char *doc = "{\"id\": 42, \"name\": \"message\", \"ok\": true}";
+	struct ucl_parser *parser;
+	ucl_object_t *obj;
+	double start, end;
+	int i, ret = 0;
+
+	start = get_ticks ();
+	for (i = 0; i < ndocs; i ++) {
+		parser = ucl_parser_new (0);
+		ucl_parser_add_string (parser, doc, 0);
+		obj = ucl_parser_get_object (parser);
+		ucl_object_unref (obj);
+		ucl_parser_free (parser);
+	}
+	end = get_ticks ();
+
+	printf ("ucl: %d documents with new parsers: %.4f us per document\n",
+			ndocs, (end - start) * 1e6 / ndocs);
+
+	start = get_ticks ();
+	for (i = 0; i < ndocs; i ++) {
+		parser = ucl_parser_pool_get (0);
+		if (!ucl_parser_add_string (parser, doc, 0)) {
+			ret = 1;
+		}
+		obj = ucl_parser_get_object (parser);
+		if (ucl_object_toint (ucl_object_lookup (obj, "id")) != 42) {
+			ret = 1;
+		}
+		ucl_object_unref (obj);
+		ucl_parser_pool_put (parser);
+	}
+	end = get_ticks ();
+	ucl_parser_pool_drain ();
+
+	printf ("ucl: %d documents with pooled parsers: %.4f us per document\n",
+			ndocs, (end - start) * 1e6 / ndocs);
+
+	if (ret != 0) {
+		printf ("Pooled parsing failed\n");
+	}
+
+	return ret;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -144,6 +299,10 @@ main (int argc, char **argv)
 	ucl_parser_free (parser);
 	ucl_object_unref (obj);
 
+	ret = bench_variables ();
+	ret += bench_comments ();
+	ret += bench_small_documents ();
+
 err:
 	munmap (map, st.st_size);
 
@@ -52,8 +52,6 @@ int main(int argc, char **argv) {
   char ch;
   FILE *in = stdin, *out = stdout;
   const char *schema = NULL;
-  unsigned char *buf = NULL;
-  size_t size = 0, r = 0;
   struct ucl_parser *parser = NULL;
   ucl_object_t *obj = NULL;
   ucl_emitter_t emitter = UCL_EMIT_CONFIG;
@@ -104,29 +102,12 @@ int main(int argc, char **argv) {
   }
 
   parser = ucl_parser_new(0);
-  buf = malloc(BUFSIZ);
-  size = BUFSIZ;
-  while(!feof(in) && !ferror(in)) {
-    if (r == size) {
-      buf = realloc(buf, size*2);
-      size *= 2;
-      if (buf == NULL) {
-        perror("realloc");
-        exit(EXIT_FAILURE);
-      }
-    }
-    r += fread(buf + r, 1, size - r, in);
-  }
-  if (ferror(in)) {
-    fprintf(stderr, "Failed to read the input file.\n");
-    exit(EXIT_FAILURE);
-  }
-  fclose(in);
-  if (!ucl_parser_add_chunk(parser, buf, r)) {
+  if (!ucl_parser_add_fd(parser, fileno(in))) {
     fprintf(stderr, "Failed to parse input file: %s\n",
             ucl_parser_get_error(parser));
     exit(EXIT_FAILURE);
   }
+  fclose(in);
   if ((obj = ucl_parser_get_object(parser)) == NULL) {
     fprintf(stderr, "Failed to get root object: %s\n",
             ucl_parser_get_error(parser));